@@ -0,0 +1,44 @@
+/**
+ * Battery Guard Multi-Device Monitor - AES-128-CBC Helpers
+ */
+
+#ifndef AES_CRYPTO_H
+#define AES_CRYPTO_H
+
+#include <Arduino.h>
+#include <mbedtls/aes.h>
+
+// ============================================================================
+// AES Initialization Vector (Zero IV)
+// ============================================================================
+const uint8_t AES_IV[16] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+// ============================================================================
+// AES Encryption/Decryption (single 16-byte block)
+// ============================================================================
+inline void aes_encrypt(const uint8_t* input, uint8_t* output, const uint8_t* key) {
+    uint8_t iv_copy[16];
+    memcpy(iv_copy, AES_IV, 16);  // Make a copy since CBC modifies IV
+    
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_enc(&aes, key, 128);
+    mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_ENCRYPT, 16, iv_copy, input, output);
+    mbedtls_aes_free(&aes);
+}
+
+inline void aes_decrypt(const uint8_t* input, uint8_t* output, const uint8_t* key) {
+    uint8_t iv_copy[16];
+    memcpy(iv_copy, AES_IV, 16);  // Make a copy since CBC modifies IV
+    
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_dec(&aes, key, 128);
+    mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_DECRYPT, 16, iv_copy, input, output);
+    mbedtls_aes_free(&aes);
+}
+
+#endif // AES_CRYPTO_H
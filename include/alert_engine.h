@@ -0,0 +1,157 @@
+/**
+ * Battery Guard Multi-Device Monitor - Edge Alert Engine
+ *
+ * Threshold rules evaluated on every parsed frame, so an alert goes out
+ * within one frame (plus the network task cycle) instead of after the next
+ * MQTT publish interval.
+ *
+ * Rules are set at runtime (MQTT <prefix>/batteryguard/_gateway/rules),
+ * stored in NVS and compiled to a small stack bytecode when they are set:
+ *
+ *   when:  "voltage < 11.8 and not charging"      raise condition
+ *   for:   30                                      must hold 30s (debounce)
+ *   clear: "voltage > 12.1"                        hysteresis (default: not when)
+ *   clear_for: 10                                  must hold 10s to clear
+ *
+ * Signals: voltage, soc, temperature, charging, resting, soh, soc_rate (%/h),
+ * to_reserve_h, vdrop_1m / vrise_1m (rapid voltage events in the last 60s).
+ * Only the signals a rule set uses are computed per frame. Evaluation time
+ * is reported as the "rules" latency in the gateway telemetry.
+ */
+
+#ifndef ALERT_ENGINE_H
+#define ALERT_ENGINE_H
+
+#include <Arduino.h>
+#include "config_defaults.h"
+#include "battery_monitor.h"
+
+#define ALERT_MAX_RULES 8
+#define ALERT_ID_LEN 24
+#define ALERT_EXPR_LEN 64
+#define ALERT_CODE_LEN 48
+#define ALERT_MAX_CONSTS 8
+#define ALERT_STACK_DEPTH 8
+#define ALERT_EVENT_HISTORY 8       // Rapid voltage events remembered per device
+
+enum AlertSignal : uint8_t {
+    SIG_VOLTAGE,
+    SIG_SOC,
+    SIG_TEMPERATURE,
+    SIG_CHARGING,
+    SIG_RESTING,
+    SIG_SOH,
+    SIG_SOC_RATE,
+    SIG_TO_RESERVE_H,
+    SIG_VDROP_1M,
+    SIG_VRISE_1M,
+    SIG_COUNT
+};
+
+// Compiled expression
+struct AlertProgram {
+    uint8_t code[ALERT_CODE_LEN];
+    float consts[ALERT_MAX_CONSTS];
+    uint8_t length;             // 0 = empty
+    uint16_t signals;           // Bit mask of AlertSignal used
+};
+
+// Rule as set by the user (persisted in NVS)
+struct AlertRuleSource {
+    char id[ALERT_ID_LEN];
+    char device[32];            // mqttName, empty = all devices
+    char when[ALERT_EXPR_LEN];
+    char clear[ALERT_EXPR_LEN]; // Empty = clears when "when" is false
+    uint16_t forSeconds;
+    uint16_t clearForSeconds;
+};
+
+// Raised/cleared alert handed to the network task
+struct AlertMessage {
+    char rule[ALERT_ID_LEN];
+    char device[32];
+    bool raised;
+    float voltage;
+    uint8_t soc;
+    int8_t temperature;
+    int64_t epochMs;            // 0 = clock not synced
+};
+
+class AlertEngine {
+public:
+    AlertEngine();
+
+    // Load and compile the stored rules (setup)
+    void begin();
+
+    // Sample task: evaluate all rules against the monitor's latest frame
+    void evaluate(const BatteryMonitor* monitor, uint8_t index, unsigned long nowMs);
+
+    // Network task: rule commands (results via takeResult)
+    void setRule(const AlertRuleSource& rule);
+    void deleteRule(const char* id);
+    void listRules();
+    void rejectCommand(const char* error);
+    bool takeResult(char* buf, size_t len);
+
+    // Network task: next raised/cleared alert
+    bool takeAlert(AlertMessage& message);
+
+    // Compile an expression; returns nullptr or an error message
+    static const char* compile(const char* expr, AlertProgram& program);
+
+private:
+    struct ActiveRule {
+        char id[ALERT_ID_LEN];
+        char device[32];
+        AlertProgram when;
+        AlertProgram clear;
+        uint32_t forMs;
+        uint32_t clearForMs;
+    };
+
+    struct RuleState {
+        bool active;            // Alert raised
+        bool pending;           // Condition (raise or clear) currently holding
+        unsigned long since;    // When it started holding
+    };
+
+    struct DeviceEvents {
+        bool seen;
+        uint16_t lastDrop, lastRise;
+        unsigned long dropTimes[ALERT_EVENT_HISTORY];
+        unsigned long riseTimes[ALERT_EVENT_HISTORY];
+        uint8_t dropNext, riseNext;
+    };
+
+    // Network task side (authoritative)
+    AlertRuleSource sources[ALERT_MAX_RULES];
+    ActiveRule staged[ALERT_MAX_RULES];
+    uint8_t stagedCount;
+    volatile bool stagedReady;
+    char result[640];
+    volatile bool resultPending;
+
+    // Sample task side
+    ActiveRule active[ALERT_MAX_RULES];
+    uint8_t activeCount;
+    uint16_t activeSignals;
+    RuleState states[ALERT_MAX_RULES][MAX_MONITORS];
+    DeviceEvents events[MAX_MONITORS];
+
+    QueueHandle_t alertQueue;
+    uint32_t alertDrops;
+
+    void stage();
+    void save();
+    void adopt();
+    void setResult(const char* op, bool ok, const char* error);
+    void recordEvents(const BatteryMonitor* monitor, uint8_t index, unsigned long nowMs);
+    void loadSignals(const BatteryMonitor* monitor, uint8_t index, unsigned long nowMs, float* signals);
+    static bool run(const AlertProgram& program, const float* signals);
+    void emit(const ActiveRule& rule, const BatteryMonitor* monitor, bool raised);
+};
+
+extern AlertEngine alertEngine;
+
+#endif // ALERT_ENGINE_H
@@ -5,10 +5,18 @@
 #ifndef BATTERY_MONITOR_H
 #define BATTERY_MONITOR_H
 
-#include <Arduino.h>
-#include <NimBLEDevice.h>
+#include "port_lock.h"
 #include "types.h"
-#include "config.h"
+#include "config_defaults.h"
+#include "monitor_policies.h"
+#include "protocol_decoder.h"
+#include "device_table.h"
+#include "rolling_stats.h"
+#include "health_estimator.h"
+#include "trend_predictor.h"
+#include "link_timing.h"
+
+#define LIVENESS_GRACE_MS 2000  // No stale check right after entering MONITORING
 
 // ============================================================================
 // Device State Definitions
@@ -34,27 +42,79 @@ inline const char* stateToString(DeviceState state) {
     }
 }
 
+// ============================================================================
+// Connection Phases & Metrics
+// ============================================================================
+enum ConnectPhase : uint8_t {
+    PHASE_CONNECT,          // Link establishment
+    PHASE_DISCOVER,         // Service/characteristic discovery
+    PHASE_SUBSCRIBE,        // Notification subscription
+    PHASE_HANDSHAKE,        // Encrypted handshake writes
+    PHASE_COUNT
+};
+
+inline const char* phaseToString(ConnectPhase phase) {
+    switch(phase) {
+        case PHASE_CONNECT: return "connect";
+        case PHASE_DISCOVER: return "discover";
+        case PHASE_SUBSCRIBE: return "subscribe";
+        case PHASE_HANDSHAKE: return "handshake";
+        default: return "unknown";
+    }
+}
+
+// Durations of the most recent attempt plus running totals, so connect
+// latency can be tuned per phase
+struct ConnectionMetrics {
+    uint32_t attempts;                      // Connection attempts started
+    uint32_t successes;                     // Attempts that reached MONITORING
+    uint32_t failures[PHASE_COUNT];         // Failed attempts per phase
+    uint32_t overruns[PHASE_COUNT];         // Phases that exceeded their budget (also failures)
+    uint32_t lastPhaseMs[PHASE_COUNT];      // Phase durations of last attempt
+    uint32_t lastTotalMs;                   // Total duration of last successful attempt
+    uint32_t totalMsSum;                    // Sum over successful attempts (for average)
+    
+    uint32_t averageTotalMs() const {
+        return successes ? totalMsSum / successes : 0;
+    }
+};
+
 // ============================================================================
 // Battery Monitor Class
 // ============================================================================
-class BatteryMonitor {
+// Policies (see monitor_policies.h): Transport owns the BLE link types,
+// Cipher the frame crypto, Clock the time/random source, Logger the output.
+template <class TransportPolicy, class CipherPolicy, class ClockPolicy, class LoggerPolicy>
+class BasicBatteryMonitor {
 public:
+    typedef TransportPolicy Transport;
+    typedef CipherPolicy Cipher;
+    typedef ClockPolicy Clock;
+    typedef LoggerPolicy Logger;
+    
     // Configuration
     uint8_t configIndex;
     const DeviceConfig* config;
+    const ProtocolDecoder* decoder;  // Selected by config->protocol
+    const DeviceIdentity* identity;  // Binary MAC, state topic, discovery id
     
     // BLE
-    NimBLEClient* pClient;
-    NimBLERemoteCharacteristic* pWriteChar;
-    NimBLERemoteCharacteristic* pNotifyChar;
+    typename Transport::Client* pClient;
+    typename Transport::Characteristic* pWriteChar;
+    typename Transport::Characteristic* pNotifyChar;
     
     // State
     DeviceState state;
-    uint8_t connectRetries;
-    unsigned long lastRetryTime;
+    uint8_t connectRetries;         // Consecutive failed attempts
+    unsigned long lastRetryTime;    // When the current backoff started
+    uint32_t retryDelayMs;          // Backoff chosen after the last failure
     unsigned long lastNotificationTime;
     unsigned long stateEnterTime;  // When we entered current state
-    NimBLEAddress deviceAddress;  // Store discovered device address
+    typename Transport::Address deviceAddress;  // Store discovered device address
+    int8_t lastAdvRssi;             // RSSI of the last matching advertisement
+    unsigned long lastAdvTime;      // When it was heard (0 = never)
+    uint32_t weakSignalSkips;       // Advertisements ignored for low RSSI
+    ConnectionMetrics connectMetrics;
     
     // Data
     float voltage;
@@ -64,56 +124,174 @@ public:
     uint16_t rapidVoltageRise;  // Rapid voltage rise event counter (e.g., alternator starts)
     uint16_t rapidVoltageDrop;  // Rapid voltage drop event counter (e.g., heavy load, engine off)
     unsigned long lastUpdateTime;
+    int64_t sampleArrivalUs;  // esp_timer time the current reading arrived
+    int64_t sampleEpochMs;    // UTC epoch ms of that arrival (0 = clock not synced)
     uint8_t notifyCount;  // Track notification count (skip first 5 due to invalid data)
+    bool restoredSample;  // Data fields hold a reading restored after warm restart
+    DeviceStats stats;    // Rolling windows over every parsed frame
+    HealthEstimator health;  // Resting voltage, crank sag, state of health
+    TrendPredictor trend;    // SOC slope, time to reserve / full
+    
+    // Liveness - notification inter-arrival statistics
+    FrameCadence cadence;
+    
+    // Guards the reading, cadence and device address against the
+    // StorageTask snapshot (writers: notify callback, SampleTask, loopTask)
+    mutable portMUX_TYPE sampleLock;
+    
+    // Bumped by reset(); frames queued for SampleTask carry the value seen
+    // at arrival, so those of a previous device in this slot are dropped
+    volatile uint8_t generation;
     
-    BatteryMonitor() :
-        configIndex(0), config(nullptr), pClient(nullptr), 
+    BasicBatteryMonitor() :
+        configIndex(0), config(nullptr), decoder(nullptr), identity(nullptr), pClient(nullptr), 
         pWriteChar(nullptr), pNotifyChar(nullptr),
         state(STATE_DISCONNECTED), connectRetries(0), 
-        lastRetryTime(0), lastNotificationTime(0), stateEnterTime(0),
-        deviceAddress(NimBLEAddress("")),
+        lastRetryTime(0), retryDelayMs(0),
+        lastNotificationTime(0), stateEnterTime(0),
+        deviceAddress(typename Transport::Address("")),
+        lastAdvRssi(-127), lastAdvTime(0), weakSignalSkips(0),
+        connectMetrics(),
         voltage(0), soc(0), temperature(0), status(0),
         rapidVoltageRise(0), rapidVoltageDrop(0),
-        lastUpdateTime(0), notifyCount(0) {}
+        lastUpdateTime(0), sampleArrivalUs(0), sampleEpochMs(0), notifyCount(0), restoredSample(false),
+        cadence(), generation(0) {
+        portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+        sampleLock = unlocked;
+    }
+    
+    // Back to the constructed state for a re-provisioned slot, in place:
+    // other tasks may be inside sampleLock or the stats/trend locks, so the
+    // object is never reassigned. The pooled client, config and identity
+    // pointers stay; init() rebinds them. Call after cleanup().
+    void reset() {
+        portENTER_CRITICAL(&sampleLock);
+        generation++;
+        pWriteChar = nullptr;
+        pNotifyChar = nullptr;
+        state = STATE_DISCONNECTED;
+        connectRetries = 0;
+        lastRetryTime = 0;
+        retryDelayMs = 0;
+        lastNotificationTime = 0;
+        stateEnterTime = 0;
+        deviceAddress = typename Transport::Address("");
+        lastAdvRssi = -127;
+        lastAdvTime = 0;
+        weakSignalSkips = 0;
+        connectMetrics = ConnectionMetrics();
+        voltage = 0;
+        soc = 0;
+        temperature = 0;
+        status = 0;
+        rapidVoltageRise = 0;
+        rapidVoltageDrop = 0;
+        lastUpdateTime = 0;
+        sampleArrivalUs = 0;
+        sampleEpochMs = 0;
+        notifyCount = 0;
+        restoredSample = false;
+        cadence = FrameCadence();
+        portEXIT_CRITICAL(&sampleLock);
+        stats.begin();
+        trend.reset();
+        health.reset();
+    }
     
-    void init(uint8_t index, const DeviceConfig* cfg) {
+    void init(uint8_t index, const DeviceConfig* cfg, const DeviceIdentity* id) {
         configIndex = index;
         config = cfg;
+        identity = id;
+        decoder = decoderFor(cfg->protocol);
+        stats.begin();
+        health.begin(cfg->type);
         state = STATE_DISCONNECTED;
         connectRetries = 0;
         
-        Serial.printf("[%s] Initialized: %s (Type: 0x%02X)\n", 
-            config->name, config->serial, config->type);
+        Logger::printf("[%s] Initialized: %s (Type: 0x%02X, %s)\n", 
+            config->name, config->serial, config->type, decoder->name);
     }
     
-    String getMacAddress() {
-        String mac = config->serial;
-        // Convert "50547B815AFB" to "50:54:7B:81:5A:FB"
-        String formatted = "";
-        for (int i = 0; i < 12; i += 2) {
-            if (i > 0) formatted += ":";
-            formatted += mac.substring(i, i + 2);
+    // Allocate this slot's BLE client once at startup. The client and its
+    // callbacks are reused for every connection attempt instead of being
+    // created and deleted per retry, which keeps the heap from fragmenting.
+    bool attachClient(typename Transport::Callbacks* callbacks) {
+        pClient = Transport::createClient(callbacks);
+        if (!pClient) {
+            Logger::printf("[BLE] ERROR: Could not allocate BLE client for slot %d\n", configIndex);
+            return false;
         }
-        return formatted;
+        return true;
+    }
+    
+    // "50:54:7B:81:5A:FB"
+    void formatMacAddress(char (&formatted)[18]) const {
+        const uint8_t* b = identity->mac.bytes;
+        snprintf(formatted, sizeof(formatted), "%02X:%02X:%02X:%02X:%02X:%02X",
+            b[0], b[1], b[2], b[3], b[4], b[5]);
+    }
+#ifdef ARDUINO
+    String getMacAddress() const {
+        char formatted[18];
+        formatMacAddress(formatted);
+        return String(formatted);
+    }
+#endif
+    
+    // Record a notification arrival and update inter-arrival statistics.
+    // Gaps longer than 1.5 expected intervals count as missed frames; if
+    // network activity happened inside the gap they are attributed to it.
+    void recordFrameArrival(unsigned long now, unsigned long lastNetActivity = 0) {
+        portENTER_CRITICAL(&sampleLock);
+        cadence.record(now, lastNetActivity, LIVENESS_MIN_SAMPLES);
+        portEXIT_CRITICAL(&sampleLock);
+        lastNotificationTime = now;
+    }
+    
+    // Silence after which the link is declared stale: LIVENESS_MISSED_FRAMES
+    // expected frames plus jitter margin, clamped to [floor, ceiling].
+    // Until the cadence is learned the ceiling (NOTIFICATION_TIMEOUT_MS) applies.
+    uint32_t livenessTimeoutMs() const {
+        return cadence.timeoutMs(LIVENESS_MISSED_FRAMES, LIVENESS_TIMEOUT_MIN_MS,
+            NOTIFICATION_TIMEOUT_MS, LIVENESS_MIN_SAMPLES);
+    }
+    
+    // Monitoring, past the grace period after the handshake, and silent for
+    // longer than livenessTimeoutMs()
+    bool linkStale(unsigned long now) const {
+        return state == STATE_MONITORING &&
+            elapsedMs(now, stateEnterTime) > LIVENESS_GRACE_MS &&
+            elapsedMs(now, lastNotificationTime) > livenessTimeoutMs();
     }
     
+    // Reset the pooled client in place (the client itself is kept)
     void cleanup() {
-        if (pClient) {
-            if (pClient->isConnected()) {
-                pClient->disconnect();
-            }
-            NimBLEDevice::deleteClient(pClient);
-            pClient = nullptr;
+        if (Transport::isConnected(pClient)) {
+            Transport::disconnect(pClient);
         }
         pWriteChar = nullptr;
         pNotifyChar = nullptr;
+        cadence.lastArrival = 0;  // Cadence stats are kept, only the gap restarts
         state = STATE_DISCONNECTED;
     }
     
+    // Schedule the next attempt after a failure. The first MAX_CONNECT_RETRIES
+    // failures retry after RECONNECT_DELAY_MS, after that the delay doubles
+    // up to RETRY_COOLDOWN_MS. +/-25% jitter keeps devices out of lockstep.
+    uint32_t scheduleRetry(unsigned long now) {
+        uint32_t delayMs = backoffDelayMs(connectRetries, MAX_CONNECT_RETRIES,
+            RECONNECT_DELAY_MS, RETRY_COOLDOWN_MS, Clock::random());
+        
+        retryDelayMs = delayMs;
+        lastRetryTime = now;
+        state = STATE_COOLDOWN;
+        return delayMs;
+    }
+    
+    // True while the backoff delay has not expired
     bool isInCooldown() {
         if (state == STATE_COOLDOWN) {
-            if (millis() - lastRetryTime >= RETRY_COOLDOWN_MS) {
-                connectRetries = 0;
+            if (intervalElapsed(Clock::now(), lastRetryTime, retryDelayMs)) {
                 state = STATE_DISCONNECTED;
                 return false;
             }
@@ -121,6 +299,31 @@ public:
         }
         return false;
     }
+    
+    // Record a matching advertisement; returns true if it is strong enough
+    // to be worth a connection attempt
+    bool recordAdvertisement(int rssi, unsigned long now) {
+        lastAdvRssi = (int8_t)(rssi < -127 ? -127 : rssi > 0 ? 0 : rssi);
+        lastAdvTime = now;
+        if (rssi < MIN_CONNECT_RSSI) {
+            weakSignalSkips++;
+            return false;
+        }
+        return true;
+    }
+    
+    // Advertisement recent enough to expect the device is still reachable
+    bool recentlyHeard(unsigned long now) const {
+        return lastAdvTime != 0 && elapsedMs(now, lastAdvTime) <= ADV_MAX_AGE_MS;
+    }
 };
 
+#ifdef ARDUINO
+// The ESP32 build
+typedef BasicBatteryMonitor<NimBLETransport, AesCipher, SystemClock, SerialLogger> BatteryMonitor;
+#else
+// Host build: simulated link on the virtual clock (native tests, benchmarks)
+typedef BasicBatteryMonitor<SimTransport, PlainCipher, SystemClock, StdioLogger> BatteryMonitor;
+#endif
+
 #endif // BATTERY_MONITOR_H
@@ -0,0 +1,88 @@
+/**
+ * Battery Guard Multi-Device Monitor - Clock and Sleep Source
+ *
+ * All state machine timing goes through these functions instead of calling
+ * millis()/delay()/esp_timer directly. On the target they compile to the
+ * framework calls. Building with -DVIRTUAL_CLOCK replaces them with a
+ * virtual clock that only moves when advanced (or slept on), plus a seeded
+ * random source, so long runs - millis() wraparound after 49.7 days,
+ * backoff sequences, publish cadence - can be simulated quickly and
+ * reproducibly. The virtual clock also builds off-target (the native test
+ * env, see test/), where it needs neither Arduino.h nor FreeRTOS.
+ *
+ * It also keeps the monotonic-to-UTC offset used to timestamp samples.
+ */
+
+#ifndef CLOCK_SOURCE_H
+#define CLOCK_SOURCE_H
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+#else
+  #include <stdint.h>
+  #include <thread>
+#endif
+
+#ifdef VIRTUAL_CLOCK
+
+// Virtual time in microseconds (64-bit, never wraps); millis() view wraps
+// like the real one
+extern volatile uint64_t g_virtualClockUs;
+extern uint32_t g_virtualRandomState;
+
+inline unsigned long clockMillis() { return (unsigned long)(uint32_t)(g_virtualClockUs / 1000); }
+inline int64_t clockMicros() { return (int64_t)g_virtualClockUs; }
+
+// Sleeping advances virtual time, then still gives other tasks (threads on
+// the host) the CPU so polling loops don't starve them or the watchdog
+inline void clockDelay(unsigned long ms) {
+    g_virtualClockUs += (uint64_t)ms * 1000;
+#ifdef ARDUINO
+    vTaskDelay(1);
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Simulation control
+inline void clockAdvance(uint32_t ms) { g_virtualClockUs += (uint64_t)ms * 1000; }
+inline void clockSetMillis(uint64_t ms) { g_virtualClockUs = ms * 1000; }
+inline void clockSeedRandom(uint32_t seed) { g_virtualRandomState = seed ? seed : 1; }
+
+// xorshift32 - deterministic for a given seed
+inline uint32_t clockRandom() {
+    uint32_t x = g_virtualRandomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    g_virtualRandomState = x;
+    return x;
+}
+
+#else
+
+#include <esp_timer.h>
+
+inline unsigned long clockMillis() { return millis(); }
+inline int64_t clockMicros() { return esp_timer_get_time(); }
+inline void clockDelay(unsigned long ms) { delay(ms); }
+inline uint32_t clockRandom() { return esp_random(); }
+
+#endif // VIRTUAL_CLOCK
+
+// ============================================================================
+// Wall clock
+// ============================================================================
+// Samples are stamped with clockMicros() at arrival and converted to UTC
+// through a cached monotonic-to-UTC offset, so no per-sample time()/gmtime
+// call is needed. The offset is refreshed whenever the system time is set
+// (NTP sync, warm restart restore).
+
+// Re-read the system time and update the offset; ignored until the clock
+// holds a plausible (synced) date
+void clockSyncWallTime();
+
+// UTC epoch milliseconds for a clockMicros() timestamp (0 = not synced yet)
+int64_t clockEpochMs(int64_t monoUs);
+
+#endif // CLOCK_SOURCE_H
@@ -0,0 +1,46 @@
+/**
+ * Battery Guard Multi-Device Monitor - BLE/WiFi Coexistence Scheduler
+ *
+ * The ESP32 shares one radio between BLE and WiFi. Bulk network work
+ * (discovery bursts, backlog replay) is deferred to the quiet window right
+ * after the monitored devices' notifications, so it doesn't collide with the
+ * next expected frame. Network activity is timestamped so missed frames can
+ * be attributed to it (see BatteryMonitor::recordFrameArrival).
+ */
+
+#ifndef COEX_SCHEDULER_H
+#define COEX_SCHEDULER_H
+
+#include <Arduino.h>
+#include "config_defaults.h"
+#include "battery_monitor.h"
+
+class CoexScheduler {
+public:
+    CoexScheduler();
+    
+    // Register monitors and apply the configured coexistence preference
+    void begin(const BatteryMonitor* monitors, uint8_t count);
+    
+    // Mark radio activity on the WiFi side (publish, connect, reassociation)
+    void noteNetworkActivity();
+    unsigned long lastNetworkActivity() const { return lastActivity; }
+    
+    // True if bulk network work may run now: no monitored device expects a
+    // frame within COEX_GUARD_MS, or work has been deferred for COEX_MAX_DEFER_MS
+    bool allowBulkWork();
+    
+    uint32_t deferrals() const { return deferCount; }
+    
+private:
+    const BatteryMonitor* monitors;
+    uint8_t monitorCount;
+    volatile unsigned long lastActivity;
+    portMUX_TYPE deferLock;         // Guards the two below (several callers)
+    unsigned long deferredSince;    // 0 = nothing deferred
+    uint32_t deferCount;
+};
+
+extern CoexScheduler coexScheduler;
+
+#endif // COEX_SCHEDULER_H
@@ -0,0 +1,155 @@
+/**
+ * Battery Guard Multi-Device Monitor - Configuration Defaults
+ *
+ * Includes the user's config.h and fills in every tunable it leaves out.
+ * Code includes this header instead of config.h, so each default is
+ * defined in exactly one place.
+ *
+ * Settings that have no sensible default stay required in config.h:
+ * AES keys, DEVICES[] (constexpr, see device_table.h), WiFi credentials,
+ * broker/InfluxDB/UDP hosts, and the scan, connect and retry settings.
+ */
+
+#ifndef CONFIG_DEFAULTS_H
+#define CONFIG_DEFAULTS_H
+
+#ifndef CONFIG_H     // The native test env force-includes test/native/config.h
+  #include "config.h"
+#endif
+
+// ============================================================================
+// BLE Connection
+// ============================================================================
+#ifndef DISCOVER_TIMEOUT_MS
+  #define DISCOVER_TIMEOUT_MS 5000
+#endif
+#ifndef SUBSCRIBE_TIMEOUT_MS
+  #define SUBSCRIBE_TIMEOUT_MS 2000
+#endif
+#ifndef HANDSHAKE_TIMEOUT_MS
+  #define HANDSHAKE_TIMEOUT_MS 3000
+#endif
+#ifndef MIN_CONNECT_RSSI
+  #define MIN_CONNECT_RSSI (-90)
+#endif
+#ifndef ADV_MAX_AGE_MS
+  #define ADV_MAX_AGE_MS 5000
+#endif
+
+// ============================================================================
+// BLE/WiFi Coexistence
+// ============================================================================
+#ifndef COEX_GUARD_MS
+  #define COEX_GUARD_MS 250
+#endif
+#ifndef COEX_MAX_DEFER_MS
+  #define COEX_MAX_DEFER_MS 10000
+#endif
+
+// ============================================================================
+// Monitoring
+// ============================================================================
+#ifndef LIVENESS_MISSED_FRAMES
+  #define LIVENESS_MISSED_FRAMES 5
+#endif
+#ifndef LIVENESS_TIMEOUT_MIN_MS
+  #define LIVENESS_TIMEOUT_MIN_MS 3000
+#endif
+#ifndef LIVENESS_MIN_SAMPLES
+  #define LIVENESS_MIN_SAMPLES 4
+#endif
+#ifndef SAMPLE_QUEUE_DEPTH
+  #define SAMPLE_QUEUE_DEPTH 16
+#endif
+#ifndef TELEMETRY_INTERVAL_MS
+  #define TELEMETRY_INTERVAL_MS 60000
+#endif
+#ifndef WARM_SNAPSHOT_INTERVAL_MS
+  #define WARM_SNAPSHOT_INTERVAL_MS 5000
+#endif
+
+// Rolling statistics windows
+#ifndef STATS_WINDOW_SHORT_MS
+  #define STATS_WINDOW_SHORT_MS 60000
+#endif
+#ifndef STATS_WINDOW_MEDIUM_MS
+  #define STATS_WINDOW_MEDIUM_MS 900000
+#endif
+#ifndef STATS_WINDOW_LONG_MS
+  #define STATS_WINDOW_LONG_MS 3600000
+#endif
+
+// Resting voltage / state of health estimator
+#ifndef REST_MIN_MS
+  #define REST_MIN_MS 1800000
+#endif
+#ifndef REST_TOLERANCE_MV
+  #define REST_TOLERANCE_MV 20
+#endif
+#ifndef CRANK_WINDOW_MS
+  #define CRANK_WINDOW_MS 3000
+#endif
+
+// SOC trend
+#ifndef TREND_RESERVE_SOC
+  #define TREND_RESERVE_SOC 50
+#endif
+#ifndef TREND_TAU_DISCHARGE_MS
+  #define TREND_TAU_DISCHARGE_MS 21600000
+#endif
+#ifndef TREND_TAU_CHARGE_MS
+  #define TREND_TAU_CHARGE_MS 1800000
+#endif
+
+// ============================================================================
+// MQTT Session
+// ============================================================================
+#ifndef MQTT_PREFIX
+  #define MQTT_PREFIX ""
+#endif
+#ifndef MQTT_KEEPALIVE_S
+  #define MQTT_KEEPALIVE_S 15
+#endif
+#ifndef MQTT_INFLIGHT_WINDOW
+  #define MQTT_INFLIGHT_WINDOW 4
+#endif
+#ifndef MQTT_RETRANSMIT_MS
+  #define MQTT_RETRANSMIT_MS 5000
+#endif
+#ifndef MQTT_OUTBOX_BYTES
+  #define MQTT_OUTBOX_BYTES 8192
+#endif
+#ifndef MQTT_BACKLOG_SAMPLES
+  #define MQTT_BACKLOG_SAMPLES 16
+#endif
+
+// ============================================================================
+// InfluxDB (INFLUX_HOST and INFLUX_PATH are required)
+// ============================================================================
+#ifndef INFLUX_PORT
+  #define INFLUX_PORT 8086
+#endif
+#ifndef INFLUX_MEASUREMENT
+  #define INFLUX_MEASUREMENT "battery"
+#endif
+#ifndef INFLUX_BATCH_BYTES
+  #define INFLUX_BATCH_BYTES 2048
+#endif
+#ifndef INFLUX_FLUSH_MS
+  #define INFLUX_FLUSH_MS 10000
+#endif
+#ifndef INFLUX_BATCHES
+  #define INFLUX_BATCHES 6
+#endif
+
+// ============================================================================
+// UDP Stream (UDP_HOST is required)
+// ============================================================================
+#ifndef UDP_PORT
+  #define UDP_PORT 4210
+#endif
+#ifndef UDP_INTERVAL_MS
+  #define UDP_INTERVAL_MS 1000
+#endif
+
+#endif // CONFIG_DEFAULTS_H
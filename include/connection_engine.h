@@ -0,0 +1,52 @@
+/**
+ * Battery Guard Multi-Device Monitor - Connection Engine
+ *
+ * Single implementation of the connect → discover → subscribe → handshake
+ * sequence. Phase durations are recorded in BatteryMonitor::connectMetrics.
+ * All link calls go through BatteryMonitor::Transport, so the same code runs
+ * against the simulated link in the native tests.
+ * Every phase has a budget (CONNECT/DISCOVER/SUBSCRIBE/HANDSHAKE_TIMEOUT_MS).
+ * The connect budget is passed to NimBLE. The discover and subscribe calls
+ * block until NimBLE returns and cannot be cut short, so their budget is
+ * checked when the call returns; the handshake budget is checked before
+ * each write. A phase over its budget fails the attempt like any other
+ * error (counted as an overrun and a failure of that phase).
+ */
+
+#ifndef CONNECTION_ENGINE_H
+#define CONNECTION_ENGINE_H
+
+#include "config_defaults.h"
+#include "battery_monitor.h"
+
+// Notification handler signature (matches NimBLE's notify_callback)
+typedef void (*NotifyHandler)(BatteryMonitor::Transport::Characteristic* pChar, uint8_t* pData, size_t length, bool isNotify);
+
+class ConnectionEngine {
+public:
+    explicit ConnectionEngine(NotifyHandler onNotify);
+    
+    // Run the full connection sequence for a monitor whose deviceAddress is set.
+    // On success the monitor is in STATE_MONITORING; on failure it is in
+    // STATE_COOLDOWN with the backoff delay from scheduleRetry().
+    bool connect(BatteryMonitor* monitor);
+    
+private:
+    NotifyHandler notifyHandler;
+    
+    bool runConnect(BatteryMonitor* monitor);
+    bool runDiscover(BatteryMonitor* monitor);
+    bool runSubscribe(BatteryMonitor* monitor);
+    bool runHandshake(BatteryMonitor* monitor);
+    
+    // Record phase duration; false (counted and logged as an overrun) if it
+    // exceeded its budget
+    bool finishPhase(BatteryMonitor* monitor, ConnectPhase phase, unsigned long startTime);
+    
+    // Common failure path for every phase: tear down, count retry, maybe cooldown
+    void fail(BatteryMonitor* monitor, ConnectPhase phase);
+};
+
+extern ConnectionEngine connectionEngine;
+
+#endif // CONNECTION_ENGINE_H
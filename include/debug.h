@@ -0,0 +1,33 @@
+/**
+ * Battery Guard Multi-Device Monitor - Debug Logging Macros
+ */
+
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+#else
+  #include <stdint.h>
+  #include <stddef.h>
+#endif
+#include "clock_source.h"
+
+// Debug mode controlled by platformio.ini build flags
+#ifndef DEBUG_MODE
+  #define DEBUG_MODE 0
+#endif
+
+#if DEBUG_MODE
+  #define DEBUG_PRINT(x) Serial.print(x)
+  #define DEBUG_PRINTF(...) Serial.printf(__VA_ARGS__)
+  #define DEBUG_PRINTLN(x) Serial.println(x)
+  #define DEBUG_TIMESTAMP() Serial.printf("[%6.2fs] ", clockMillis()/1000.0)
+#else
+  #define DEBUG_PRINT(x)
+  #define DEBUG_PRINTF(...)
+  #define DEBUG_PRINTLN(x)
+  #define DEBUG_TIMESTAMP()
+#endif
+
+#endif // DEBUG_H
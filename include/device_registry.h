@@ -0,0 +1,124 @@
+/**
+ * Battery Guard Multi-Device Monitor - Runtime Device Registry
+ *
+ * Owns the device table at runtime. At boot it is loaded from NVS if devices
+ * were provisioned before, otherwise from DEVICES[] in config.h. Commands
+ * (add/modify/remove, e.g. from the MQTT command topic) are queued from any
+ * task and applied by the control task: only the affected monitor slot is
+ * disconnected and re-initialised, all other links keep running. The
+ * resulting table is written back to NVS.
+ *
+ * Slot i of the registry always belongs to monitors[i]. A removed slot stays
+ * allocated as a disabled entry until an add reuses it.
+ */
+
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include <Arduino.h>
+#include "config_defaults.h"
+#include "types.h"
+#include "device_table.h"
+#include "battery_monitor.h"
+
+#define DEVICE_NAME_LEN 32
+
+struct DeviceSlot {
+    bool used;                          // false = free (removed or never assigned)
+    uint8_t keyIndex;                   // 1 = AES_KEY_1, 2 = AES_KEY_2, 0 = own key from config.h
+    uint8_t key[16];                    // Key bytes (persisted, so own keys survive a save)
+    char serial[13];
+    char name[DEVICE_NAME_LEN];
+    char mqttName[DEVICE_NAME_LEN];
+    DeviceConfig config;                // Points into the buffers above
+    DeviceIdentity identity;
+};
+
+enum DeviceCommandOp : uint8_t {
+    DEVICE_CMD_ADD,
+    DEVICE_CMD_MODIFY,
+    DEVICE_CMD_REMOVE,
+    DEVICE_CMD_LIST,
+    DEVICE_CMD_RESET                    // Forget NVS table (config.h used from next boot)
+};
+
+// Field values of -1 / empty strings mean "not given" (modify keeps the
+// current value, add uses the default)
+struct DeviceCommand {
+    DeviceCommandOp op;
+    char serial[13];
+    char name[DEVICE_NAME_LEN];
+    char mqttName[DEVICE_NAME_LEN];
+    int16_t type;
+    int8_t enabled;
+    int8_t protocol;
+    int8_t keyIndex;
+};
+
+class DeviceRegistry {
+public:
+    DeviceRegistry();
+
+    // Load the table (NVS, else config.h); returns the number of slots in use
+    uint8_t load();
+
+    const DeviceSlot& slot(uint8_t index) const { return slots[index]; }
+
+    // Queue a command (any task); false if the queue is full
+    bool submit(const DeviceCommand& command);
+
+    // Control task: apply queued commands to the monitors. count grows when
+    // a device is added to a new slot. Returns the changed slot or -1.
+    int8_t applyPending(BatteryMonitor* monitors, uint8_t& count);
+
+    // Control task: report the effect of the last change on the other
+    // devices once the observation window has passed
+    void checkDisruption(const BatteryMonitor* monitors, uint8_t count);
+
+    // Network task: take the JSON result of the last command
+    bool takeResult(char* buf, size_t len);
+
+    // Network task: slot whose name/topic changed since the last call. old
+    // is filled if the slot previously had a published identity.
+    bool takeNetworkChange(uint8_t index, DeviceIdentity& old, bool& hadOld);
+
+    // Report a command that could not be parsed (network task)
+    void rejectCommand(const char* error);
+
+private:
+    DeviceSlot slots[MAX_MONITORS];
+    uint8_t slotCount;
+    QueueHandle_t commandQueue;
+
+    // Result handed to the network task
+    char result[640];
+    volatile bool resultPending;
+
+    // Per-slot identity changes for the network task
+    DeviceIdentity retired[MAX_MONITORS];
+    bool retiredValid[MAX_MONITORS];
+    volatile bool networkDirty[MAX_MONITORS];
+
+    // Disruption measurement for the last change
+    int8_t watchSlot;
+    unsigned long watchStart;
+    uint32_t watchApplyMs;          // Control task time spent applying it
+    uint8_t watchMonitoring;
+    uint32_t watchMissed;
+
+    bool loadFromNvs();
+    void loadFromConfig();
+    void save();
+    bool fillSlot(DeviceSlot& slot, const DeviceCommand& command, const DeviceSlot* current, const char** error);
+    int8_t findSerial(const char* serial) const;
+    bool mqttNameTaken(const char* mqttName, int8_t except) const;
+    void reinitMonitor(BatteryMonitor& monitor, uint8_t index);
+    void markNetworkChange(uint8_t index, bool hadIdentity);
+    void startWatch(const BatteryMonitor* monitors, uint8_t count, int8_t index, uint32_t applyMs);
+    void setResult(const char* op, bool ok, const char* error);
+    void listResult();
+};
+
+extern DeviceRegistry deviceRegistry;
+
+#endif // DEVICE_REGISTRY_H
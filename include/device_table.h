@@ -0,0 +1,189 @@
+/**
+ * Battery Guard Multi-Device Monitor - Compiled Device Table
+ *
+ * Validates DEVICES[] from config.h at compile time and derives what the
+ * runtime needs per device: the MAC as 6 binary bytes, the MQTT state topic
+ * and the Home Assistant discovery id. Nothing is parsed or concatenated at
+ * runtime. A malformed serial, an invalid or duplicate mqttName or too many
+ * devices stops the build with a static_assert.
+ *
+ * C++11 constexpr only (single-return recursion, no loops).
+ */
+
+#ifndef DEVICE_TABLE_H
+#define DEVICE_TABLE_H
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+#else
+  #include <stdint.h>
+  #include <stddef.h>
+#endif
+#include "config_defaults.h"
+#include "types.h"
+
+#define DEVICE_TOPIC_LEN 96     // State topic / discovery id incl. terminator
+
+// ============================================================================
+// Runtime Representation
+// ============================================================================
+struct MacAddress {
+    uint8_t bytes[6];           // Display order ("50547B..." -> 0x50, 0x54, ...)
+
+    // NimBLE stores addresses little-endian (getNative())
+    bool matchesNative(const uint8_t* native) const {
+        for (uint8_t i = 0; i < 6; i++) {
+            if (bytes[i] != native[5 - i]) return false;
+        }
+        return true;
+    }
+};
+
+struct FixedString {
+    char str[DEVICE_TOPIC_LEN];
+};
+
+struct DeviceIdentity {
+    MacAddress mac;
+    FixedString stateTopic;     // <MQTT_PREFIX>/batteryguard/<mqttName>
+    FixedString discoveryId;    // batteryguard_<mqttName>
+};
+
+// ============================================================================
+// constexpr Helpers
+// ============================================================================
+namespace device_table {
+
+constexpr size_t length(const char* s) {
+    return *s ? 1 + length(s + 1) : 0;
+}
+
+constexpr bool equal(const char* a, const char* b) {
+    return (*a == *b) && (*a == '\0' || equal(a + 1, b + 1));
+}
+
+constexpr bool isHex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+}
+
+// 0 for non-hex characters (placeholders in disabled entries)
+constexpr uint8_t hexValue(char c) {
+    return (c >= '0' && c <= '9') ? c - '0'
+         : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+         : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+         : 0;
+}
+
+// Exactly 12 hex digits
+constexpr bool isValidSerial(const char* s, size_t i = 0) {
+    return i == 12 ? s[i] == '\0' : (isHex(s[i]) && isValidSerial(s, i + 1));
+}
+
+// Non-empty, no spaces or MQTT topic separators/wildcards
+constexpr bool isValidTopicChars(const char* s) {
+    return *s == '\0' ||
+        (*s != ' ' && *s != '/' && *s != '+' && *s != '#' && isValidTopicChars(s + 1));
+}
+
+constexpr bool isValidMqttName(const char* s) {
+    return *s != '\0' && isValidTopicChars(s);
+}
+
+constexpr uint8_t macByte(const char* serial, size_t i) {
+    return (uint8_t)((hexValue(serial[2 * i]) << 4) | hexValue(serial[2 * i + 1]));
+}
+
+constexpr MacAddress parseMac(const char* serial) {
+    return MacAddress{{ macByte(serial, 0), macByte(serial, 1), macByte(serial, 2),
+                        macByte(serial, 3), macByte(serial, 4), macByte(serial, 5) }};
+}
+
+// Character i of a + b + c ('\0' past the end)
+constexpr char concatAt(const char* a, const char* b, const char* c, size_t i) {
+    return i < length(a) ? a[i]
+         : i - length(a) < length(b) ? b[i - length(a)]
+         : i - length(a) - length(b) < length(c) ? c[i - length(a) - length(b)]
+         : '\0';
+}
+
+// ---- Table checks ----------------------------------------------------------
+
+// Serials are only checked on enabled entries, so disabled ones may keep
+// the "XXXXXXXXXXXX" placeholder
+constexpr bool allValid(const DeviceConfig* d, size_t n) {
+    return n == 0 ||
+        ((!d->enabled || isValidSerial(d->serial)) && isValidMqttName(d->mqttName) &&
+         allValid(d + 1, n - 1));
+}
+
+constexpr bool nameUnused(const char* name, const DeviceConfig* d, size_t n) {
+    return n == 0 || (!equal(name, d->mqttName) && nameUnused(name, d + 1, n - 1));
+}
+
+constexpr bool namesUnique(const DeviceConfig* d, size_t n) {
+    return n == 0 || (nameUnused(d->mqttName, d + 1, n - 1) && namesUnique(d + 1, n - 1));
+}
+
+constexpr bool serialUnused(const char* serial, const DeviceConfig* d, size_t n) {
+    return n == 0 ||
+        ((!d->enabled || !equal(serial, d->serial)) && serialUnused(serial, d + 1, n - 1));
+}
+
+constexpr bool serialsUnique(const DeviceConfig* d, size_t n) {
+    return n == 0 ||
+        ((!d->enabled || serialUnused(d->serial, d + 1, n - 1)) && serialsUnique(d + 1, n - 1));
+}
+
+constexpr bool namesFit(const DeviceConfig* d, size_t n) {
+    return n == 0 ||
+        (length(MQTT_PREFIX "/batteryguard/") + length(d->mqttName) < DEVICE_TOPIC_LEN &&
+         length("batteryguard_") + length(d->mqttName) < DEVICE_TOPIC_LEN &&
+         namesFit(d + 1, n - 1));
+}
+
+// ---- Table generation ------------------------------------------------------
+
+template <size_t... I> struct IndexList {};
+template <size_t N, size_t... I> struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+template <size_t... I> struct MakeIndexList<0, I...> { typedef IndexList<I...> type; };
+
+template <size_t... C>
+constexpr FixedString concat(const char* a, const char* b, const char* c, IndexList<C...>) {
+    return FixedString{{ concatAt(a, b, c, C)... }};
+}
+
+constexpr DeviceIdentity compile(const DeviceConfig& d) {
+    return DeviceIdentity{
+        parseMac(d.serial),
+        concat(MQTT_PREFIX "/batteryguard/", d.mqttName, "", MakeIndexList<DEVICE_TOPIC_LEN>::type()),
+        concat("batteryguard_", d.mqttName, "", MakeIndexList<DEVICE_TOPIC_LEN>::type())
+    };
+}
+
+template <size_t N>
+struct IdentityTable {
+    DeviceIdentity entries[N];
+};
+
+template <size_t... I>
+constexpr IdentityTable<sizeof...(I)> compileAll(IndexList<I...>) {
+    return IdentityTable<sizeof...(I)>{{ compile(DEVICES[I])... }};
+}
+
+} // namespace device_table
+
+// ============================================================================
+// Validation
+// ============================================================================
+static_assert(DEVICE_COUNT <= MAX_MONITORS, "config.h: at most 4 DEVICES are supported");
+static_assert(device_table::allValid(DEVICES, DEVICE_COUNT),
+    "config.h: enabled serials must be 12 hex digits, mqttNames non-empty without ' ', '/', '+' or '#'");
+static_assert(device_table::namesUnique(DEVICES, DEVICE_COUNT), "config.h: duplicate mqttName in DEVICES");
+static_assert(device_table::serialsUnique(DEVICES, DEVICE_COUNT), "config.h: duplicate serial among enabled DEVICES");
+static_assert(device_table::namesFit(DEVICES, DEVICE_COUNT), "config.h: MQTT_PREFIX + mqttName too long");
+
+// Per-device identity, index = position in DEVICES[]
+constexpr device_table::IdentityTable<DEVICE_COUNT> DEVICE_IDENTITIES =
+    device_table::compileAll(device_table::MakeIndexList<DEVICE_COUNT>::type());
+
+#endif // DEVICE_TABLE_H
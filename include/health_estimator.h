@@ -0,0 +1,257 @@
+/**
+ * Battery Guard Multi-Device Monitor - Resting Voltage & Health Estimator
+ *
+ * Incremental per-frame estimator (a handful of float compares per frame,
+ * no allocation, no table lookups on the frame path):
+ *
+ * - Rest: not charging, no rapid-drop event and the voltage stayed inside
+ *   REST_TOLERANCE_MV for REST_MIN_MS. The resting voltage is taken as
+ *   open-circuit voltage and mapped to SOC with the OCV curve of the
+ *   configured BatteryType.
+ * - Full-charge rest: the first rest after a charge phase shows how high
+ *   the battery still settles when full (sulfation / capacity loss).
+ * - Crank: a rapidVoltageDrop counter increment while not charging starts
+ *   a CRANK_WINDOW_MS window; the sag is the voltage before the event minus the minimum seen
+ *   in the window. Frames arrive about once a second, so the minimum is an
+ *   upper bound of the true crank dip - a trend indicator, not a load test.
+ *
+ * State of health combines the full-charge rest voltage and the smoothed
+ * crank minimum (each 0-100, scaled between per-chemistry good/bad limits).
+ */
+
+#ifndef HEALTH_ESTIMATOR_H
+#define HEALTH_ESTIMATOR_H
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+#else
+  #include <stdint.h>
+  #include <stddef.h>
+#endif
+#include "config_defaults.h"
+#include "types.h"
+
+#define HEALTH_GAP_MS 30000     // Longer silence (reconnect) restarts rest/crank tracking
+#define CRANK_MIN_SAG_V 0.3f    // Smaller drops are load steps, not engine starts
+
+// ============================================================================
+// Per-Chemistry Profiles (12V nominal)
+// ============================================================================
+struct ChemistryProfile {
+    const float* ocvVolts;      // Ascending resting voltages...
+    const uint8_t* ocvSoc;      // ...and their SOC
+    uint8_t ocvPoints;
+    float fullRestGoodV;        // Resting voltage after charge, 100% health
+    float fullRestBadV;         // ... 0% health
+    float crankGoodV;           // Crank minimum (1 Hz sampled), 100% health
+    float crankBadV;            // ... 0% health
+};
+
+inline const ChemistryProfile& chemistryProfile(BatteryType type) {
+    // Flooded lead acid
+    static const float LEAD_V[] = { 11.89f, 12.06f, 12.24f, 12.45f, 12.65f };
+    static const uint8_t LEAD_SOC[] = { 0, 25, 50, 75, 100 };
+    // AGM
+    static const float AGM_V[] = { 11.80f, 12.00f, 12.30f, 12.60f, 12.85f };
+    static const uint8_t AGM_SOC[] = { 0, 25, 50, 75, 100 };
+    // LiFePO4 (4S) - flat curve, only the knees are reliable
+    static const float LFP_V[] = { 10.0f, 12.0f, 12.8f, 13.0f, 13.1f, 13.2f, 13.3f, 13.4f, 13.6f };
+    static const uint8_t LFP_SOC[] = { 0, 9, 17, 30, 40, 70, 90, 99, 100 };
+
+    static const ChemistryProfile LEAD = { LEAD_V, LEAD_SOC, 5, 12.65f, 12.30f, 10.5f, 9.6f };
+    static const ChemistryProfile AGM_PROFILE = { AGM_V, AGM_SOC, 5, 12.80f, 12.40f, 10.5f, 9.6f };
+    static const ChemistryProfile LFP = { LFP_V, LFP_SOC, 9, 13.30f, 13.10f, 12.0f, 10.5f };
+
+    switch (type) {
+        case AGM: return AGM_PROFILE;
+        case LITHIUM:
+        case LITHIUM_INTELLIGENT:
+        case LITHIUM_MANUAL: return LFP;
+        default: return LEAD;
+    }
+}
+
+// Linear interpolation on the OCV curve
+inline uint8_t ocvToSoc(const ChemistryProfile& profile, float volts) {
+    if (volts <= profile.ocvVolts[0]) return profile.ocvSoc[0];
+    for (uint8_t i = 1; i < profile.ocvPoints; i++) {
+        if (volts < profile.ocvVolts[i]) {
+            float f = (volts - profile.ocvVolts[i - 1]) / (profile.ocvVolts[i] - profile.ocvVolts[i - 1]);
+            return (uint8_t)(profile.ocvSoc[i - 1] + f * (profile.ocvSoc[i] - profile.ocvSoc[i - 1]) + 0.5f);
+        }
+    }
+    return profile.ocvSoc[profile.ocvPoints - 1];
+}
+
+// 0-100 between bad and good
+inline int8_t scaleScore(float value, float bad, float good) {
+    float f = (value - bad) / (good - bad);
+    if (f < 0) f = 0;
+    if (f > 1) f = 1;
+    return (int8_t)(f * 100 + 0.5f);
+}
+
+enum HealthEvent : uint8_t {
+    HEALTH_NONE,
+    HEALTH_REST,                // Rest period confirmed (restingVoltage valid)
+    HEALTH_CRANK                // Crank window finished (lastCrank* valid)
+};
+
+// ============================================================================
+// Estimator
+// ============================================================================
+class HealthEstimator {
+public:
+    HealthEstimator() : profile(&chemistryProfile(LEAD_ACID)) { reset(); }
+
+    void begin(BatteryType type) {
+        profile = &chemistryProfile(type);
+        reset();
+    }
+
+    void reset() {
+        lastFrameMs = 0;
+        prevVoltage = 0;
+        prevDropCount = 0;
+        prevCharging = false;
+        restStart = 0;
+        restMin = restMax = 0;
+        resting = false;
+        restingVoltage = 0;
+        chargedSinceRest = false;
+        fullRestVoltage = 0;
+        crankActive = false;
+        crankStart = 0;
+        crankBaseV = crankMinV = 0;
+        lastCrankSag = lastCrankMinV = 0;
+        crankMinEwma = 0;
+        crankCount = 0;
+    }
+
+    // Per parsed frame (sample task)
+    HealthEvent update(unsigned long nowMs, float volts, uint8_t status, uint16_t dropCount) {
+        HealthEvent event = HEALTH_NONE;
+
+        if (lastFrameMs == 0 || nowMs - lastFrameMs > HEALTH_GAP_MS) {
+            // First frame of a connection: counters and rest start over
+            lastFrameMs = nowMs;
+            prevVoltage = volts;
+            prevDropCount = dropCount;
+            prevCharging = status == STATUS_CHARGING;
+            crankActive = false;
+            startRest(nowMs, volts);
+            return event;
+        }
+        lastFrameMs = nowMs;
+
+        // ---- Crank sag ----
+        // A drop out of charging is the engine stopping, not a start
+        bool dropEvent = dropCount != prevDropCount;
+        if (dropEvent && !crankActive && !prevCharging) {
+            crankActive = true;
+            crankStart = nowMs;
+            crankBaseV = prevVoltage;
+            crankMinV = volts;
+        }
+        if (crankActive) {
+            if (volts < crankMinV) crankMinV = volts;
+            if (nowMs - crankStart >= CRANK_WINDOW_MS) {
+                crankActive = false;
+                float sag = crankBaseV - crankMinV;
+                if (sag >= CRANK_MIN_SAG_V) {
+                    lastCrankSag = sag;
+                    lastCrankMinV = crankMinV;
+                    crankMinEwma = (crankCount == 0) ? crankMinV : crankMinEwma + (crankMinV - crankMinEwma) / 4;
+                    if (crankCount < 0xFFFF) crankCount++;
+                    event = HEALTH_CRANK;
+                }
+            }
+        }
+        prevVoltage = volts;
+        prevDropCount = dropCount;
+        prevCharging = status == STATUS_CHARGING;
+
+        // ---- Rest detection ----
+        if (status == STATUS_CHARGING || dropEvent) {
+            if (status == STATUS_CHARGING) chargedSinceRest = true;
+            startRest(nowMs, volts);
+            return event;
+        }
+        if (volts < restMin) restMin = volts;
+        if (volts > restMax) restMax = volts;
+        if ((restMax - restMin) * 1000.0f > REST_TOLERANCE_MV) {
+            startRest(nowMs, volts);  // Still settling (surface charge) or under load
+            return event;
+        }
+        if (nowMs - restStart >= REST_MIN_MS) {
+            restingVoltage = volts;
+            if (!resting) {
+                resting = true;
+                if (chargedSinceRest) {
+                    fullRestVoltage = volts;
+                    chargedSinceRest = false;
+                }
+                if (event == HEALTH_NONE) event = HEALTH_REST;
+            }
+        }
+        return event;
+    }
+
+    bool isResting() const { return resting; }
+    float restVoltage() const { return restingVoltage; }            // 0 = no rest seen yet
+    float fullChargeRestVoltage() const { return fullRestVoltage; } // 0 = not measured yet
+    float crankSag() const { return lastCrankSag; }
+    float crankMinVoltage() const { return lastCrankMinV; }
+    uint16_t cranks() const { return crankCount; }
+
+    // SOC from the last resting voltage, -1 if no rest seen yet
+    int8_t ocvSoc() const {
+        return restingVoltage > 0 ? (int8_t)ocvToSoc(*profile, restingVoltage) : -1;
+    }
+
+    // 0-100, -1 until a full-charge rest or a crank has been observed
+    int8_t stateOfHealth() const {
+        int16_t sum = 0;
+        uint8_t parts = 0;
+        if (fullRestVoltage > 0) {
+            sum += scaleScore(fullRestVoltage, profile->fullRestBadV, profile->fullRestGoodV);
+            parts++;
+        }
+        if (crankCount > 0) {
+            sum += scaleScore(crankMinEwma, profile->crankBadV, profile->crankGoodV);
+            parts++;
+        }
+        return parts ? (int8_t)(sum / parts) : -1;
+    }
+
+private:
+    const ChemistryProfile* profile;
+    unsigned long lastFrameMs;
+    float prevVoltage;
+    uint16_t prevDropCount;
+    bool prevCharging;
+
+    // Rest
+    unsigned long restStart;
+    float restMin, restMax;     // Voltage range since restStart
+    bool resting;
+    float restingVoltage;
+    bool chargedSinceRest;
+    float fullRestVoltage;
+
+    // Crank
+    bool crankActive;
+    unsigned long crankStart;
+    float crankBaseV, crankMinV;
+    float lastCrankSag, lastCrankMinV;
+    float crankMinEwma;
+    uint16_t crankCount;
+
+    void startRest(unsigned long nowMs, float volts) {
+        restStart = nowMs;
+        restMin = restMax = volts;
+        resting = false;
+    }
+};
+
+#endif // HEALTH_ESTIMATOR_H
@@ -0,0 +1,105 @@
+/**
+ * Battery Guard Multi-Device Monitor - InfluxDB Line Protocol Writer
+ *
+ * Writes every parsed frame of every device to InfluxDB (v1 /write or v2
+ * /api/v2/write) instead of, or next to, the MQTT snapshot publishes:
+ *
+ *   battery,device=car,serial=50547B000000 voltage=12.71,soc=85i,
+ *       temperature=21i,status=1i,vrise=3i,vdrop=0i 1700000000123
+ *
+ * The sample bus sink only formats the line and appends it to the batch
+ * being filled (a memcpy under a spinlock). InfluxTask flushes a batch when
+ * it reaches INFLUX_BATCH_BYTES or its oldest line is INFLUX_FLUSH_MS old,
+ * as one HTTP/1.1 POST over a keep-alive connection, in a BLE quiet window.
+ *
+ * Failed batches (network error, 429, 5xx) stay in the backlog and are
+ * retried oldest first with exponential backoff; when all INFLUX_BATCHES
+ * buffers are taken the oldest unsent batch is dropped. Samples from before
+ * the first NTP sync are dropped (no timestamp).
+ */
+
+#ifndef INFLUX_WRITER_H
+#define INFLUX_WRITER_H
+
+#ifdef INFLUX_ENABLED
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "config_defaults.h"
+#include "sample_bus.h"
+
+#define INFLUX_LINE_MAX 192
+#define INFLUX_POLL_MS 1000
+#define INFLUX_HTTP_TIMEOUT_MS 5000
+#define INFLUX_RETRY_MIN_MS 1000
+#define INFLUX_RETRY_MAX_MS 60000
+
+struct InfluxStats {
+    uint32_t lines;             // Accepted from the sample bus
+    uint32_t linesWritten;      // Acknowledged by the server (2xx)
+    uint32_t linesDropped;      // Evicted from a full backlog or rejected (4xx)
+    uint32_t posts;
+    uint32_t failures;          // Network errors, 429, 5xx
+    uint32_t connects;          // New TCP connections (keep-alive reuse otherwise)
+    uint32_t bytes;             // Body bytes written
+    uint32_t lastPostMs;        // Round trip of the last POST
+    uint32_t maxPostMs;
+};
+
+class InfluxWriter {
+public:
+    InfluxWriter();
+
+    // Start InfluxTask
+    bool begin();
+
+    // Sample task: append one line; false = sample dropped
+    bool add(const SampleRecord& record);
+
+    void printStats();
+    size_t formatStats(char* buf, size_t len);
+
+private:
+    enum BatchState : uint8_t {
+        BATCH_FREE,
+        BATCH_FILLING,
+        BATCH_SEALED,           // Waiting to be sent (or retried)
+        BATCH_SENDING
+    };
+
+    struct Batch {
+        BatchState state;
+        uint16_t length;
+        uint16_t lines;
+        uint32_t sequence;      // Seal order
+        unsigned long openedMs; // First line
+        char data[INFLUX_BATCH_BYTES];
+    };
+
+    Batch batches[INFLUX_BATCHES];
+    int8_t filling;             // -1 = none
+    uint32_t nextSequence;
+    portMUX_TYPE lock;
+
+    TaskHandle_t task;
+    WiFiClient client;
+    unsigned long retryAtMs;    // 0 = no backoff
+    uint32_t backoffMs;
+    InfluxStats stats;
+
+    static void taskEntry(void* param);
+    void run();
+    void seal(int8_t index);
+    int8_t claim();
+    int8_t takeNext(unsigned long now);
+    int post(const Batch& batch);
+    int request(const Batch& batch);
+    bool readLine(char* buf, size_t len, unsigned long deadline);
+    uint8_t backlog();
+};
+
+extern InfluxWriter influxWriter;
+
+#endif // INFLUX_ENABLED
+
+#endif // INFLUX_WRITER_H
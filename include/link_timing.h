@@ -0,0 +1,99 @@
+/**
+ * Battery Guard Multi-Device Monitor - Link Timing
+ *
+ * Reconnect backoff and notification liveness arithmetic used by
+ * BatteryMonitor. Kept free of Arduino/NimBLE and config.h (the limits are
+ * passed in) so the native unit tests can drive it through the virtual
+ * clock (see test/test_link_timing).
+ */
+
+#ifndef LINK_TIMING_H
+#define LINK_TIMING_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Milliseconds from `since` to `now`. The subtraction is done in 32 bits
+// like millis() itself, so it stays correct across the 49.7-day wraparound
+// (also on hosts where unsigned long is 64 bits wide).
+inline uint32_t elapsedMs(unsigned long now, unsigned long since) {
+    return (uint32_t)now - (uint32_t)since;
+}
+
+// True once `interval` ms have passed since `since`
+inline bool intervalElapsed(unsigned long now, unsigned long since, uint32_t interval) {
+    return elapsedMs(now, since) >= interval;
+}
+
+// Delay before the next attempt after `failures` consecutive failures: the
+// first `quickRetries` wait `firstMs`, after that the delay doubles up to
+// `maxMs`. +/-25% jitter (from `random`) keeps devices out of lockstep.
+inline uint32_t backoffDelayMs(uint8_t failures, uint8_t quickRetries,
+                               uint32_t firstMs, uint32_t maxMs, uint32_t random) {
+    uint8_t exponent = 0;
+    if (failures >= quickRetries) {
+        exponent = failures - quickRetries + 1;
+        if (exponent > 16) exponent = 16;
+    }
+    uint32_t delayMs = firstMs << exponent;
+    if (delayMs > maxMs || delayMs < firstMs) {
+        delayMs = maxMs;
+    }
+    uint32_t jitter = delayMs / 4;
+    return delayMs - jitter + random % (2 * jitter + 1);
+}
+
+// Notification inter-arrival statistics of one link (EWMA, TCP RTT style)
+struct FrameCadence {
+    unsigned long lastArrival;  // 0 = no frame yet on this connection
+    float mean;                 // Smoothed inter-arrival time (ms)
+    float jitter;               // Smoothed mean deviation (ms)
+    uint16_t samples;           // Intervals observed (saturating)
+    uint32_t missed;            // Expected frames that never arrived
+    uint32_t missedNet;         // Of which overlapped WiFi activity
+
+    FrameCadence() : lastArrival(0), mean(0), jitter(0), samples(0), missed(0), missedNet(0) {}
+
+    // Record an arrival. Once `minSamples` intervals are known, gaps longer
+    // than 1.5 expected intervals count as missed frames; if network activity
+    // happened inside the gap they are attributed to it.
+    void record(unsigned long now, unsigned long lastNetActivity, uint16_t minSamples) {
+        if (lastArrival != 0) {
+            uint32_t gap = elapsedMs(now, lastArrival);
+            float interval = (float)gap;
+            if (samples >= minSamples && mean > 0 && interval > 1.5f * mean) {
+                uint32_t lost = (uint32_t)(interval / mean + 0.5f) - 1;
+                missed += lost;
+                if (lastNetActivity != 0 && elapsedMs(now, lastNetActivity) <= gap) {
+                    missedNet += lost;
+                }
+            }
+            if (samples == 0) {
+                mean = interval;
+                jitter = interval / 2;
+            } else {
+                float deviation = fabsf(interval - mean);
+                jitter += (deviation - jitter) / 4;
+                mean += (interval - mean) / 8;
+            }
+            if (samples < 0xFFFF) samples++;
+        }
+        lastArrival = now;
+    }
+
+    // Silence after which the link is stale: `missedFrames` expected frames
+    // plus jitter margin, clamped to [floorMs, ceilingMs]. Until `minSamples`
+    // intervals are known the ceiling applies.
+    uint32_t timeoutMs(uint8_t missedFrames, uint32_t floorMs, uint32_t ceilingMs,
+                       uint16_t minSamples) const {
+        if (samples < minSamples) {
+            return ceilingMs;
+        }
+        float timeout = missedFrames * mean + 4 * jitter;
+        if (timeout < floorMs) return floorMs;
+        if (timeout > ceilingMs) return ceilingMs;
+        return (uint32_t)timeout;
+    }
+};
+
+#endif // LINK_TIMING_H
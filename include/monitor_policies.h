@@ -0,0 +1,270 @@
+/**
+ * Battery Guard Multi-Device Monitor - BatteryMonitor Policies
+ *
+ * BasicBatteryMonitor is parameterised on four policy classes with static
+ * members only, so every call resolves at compile time and inlines - there
+ * are no virtual calls and no per-instance policy storage. The ESP32 build
+ * uses the policies below; another transport, cipher, clock or logger can
+ * be swapped in by instantiating the template with different classes.
+ *
+ * Host builds (no ARDUINO) get simulator policies instead: a scriptable BLE
+ * link, a pass-through cipher and stdout logging on the virtual clock, used
+ * by the native tests and benchmarks under test/.
+ */
+
+#ifndef MONITOR_POLICIES_H
+#define MONITOR_POLICIES_H
+
+#include "clock_source.h"
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include "aes_crypto.h"
+
+// ============================================================================
+// Transport - BLE central link to one device
+// ============================================================================
+// The connection engine goes through these calls only, so it builds against
+// the simulator transport on the host as well.
+struct NimBLETransport {
+    typedef NimBLEClient Client;
+    typedef NimBLERemoteService Service;
+    typedef NimBLERemoteCharacteristic Characteristic;
+    typedef NimBLEAddress Address;
+    typedef NimBLEClientCallbacks Callbacks;
+
+    static Client* createClient(Callbacks* callbacks) {
+        Client* client = NimBLEDevice::createClient();
+        if (client) {
+            client->setClientCallbacks(callbacks, false);
+        }
+        return client;
+    }
+    static bool isConnected(Client* client) { return client && client->isConnected(); }
+    static void disconnect(Client* client) { client->disconnect(); }
+    
+    // NimBLE takes the connect timeout in whole seconds (uint8_t): round
+    // up, so a budget under 1 s is not 0 and none is cut short
+    static bool connect(Client* client, const Address& address, uint32_t timeoutMs) {
+        uint32_t seconds = (timeoutMs + 999) / 1000;
+        client->setConnectTimeout(seconds == 0 ? 1 : seconds > UINT8_MAX ? UINT8_MAX : seconds);
+        return client->connect(address);
+    }
+    static int lastError(Client* client) { return client->getLastError(); }
+    
+    static Service* getService(Client* client, const char* uuid) {
+        return client->getService(NimBLEUUID(uuid));
+    }
+    static Characteristic* getCharacteristic(Service* service, const char* uuid) {
+        return service->getCharacteristic(NimBLEUUID(uuid));
+    }
+    static bool canNotify(Characteristic* characteristic) { return characteristic->canNotify(); }
+    template <typename Handler>
+    static bool subscribe(Characteristic* characteristic, Handler handler) {
+        return characteristic->subscribe(true, handler);
+    }
+    static bool write(Characteristic* characteristic, const uint8_t* data, size_t length) {
+        return characteristic->writeValue(data, length, false);
+    }
+};
+
+// ============================================================================
+// Cipher - single 16-byte block
+// ============================================================================
+struct AesCipher {
+    static void encrypt(const uint8_t* input, uint8_t* output, const uint8_t* key) {
+        aes_encrypt(input, output, key);
+    }
+    static void decrypt(const uint8_t* input, uint8_t* output, const uint8_t* key) {
+        aes_decrypt(input, output, key);
+    }
+};
+
+// ============================================================================
+// Logger
+// ============================================================================
+struct SerialLogger {
+    template <typename... Args>
+    static void printf(const char* format, Args... args) {
+        Serial.printf(format, args...);
+    }
+};
+
+#else // Host build (native test env)
+
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+
+#ifndef VIRTUAL_CLOCK
+  #error "Host builds run on the virtual clock, build with -DVIRTUAL_CLOCK"
+#endif
+
+// ============================================================================
+// Transport - simulated BLE link
+// ============================================================================
+// Every call succeeds and costs no time unless SimTransport::link() says
+// otherwise: tests set the step that should fail and how long each step
+// blocks (advanced on the virtual clock, as the NimBLE calls block on the
+// device). Clients come from a fixed pool, so nothing here allocates after
+// startup.
+enum SimStep : uint8_t {
+    SIM_CONNECT,
+    SIM_DISCOVER,
+    SIM_SUBSCRIBE,
+    SIM_WRITE,
+    SIM_STEPS,
+    SIM_NONE = SIM_STEPS        // failAt: every step succeeds
+};
+
+struct SimTransport {
+    struct Characteristic;
+    typedef void (*Handler)(Characteristic* characteristic, uint8_t* data, size_t length, bool isNotify);
+    
+    struct Characteristic {
+        const char* uuid;
+        Handler handler;        // Set by subscribe()
+    };
+    struct Service {
+        Characteristic characteristics[2];  // Write and notify
+    };
+    struct Client;
+    struct Callbacks {
+        virtual ~Callbacks() {}
+        virtual void onConnect(Client* client) { (void)client; }
+        virtual void onDisconnect(Client* client) { (void)client; }
+    };
+    struct Client {
+        Callbacks* callbacks;
+        bool connected;
+        Service service;
+    };
+    struct Address {
+        const char* text;
+        explicit Address(const char* address) : text(address) {}
+    };
+    
+    // Script and counters shared by all clients
+    struct Link {
+        SimStep failAt;
+        uint32_t stepMs[SIM_STEPS];
+        uint32_t calls[SIM_STEPS];
+        uint32_t disconnects;
+    };
+    static Link& link() {
+        static Link state = { SIM_NONE, {}, {}, 0 };
+        return state;
+    }
+    
+    static Client* createClient(Callbacks* callbacks) {
+        static Client pool[MAX_MONITORS];
+        static uint8_t used = 0;
+        if (used == MAX_MONITORS) return nullptr;
+        Client* client = &pool[used++];
+        client->callbacks = callbacks;
+        return client;
+    }
+    static bool isConnected(Client* client) { return client && client->connected; }
+    static void disconnect(Client* client) {
+        if (!client->connected) return;
+        client->connected = false;
+        link().disconnects++;
+        if (client->callbacks) client->callbacks->onDisconnect(client);
+    }
+    
+    static bool connect(Client* client, const Address& address, uint32_t timeoutMs) {
+        (void)address;
+        if (!step(SIM_CONNECT, timeoutMs)) return false;
+        client->connected = true;
+        if (client->callbacks) client->callbacks->onConnect(client);
+        return true;
+    }
+    static int lastError(Client* client) { return client->connected ? 0 : 13; }
+    
+    static Service* getService(Client* client, const char* uuid) {
+        (void)uuid;
+        if (!step(SIM_DISCOVER, UINT32_MAX)) return nullptr;
+        memset(&client->service, 0, sizeof(client->service));
+        return &client->service;
+    }
+    static Characteristic* getCharacteristic(Service* service, const char* uuid) {
+        for (Characteristic& c : service->characteristics) {
+            if (!c.uuid || strcmp(c.uuid, uuid) == 0) {
+                c.uuid = uuid;
+                return &c;
+            }
+        }
+        return nullptr;
+    }
+    static bool canNotify(Characteristic* characteristic) { (void)characteristic; return true; }
+    static bool subscribe(Characteristic* characteristic, Handler handler) {
+        if (!step(SIM_SUBSCRIBE, UINT32_MAX)) return false;
+        characteristic->handler = handler;
+        return true;
+    }
+    static bool write(Characteristic* characteristic, const uint8_t* data, size_t length) {
+        (void)characteristic; (void)data; (void)length;
+        return step(SIM_WRITE, UINT32_MAX);
+    }
+    
+    // Deliver a notification the way the BLE host task would
+    static void notify(Characteristic* characteristic, uint8_t* data, size_t length) {
+        if (characteristic && characteristic->handler) {
+            characteristic->handler(characteristic, data, length, true);
+        }
+    }
+    
+private:
+    // A failing connect blocks until its timeout, like the real one
+    static bool step(SimStep s, uint32_t timeoutMs) {
+        Link& l = link();
+        l.calls[s]++;
+        bool ok = l.failAt != s;
+        uint32_t blockedMs = (!ok && s == SIM_CONNECT) ? timeoutMs : l.stepMs[s];
+        clockAdvance(blockedMs < timeoutMs ? blockedMs : timeoutMs);
+        return ok;
+    }
+};
+
+// ============================================================================
+// Cipher - pass-through (host tests feed plaintext frames)
+// ============================================================================
+struct PlainCipher {
+    static void encrypt(const uint8_t* input, uint8_t* output, const uint8_t* key) {
+        (void)key;
+        memcpy(output, input, 16);
+    }
+    static void decrypt(const uint8_t* input, uint8_t* output, const uint8_t* key) {
+        (void)key;
+        memcpy(output, input, 16);
+    }
+};
+
+// ============================================================================
+// Logger - stdout, can be muted for long simulations
+// ============================================================================
+struct StdioLogger {
+    static bool& enabled() {
+        static bool on = true;
+        return on;
+    }
+    template <typename... Args>
+    static void printf(const char* format, Args... args) {
+        if (enabled()) ::printf(format, args...);
+    }
+};
+
+#endif // ARDUINO
+
+// ============================================================================
+// Clock - see clock_source.h (virtual under -DVIRTUAL_CLOCK, which the host
+// build always uses, so there this is the simulator clock)
+// ============================================================================
+struct SystemClock {
+    static unsigned long now() { return clockMillis(); }
+    static uint32_t random() { return clockRandom(); }
+};
+
+#endif // MONITOR_POLICIES_H
@@ -5,48 +5,112 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <PubSubClient.h>
-#include "config.h"
+#include "mqtt_session.h"
+#include "tls_client.h"
+#include "config_defaults.h"
 #include "battery_monitor.h"
+#include "sample_bus.h"
 
 // Constants
 #define MAX_DEVICES 4
 
+// One reading as published. Copied out of the monitor in a single critical
+// section, so the 64-bit times and the values belong to the same frame.
+struct PublishSample {
+    float voltage;
+    uint8_t soc;
+    int8_t temperature;
+    uint8_t status;
+    bool restored;              // Reading from before a warm restart
+    int64_t arrivalUs;          // esp_timer time of the BLE notification
+    int64_t epochMs;            // UTC epoch ms of arrival (0 = not synced)
+};
+
 // MQTT Client class for Battery Guard monitoring
 class MQTTClient {
 public:
     MQTTClient();
     
-    // Initialize WiFi and MQTT connection
+    // Start WiFi and MQTT connection in the background (non-blocking)
     bool begin();
     
-    // Main loop - call regularly to maintain connection and process messages
+    // Network task cycle: command results, alerts. The broker connection
+    // itself is kept up by the session's I/O task.
     void loop();
     
+    // MqttSink (SampleTask): keep the record as the slot's latest reading.
+    // While the broker is unreachable one reading per MQTT_UPDATE_INTERVAL
+    // also goes into the slot's backlog; false if that overwrote the oldest
+    // (the sink counts it as dropped).
+    bool storeSample(const SampleRecord& record);
+    
     // Publish battery data for a specific monitor
     void publishBatteryData(const BatteryMonitor* monitor);
     
+    // Publish "online"/"offline" (retained) to <state topic>/availability
+    // whenever the monitor enters or leaves MONITORING
+    void publishAvailability(const BatteryMonitor* monitor);
+    
+    // Publish gateway telemetry JSON to <prefix>/batteryguard/_gateway/telemetry
+    void publishTelemetry(const char* payload);
+    
     // Check if MQTT is connected
     bool isConnected();
     
+    // Session (and TLS handshake) counters for the telemetry
+    void printSessionStats();
+    size_t formatSessionStats(char* buf, size_t len);
+    
 private:
-    WiFiClient wifiClient;
-    PubSubClient mqttClient;
-    unsigned long lastReconnectAttempt;
+    #ifdef MQTT_TLS
+    TlsClient transport;
+    #else
+    WiFiClient transport;
+    #endif
+    MqttSession session;
+    char statusTopic[MQTT_MAX_TOPIC];
+    volatile bool sessionRestarted;
     unsigned long lastPublishTime[MAX_DEVICES];
+    bool restoredPublished[MAX_DEVICES];
+    bool discoveryPublished[MAX_DEVICES];
+    int8_t availabilityPublished[MAX_DEVICES];  // -1 = not since (re)connect, 0 = offline, 1 = online
+    unsigned long firstPublishMs;   // Uptime of first successful publish (boot metric)
+    
+    // Latest reading per slot, copied in by MqttSink, and the readings
+    // buffered while the broker was unreachable (all guarded by latestLock)
+    struct SampleBacklog {
+        PublishSample entries[MQTT_BACKLOG_SAMPLES];
+        uint8_t first;          // Oldest entry
+        uint8_t count;
+    };
+    portMUX_TYPE latestLock;
+    PublishSample latest[MAX_DEVICES];
+    bool latestValid[MAX_DEVICES];
+    SampleBacklog backlog[MAX_DEVICES];
+    bool takeLatest(uint8_t index, PublishSample& sample);
+    bool peekBacklog(uint8_t index, PublishSample& sample);
+    void popBacklog(uint8_t index, int64_t arrivalUs);
+    void replayBacklog(const BatteryMonitor* monitor, int64_t latestArrivalUs);
     
     // Connection management
-    bool connectWiFi();
-    bool connectMQTT();
-    void reconnect();
+    static void onSessionConnected();
+    
+    // Device provisioning (<prefix>/batteryguard/_gateway/cmd)
+    static void onMessage(char* topic, uint8_t* payload, unsigned int length);
+    void processRegistryChanges();
+    void publishAlerts();
+    void removeHomeAssistantDiscovery(const DeviceIdentity* identity);
     
     // Publishing
-    void publishHomeAssistantDiscovery(const DeviceConfig* config);
-    void publishState(const BatteryMonitor* monitor);
+    bool publishHomeAssistantDiscovery(const BatteryMonitor* monitor);
+    void publishState(const BatteryMonitor* monitor, const PublishSample& sample);
     String buildStateTopic(const char* mqttName);
-    String buildDiscoveryTopic(const char* mqttName, const char* sensor);
-    String buildJsonPayload(const BatteryMonitor* monitor);
-    String buildHomeAssistantConfig(const DeviceConfig* config, const char* sensor, const char* unit, const char* deviceClass);
+    String buildAvailabilityTopic(const DeviceIdentity* identity);
+    String buildDiscoveryTopic(const DeviceIdentity* identity, const char* sensor);
+    static void copySample(const BatteryMonitor* monitor, PublishSample& sample);
+    String buildJsonPayload(const BatteryMonitor* monitor, const PublishSample& sample);
+    String buildBacklogPayload(const PublishSample& sample);
+    String buildHomeAssistantConfig(const BatteryMonitor* monitor, const char* sensor, const char* unit, const char* deviceClass);
 };
 
 extern MQTTClient mqttClient;
@@ -0,0 +1,172 @@
+/**
+ * Battery Guard Multi-Device Monitor - Asynchronous MQTT Session
+ *
+ * Minimal MQTT 3.1.1 client (CONNECT with will, PUBLISH QoS 0/1, SUBSCRIBE,
+ * PINGREQ) that owns the broker socket in its own task (TASK_MQTT_IO).
+ * publish() copies the message into the outbox and returns; socket writes,
+ * PUBACK handling, retransmits, keepalive and reconnects all run in the I/O
+ * task, so a slow broker or a full TCP window never stalls the network task
+ * or the BLE state machine.
+ *
+ * Outbox: byte ring of MQTT_OUTBOX_BYTES with complete messages in FIFO
+ * order. QoS 1 messages stay in the ring until their PUBACK arrives; at most
+ * MQTT_INFLIGHT_WINDOW are unacknowledged at a time, and each is resent with
+ * DUP after MQTT_RETRANSMIT_MS and after a reconnect. Space is reclaimed
+ * from the oldest end, so an unacknowledged message holds back the release
+ * (not the sending) of the messages queued behind it.
+ */
+
+#ifndef MQTT_SESSION_H
+#define MQTT_SESSION_H
+
+#ifdef MQTT_ENABLED
+
+#include <Arduino.h>
+#include <Client.h>
+#include "config_defaults.h"
+
+#define MQTT_MAX_TOPIC 128          // Longest topic accepted by publish()
+#define MQTT_MAX_SUBSCRIPTIONS 4
+#define MQTT_RX_BUFFER 768          // Largest incoming packet (command JSON)
+#define MQTT_RECONNECT_MS 5000      // Broker connect attempts while WiFi is up
+#define MQTT_CONNECT_TIMEOUT_MS 5000
+#define MQTT_IO_POLL_MS 10          // I/O task cycle (publish() wakes it early)
+
+typedef void (*MqttMessageCallback)(char* topic, uint8_t* payload, unsigned int length);
+typedef void (*MqttConnectCallback)();
+
+struct MqttSessionStats {
+    uint32_t queued;            // Accepted by publish()
+    uint32_t sent;              // Written to the socket (first transmission)
+    uint32_t acked;             // QoS 1 PUBACKs
+    uint32_t retransmits;
+    uint32_t dropped;           // Rejected: outbox full or message too large
+    uint32_t connects;          // Successful CONNACKs
+    uint16_t outboxPeak;        // Bytes
+    uint8_t inflightPeak;
+};
+
+class MqttSession {
+public:
+    MqttSession(Client& client);
+
+    // Configuration (before start)
+    void setServer(const char* host, uint16_t port);
+    void setClientId(const char* clientId);
+    void setCredentials(const char* username, const char* password);
+    void setWill(const char* topic, const char* message);   // QoS 1, retained
+    void setCallbacks(MqttMessageCallback onMessage, MqttConnectCallback onConnect);
+
+    // Subscriptions are (re)sent on every connect (QoS 0)
+    bool subscribe(const char* topic);
+
+    // Start the I/O task
+    bool start();
+
+    // Queue a message (any task). False if the outbox has no room. Bulk
+    // messages (discovery, replayed samples) are held for a quiet BLE window.
+    bool publish(const char* topic, const char* payload, bool retained, uint8_t qos = 0, bool bulk = false);
+
+    bool connected() const { return isConnected; }
+    uint16_t outboxFree();
+
+    void printStats();
+    size_t formatStats(char* buf, size_t len);
+
+private:
+    struct OutboxEntry {
+        uint16_t size;          // Header + topic + payload, padded to 4
+        uint16_t packetId;      // QoS 1, assigned at first transmission
+        uint16_t topicLength;
+        uint16_t payloadLength;
+        uint8_t state;
+        uint8_t flags;          // Bits 0-1 QoS, bit 2 retain, bit 3 bulk
+        uint8_t session;        // Connection the last transmission went to
+        uint8_t reserved;
+        uint32_t queuedUs;
+        uint32_t sentUs;
+        uint32_t lastSendMs;
+    };
+
+    enum SessionState : uint8_t {
+        SESSION_DISCONNECTED,
+        SESSION_CONNECTING,     // CONNECT sent, waiting for CONNACK
+        SESSION_CONNECTED
+    };
+
+    Client& client;
+    const char* host;
+    uint16_t port;
+    char clientId[32];
+    const char* username;
+    const char* password;
+    char willTopic[MQTT_MAX_TOPIC];
+    const char* willMessage;
+    MqttMessageCallback messageCallback;
+    MqttConnectCallback connectCallback;
+    char subscriptions[MQTT_MAX_SUBSCRIPTIONS][MQTT_MAX_TOPIC];
+    uint8_t subscriptionCount;
+
+    // Outbox ring. head/used/unsent are shared with publishers (lock);
+    // tail, cursor and inflight belong to the I/O task.
+    uint32_t outbox[MQTT_OUTBOX_BYTES / 4];
+    SemaphoreHandle_t lock;
+    uint16_t head;              // Next free byte
+    uint16_t tail;              // Oldest live entry
+    uint16_t used;              // Bytes from tail to head, wrap gaps included
+    uint16_t unsent;            // Entries not transmitted yet
+    uint16_t cursor;            // Next entry to transmit
+    uint8_t inflight;           // QoS 1 entries waiting for PUBACK
+    uint16_t nextPacketId;
+
+    // Connection (I/O task)
+    TaskHandle_t ioTask;
+    SessionState state;
+    int8_t bulkGate;            // Quiet-window answer for this pass (-1 = not asked)
+    volatile bool isConnected;
+    uint8_t sessionId;
+    bool subscribePending;
+    bool pingOutstanding;
+    unsigned long lastConnectAttempt;
+    unsigned long connectStartMs;
+    unsigned long lastOutMs;
+    unsigned long pingSentMs;
+
+    // Incoming packet parser
+    uint8_t rx[MQTT_RX_BUFFER];
+    uint8_t rxPhase;            // 0 = fixed header, 1 = remaining length, 2 = body
+    uint8_t rxType;
+    uint32_t rxLength;
+    uint8_t rxShift;
+    uint32_t rxReceived;
+
+    uint8_t tx[64 + MQTT_MAX_TOPIC];    // Control packets and PUBLISH headers
+
+    MqttSessionStats stats;
+
+    static void taskEntry(void* param);
+    void service();
+    void beginConnect(unsigned long now);
+    void drop(const char* reason);
+    bool readPacket();
+    void handlePacket(unsigned long now);
+    void handlePublish();
+    void sendSubscriptions();
+    void sendQueued(unsigned long now);
+    void retransmit(unsigned long now);
+    void keepalive(unsigned long now);
+    bool writePublish(OutboxEntry* entry, bool dup);
+    bool writeBytes(const uint8_t* buf, size_t len);
+    bool writeString(const char* str);
+    void releaseDone();
+    bool outboxPending();
+    bool bulkAllowed();
+
+    OutboxEntry* entryAt(uint16_t offset) { return (OutboxEntry*)((uint8_t*)outbox + offset); }
+    uint16_t normalize(uint16_t offset);
+    uint16_t advance(uint16_t offset);
+};
+
+#endif // MQTT_ENABLED
+
+#endif // MQTT_SESSION_H
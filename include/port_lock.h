@@ -0,0 +1,26 @@
+/**
+ * Battery Guard Multi-Device Monitor - Critical Section Seam
+ *
+ * The per-device data structures guard their fields with FreeRTOS portMUX
+ * spinlocks. On the target this header is just Arduino.h. Off-target (the
+ * native test env, see test/) the tests run single-threaded, so the lock
+ * type is an empty stand-in and entering/leaving compiles to nothing.
+ */
+
+#ifndef PORT_LOCK_H
+#define PORT_LOCK_H
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+#else
+  #include <stdint.h>
+  #include <stddef.h>
+  #include <math.h>
+
+  typedef struct { uint32_t owner; } portMUX_TYPE;
+  #define portMUX_INITIALIZER_UNLOCKED { 0 }
+  #define portENTER_CRITICAL(mux) ((void)(mux))
+  #define portEXIT_CRITICAL(mux) ((void)(mux))
+#endif
+
+#endif // PORT_LOCK_H
@@ -0,0 +1,59 @@
+/**
+ * Battery Guard Multi-Device Monitor - Protocol Decoders
+ *
+ * Each supported device family supplies its advertised name, GATT UUIDs,
+ * handshake and frame parser in one ProtocolDecoder entry. A device picks
+ * its decoder through DeviceConfig::protocol; the connection engine and
+ * SampleTask only call through the entry, never branch on the protocol.
+ *
+ *   PROTOCOL_BM6  intAct Battery Guard (BM6) - 6-write handshake, D1 55 frames
+ *   PROTOCOL_BM2  Ancel BM300 Pro (BM2)      - no handshake, F5 frames
+ */
+
+#ifndef PROTOCOL_DECODER_H
+#define PROTOCOL_DECODER_H
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+#else
+  #include <stdint.h>
+  #include <string.h>
+#endif
+#include "types.h"
+
+#define HANDSHAKE_MAX_COMMANDS 8
+
+// Fields a decoder extracts from one decrypted 16-byte frame. Fields the
+// protocol doesn't report are left at 0.
+struct DecodedSample {
+    int8_t temperature;
+    uint8_t status;
+    uint8_t soc;
+    float voltage;
+    uint16_t rapidVoltageRise;
+    uint16_t rapidVoltageDrop;
+};
+
+struct ProtocolDecoder {
+    const char* name;               // Short name for logs
+    const char* advertisedName;     // BLE local name the device advertises
+    const char* serviceUuid;
+    const char* writeUuid;          // Handshake characteristic (nullptr = none)
+    const char* notifyUuid;         // Data characteristic
+    uint8_t warmupFrames;           // Notifications to discard after subscribing
+    
+    // Fill plaintext handshake commands (encrypted and written by the
+    // connection engine); returns the number of commands, 0 = none
+    uint8_t (*buildHandshake)(const DeviceConfig* config, uint8_t commands[][16]);
+    
+    // Parse a decrypted frame; false if the header doesn't match
+    bool (*parse)(const uint8_t* frame, DecodedSample& out);
+};
+
+// Decoder for a configured protocol (falls back to BM6 for unknown ids)
+const ProtocolDecoder* decoderFor(ProtocolId protocol);
+
+// Decoder whose devices advertise this name, or nullptr
+const ProtocolDecoder* decoderForAdvertisedName(const char* name);
+
+#endif // PROTOCOL_DECODER_H
@@ -0,0 +1,243 @@
+/**
+ * Battery Guard Multi-Device Monitor - Rolling Window Statistics
+ *
+ * Sliding-window min/max/mean/stddev of the full-rate (per frame) signal,
+ * so the published payload summarises what happened between two MQTT
+ * updates. Each window is split into STATS_BUCKETS time buckets:
+ *
+ * - A frame is added to the open bucket with Welford's update - O(1)
+ * - A closed bucket goes into a ring; its min/max into monotonic deques,
+ *   so window min/max is the deque front - amortised O(1)
+ * - Mean/stddev merge the buckets of the window (Chan et al.) when a
+ *   summary is requested (publish time, STATS_BUCKETS merges)
+ *
+ * Memory is fixed per window regardless of frame rate. The window slides
+ * in bucket steps, i.e. it covers the last (window - window/STATS_BUCKETS)
+ * to window milliseconds.
+ */
+
+#ifndef ROLLING_STATS_H
+#define ROLLING_STATS_H
+
+#include "port_lock.h"
+#include "config_defaults.h"
+
+#define STATS_BUCKETS 12
+
+enum StatsWindow : uint8_t {
+    STATS_SHORT,                // STATS_WINDOW_SHORT_MS (default 1 min)
+    STATS_MEDIUM,               // STATS_WINDOW_MEDIUM_MS (default 15 min)
+    STATS_LONG,                 // STATS_WINDOW_LONG_MS (default 1 h)
+    STATS_WINDOW_COUNT
+};
+
+inline uint32_t statsWindowMs(uint8_t window) {
+    switch (window) {
+        case STATS_SHORT: return STATS_WINDOW_SHORT_MS;
+        case STATS_MEDIUM: return STATS_WINDOW_MEDIUM_MS;
+        default: return STATS_WINDOW_LONG_MS;
+    }
+}
+
+// Summary of one window (count 0 = no data in the window)
+struct StatSummary {
+    uint32_t count;
+    float mean;
+    float stddev;               // Sample standard deviation
+    float min;
+    float max;
+};
+
+// ============================================================================
+// Sliding Window
+// ============================================================================
+class RollingWindow {
+public:
+    RollingWindow() : bucketMs(1) { reset(); }
+
+    void begin(uint32_t windowMs) {
+        bucketMs = windowMs / STATS_BUCKETS;
+        if (bucketMs == 0) bucketMs = 1;
+        reset();
+    }
+
+    void reset() {
+        open.count = 0;
+        for (uint8_t i = 0; i < STATS_BUCKETS; i++) {
+            ring[i].count = 0;
+        }
+        minHead = minSize = maxHead = maxSize = 0;
+    }
+
+    void add(unsigned long nowMs, float x) {
+        uint32_t id = nowMs / bucketMs;
+        if (open.count > 0 && id != open.id) {
+            if (id < open.id) {
+                reset();        // millis() wrapped
+            } else {
+                close();
+            }
+        }
+        if (open.count == 0) {
+            open.id = id;
+            open.mean = 0;
+            open.m2 = 0;
+            open.min = x;
+            open.max = x;
+        }
+        open.count++;
+        float delta = x - open.mean;
+        open.mean += delta / open.count;
+        open.m2 += delta * (x - open.mean);
+        if (x < open.min) open.min = x;
+        if (x > open.max) open.max = x;
+    }
+
+    StatSummary summarize(unsigned long nowMs) const {
+        uint32_t current = nowMs / bucketMs;
+        StatSummary s = { 0, 0, 0, 0, 0 };
+        float m2 = 0;
+
+        for (uint8_t i = 0; i < STATS_BUCKETS; i++) {
+            if (ring[i].count > 0 && inWindow(ring[i].id, current)) {
+                merge(s, m2, ring[i]);
+            }
+        }
+        bool openValid = open.count > 0 && inWindow(open.id, current);
+        if (openValid) {
+            merge(s, m2, open);
+        }
+        if (s.count == 0) return s;
+
+        s.stddev = (s.count > 1) ? sqrtf(m2 / (s.count - 1)) : 0;
+
+        bool haveMin = false, haveMax = false;
+        for (uint8_t k = 0; k < minSize; k++) {
+            uint32_t id = minIds[(minHead + k) % STATS_BUCKETS];
+            if (inWindow(id, current)) {
+                s.min = ring[id % STATS_BUCKETS].min;
+                haveMin = true;
+                break;
+            }
+        }
+        for (uint8_t k = 0; k < maxSize; k++) {
+            uint32_t id = maxIds[(maxHead + k) % STATS_BUCKETS];
+            if (inWindow(id, current)) {
+                s.max = ring[id % STATS_BUCKETS].max;
+                haveMax = true;
+                break;
+            }
+        }
+        if (openValid) {
+            if (!haveMin || open.min < s.min) s.min = open.min;
+            if (!haveMax || open.max > s.max) s.max = open.max;
+        }
+        return s;
+    }
+
+private:
+    struct Bucket {
+        uint32_t id;            // nowMs / bucketMs
+        uint32_t count;
+        float mean;
+        float m2;               // Sum of squared deviations from the mean
+        float min;
+        float max;
+    };
+
+    uint32_t bucketMs;
+    Bucket open;                        // Bucket currently being filled
+    Bucket ring[STATS_BUCKETS];         // Closed buckets, slot = id % STATS_BUCKETS
+    uint32_t minIds[STATS_BUCKETS];     // Bucket ids with increasing min
+    uint32_t maxIds[STATS_BUCKETS];     // Bucket ids with decreasing max
+    uint8_t minHead, minSize;
+    uint8_t maxHead, maxSize;
+
+    static bool inWindow(uint32_t id, uint32_t current) {
+        return id <= current && current - id < STATS_BUCKETS;
+    }
+
+    // Parallel variance merge (Chan et al.)
+    static void merge(StatSummary& s, float& m2, const Bucket& b) {
+        uint32_t total = s.count + b.count;
+        float delta = b.mean - s.mean;
+        s.mean += delta * b.count / total;
+        m2 += b.m2 + delta * delta * ((float)s.count * b.count / total);
+        s.count = total;
+    }
+
+    void close() {
+        // Drop ids that fall out of a window ending at the closing bucket
+        while (minSize > 0 && open.id - minIds[minHead] >= STATS_BUCKETS) {
+            minHead = (minHead + 1) % STATS_BUCKETS;
+            minSize--;
+        }
+        while (maxSize > 0 && open.id - maxIds[maxHead] >= STATS_BUCKETS) {
+            maxHead = (maxHead + 1) % STATS_BUCKETS;
+            maxSize--;
+        }
+        // Buckets that can no longer be the min/max leave from the back
+        while (minSize > 0 &&
+               ring[minIds[(minHead + minSize - 1) % STATS_BUCKETS] % STATS_BUCKETS].min >= open.min) {
+            minSize--;
+        }
+        while (maxSize > 0 &&
+               ring[maxIds[(maxHead + maxSize - 1) % STATS_BUCKETS] % STATS_BUCKETS].max <= open.max) {
+            maxSize--;
+        }
+
+        ring[open.id % STATS_BUCKETS] = open;
+        minIds[(minHead + minSize) % STATS_BUCKETS] = open.id;
+        minSize++;
+        maxIds[(maxHead + maxSize) % STATS_BUCKETS] = open.id;
+        maxSize++;
+        open.count = 0;
+    }
+};
+
+// ============================================================================
+// Per-Device Statistics (written by the sample task, read by the network task)
+// ============================================================================
+class DeviceStats {
+public:
+    DeviceStats() {
+        portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+        lock = unlocked;
+    }
+
+    // Empty all windows; takes the lock, so a slot can be re-initialised
+    // while the network task summarizes it
+    void begin() {
+        portENTER_CRITICAL(&lock);
+        for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++) {
+            voltage[w].begin(statsWindowMs(w));
+            temperature[w].begin(statsWindowMs(w));
+        }
+        portEXIT_CRITICAL(&lock);
+    }
+
+    void add(unsigned long nowMs, float volts, float celsius) {
+        portENTER_CRITICAL(&lock);
+        for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++) {
+            voltage[w].add(nowMs, volts);
+            temperature[w].add(nowMs, celsius);
+        }
+        portEXIT_CRITICAL(&lock);
+    }
+
+    void summarize(unsigned long nowMs, StatSummary* volts, StatSummary* celsius) const {
+        portENTER_CRITICAL(&lock);
+        for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++) {
+            volts[w] = voltage[w].summarize(nowMs);
+            celsius[w] = temperature[w].summarize(nowMs);
+        }
+        portEXIT_CRITICAL(&lock);
+    }
+
+private:
+    mutable portMUX_TYPE lock;
+    RollingWindow voltage[STATS_WINDOW_COUNT];
+    RollingWindow temperature[STATS_WINDOW_COUNT];
+};
+
+#endif // ROLLING_STATS_H
@@ -0,0 +1,148 @@
+/**
+ * Battery Guard Multi-Device Monitor - Sample Bus
+ *
+ * Every parsed frame is published once as an immutable SampleRecord and
+ * handed by const reference to each sink in turn. The sink list is a
+ * compile-time type list: a sink compiled out by its feature flag is simply
+ * not in the list, so it costs neither code nor a runtime check. Each sink
+ * keeps delivered/dropped counters so backpressure shows up in telemetry.
+ *
+ * Adding a sink: declare a struct with NAME, a static SinkStats and a static
+ * bool consume(const SampleRecord&), then add it to the SampleBus typedef.
+ */
+
+#ifndef SAMPLE_BUS_H
+#define SAMPLE_BUS_H
+
+#include <Arduino.h>
+#include "config_defaults.h"
+#include "battery_monitor.h"
+
+// One parsed frame. Lives on the SampleTask stack for the duration of
+// publish(); sinks copy what they need to keep.
+struct SampleRecord {
+    const BatteryMonitor* monitor;
+    uint8_t monitorIndex;
+    float voltage;
+    uint8_t soc;
+    int8_t temperature;
+    uint8_t status;
+    uint16_t rapidVoltageRise;
+    uint16_t rapidVoltageDrop;
+    int64_t arrivalUs;          // esp_timer time of the BLE notification
+    int64_t epochMs;            // UTC epoch ms of arrival (0 = not synced)
+};
+
+struct SinkStats {
+    volatile uint32_t delivered;
+    volatile uint32_t dropped;  // Sink could not take the sample
+};
+
+// ============================================================================
+// Sink list (C++11 recursive type list)
+// ============================================================================
+template <typename... Sinks>
+struct SinkList;
+
+template <>
+struct SinkList<> {
+    static void publish(const SampleRecord&) {}
+    static void printStats() {}
+    static size_t formatStats(char*, size_t, bool) { return 0; }
+};
+
+template <typename Head, typename... Tail>
+struct SinkList<Head, Tail...> {
+    static void publish(const SampleRecord& record) {
+        if (Head::consume(record)) {
+            Head::stats.delivered++;
+        } else {
+            Head::stats.dropped++;
+        }
+        SinkList<Tail...>::publish(record);
+    }
+
+    static void printStats() {
+        Serial.printf("[TELEMETRY]   sink %-8s delivered=%lu dropped=%lu\n", Head::NAME,
+            (unsigned long)Head::stats.delivered, (unsigned long)Head::stats.dropped);
+        SinkList<Tail...>::printStats();
+    }
+
+    // Appends "name":{...} entries; returns the number of characters written
+    static size_t formatStats(char* buf, size_t len, bool first) {
+        if (len == 0) return 0;
+        size_t pos = snprintf(buf, len, "%s\"%s\":{\"ok\":%lu,\"drop\":%lu}", first ? "" : ",",
+            Head::NAME, (unsigned long)Head::stats.delivered, (unsigned long)Head::stats.dropped);
+        if (pos >= len) return len;
+        return pos + SinkList<Tail...>::formatStats(buf + pos, len - pos, false);
+    }
+};
+
+// ============================================================================
+// Sinks
+// ============================================================================
+
+// [PARSE] and summary lines on the serial console
+struct SerialSink {
+    static const char* const NAME;
+    static SinkStats stats;
+    static bool consume(const SampleRecord& record);
+};
+
+#ifdef LCD_ENABLED
+// Copies the reading into the display task's shared slot
+struct LcdSink {
+    static const char* const NAME;
+    static SinkStats stats;
+    static bool consume(const SampleRecord& record);
+};
+#endif
+
+#ifdef MQTT_ENABLED
+// Copies the reading into the MQTT client's per-slot latest buffer, which
+// NetworkTask publishes at MQTT_UPDATE_INTERVAL; samples arriving while the
+// broker is unreachable are counted as dropped
+struct MqttSink {
+    static const char* const NAME;
+    static SinkStats stats;
+    static bool consume(const SampleRecord& record);
+};
+#endif
+
+#ifdef INFLUX_ENABLED
+// Appends a line-protocol record to the InfluxDB batch (see influx_writer.h);
+// samples before the first NTP sync are counted as dropped
+struct InfluxSink {
+    static const char* const NAME;
+    static SinkStats stats;
+    static bool consume(const SampleRecord& record);
+};
+#endif
+
+#ifdef UDP_ENABLED
+// Stores the reading in the device's slot for the next UDP datagram
+// (see udp_streamer.h); never drops
+struct UdpSink {
+    static const char* const NAME;
+    static SinkStats stats;
+    static bool consume(const SampleRecord& record);
+};
+#endif
+
+typedef SinkList<
+    SerialSink
+#ifdef LCD_ENABLED
+    , LcdSink
+#endif
+#ifdef MQTT_ENABLED
+    , MqttSink
+#endif
+#ifdef INFLUX_ENABLED
+    , InfluxSink
+#endif
+#ifdef UDP_ENABLED
+    , UdpSink
+#endif
+> SampleBus;
+
+#endif // SAMPLE_BUS_H
@@ -0,0 +1,48 @@
+/**
+ * Battery Guard Multi-Device Monitor - Task Topology
+ *
+ * Central table of the firmware's FreeRTOS tasks: core affinity, priority
+ * and stack size for each role. Edit TASK_TOPOLOGY in task_topology.cpp to
+ * try a different layout; everything that creates a task goes through
+ * startTask(). -DTASK_SINGLE_CORE places every table task on core 0 to
+ * compare against the single-core layout on a dual-core board.
+ *
+ * Not in the table because they are created by the framework:
+ * - NimBLE host task: -DCONFIG_BT_NIMBLE_PINNED_TO_CORE / _HOST_TASK_STACK_SIZE
+ * - WiFi/lwIP tasks: pinned by ESP-IDF (core 0 on dual-core parts)
+ */
+
+#ifndef TASK_TOPOLOGY_H
+#define TASK_TOPOLOGY_H
+
+#include <Arduino.h>
+
+enum TaskRole : uint8_t {
+    TASK_CONTROL,   // BLE state machine (Arduino loopTask - priority only)
+    TASK_SAMPLES,   // Decrypt/parse notifications off the NimBLE host task
+    TASK_NETWORK,   // MQTT publishing, telemetry upload
+    TASK_MQTT_IO,   // MQTT socket: send queue, acks, keepalive, reconnect
+    TASK_DISPLAY,   // LCD rendering
+    TASK_STORAGE,   // Warm restart snapshot
+    TASK_INFLUX,    // InfluxDB batch writer
+    TASK_UDP,       // UDP frame stream
+    TASK_ROLE_COUNT
+};
+
+struct TaskSpec {
+    const char* name;
+    int8_t core;            // 0/1, or -1 for no affinity
+    uint8_t priority;
+    uint32_t stackBytes;
+};
+
+extern const TaskSpec TASK_TOPOLOGY[TASK_ROLE_COUNT];
+
+// Create the task for a role using its table entry. On single-core chips
+// every pinned task is mapped to core 0.
+bool startTask(TaskRole role, TaskFunction_t fn, void* param, TaskHandle_t* handle = nullptr);
+
+// Apply TASK_CONTROL's priority to the calling (loop) task
+void applyControlTaskPriority();
+
+#endif // TASK_TOPOLOGY_H
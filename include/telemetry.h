@@ -0,0 +1,90 @@
+/**
+ * Battery Guard Multi-Device Monitor - Runtime Telemetry
+ *
+ * Samples FreeRTOS task statistics (CPU share per task and per core, stack
+ * high-water marks) and heap health (free, minimum free, largest block).
+ * Sampling is a single uxTaskGetSystemState() call every
+ * TELEMETRY_INTERVAL_MS, so the cost is negligible.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "config_defaults.h"
+
+#define TELEMETRY_MAX_TASKS 24
+
+struct TaskTelemetry {
+    char name[16];
+    uint32_t taskNumber;        // FreeRTOS task number (stable per task)
+    int8_t core;                // -1 = not pinned
+    uint8_t priority;
+    uint8_t cpuPercent;         // Share of one core since last sample
+    uint32_t stackFreeBytes;    // Stack high-water mark (minimum ever free)
+};
+
+struct HeapTelemetry {
+    uint32_t freeBytes;
+    uint32_t minFreeBytes;      // Low-water mark since boot
+    uint32_t largestBlock;      // Largest allocatable block (fragmentation)
+};
+
+// Sample pipeline stages measured from notification arrival
+enum LatencyStage : uint8_t {
+    LATENCY_PARSE,      // Arrival → decrypted/parsed in SampleTask
+    LATENCY_PUBLISH,    // Arrival of published sample → queued for MQTT
+    LATENCY_RULES,      // Alert rule evaluation per frame (alert_engine.h)
+    LATENCY_MQTT_SEND,  // Queued → written to the broker socket
+    LATENCY_MQTT_ACK,   // Written → PUBACK (QoS 1)
+    LATENCY_STAGE_COUNT
+};
+
+struct LatencyTelemetry {
+    uint32_t count;
+    uint32_t avgUs;
+    uint32_t maxUs;
+};
+
+class Telemetry {
+public:
+    Telemetry();
+    
+    // Take a new sample (call every TELEMETRY_INTERVAL_MS)
+    void sample();
+    
+    // Print the last sample to Serial
+    void printSerial() const;
+    
+    // Format the last sample as compact JSON; returns bytes written, or 0
+    // (and logs) if it doesn't fit into len
+    size_t formatJson(char* buf, size_t len) const;
+    
+    uint8_t coreLoad(uint8_t core) const { return core < 2 ? coreLoadPercent[core] : 0; }
+    
+    // Record a pipeline latency (callable from any task)
+    void recordLatency(LatencyStage stage, uint32_t us);
+    
+private:
+    TaskTelemetry tasks[TELEMETRY_MAX_TASKS];
+    uint8_t taskCount;
+    HeapTelemetry heap;
+    uint8_t coreLoadPercent[2];
+    bool haveRunTimeStats;
+    
+    // Latency of the last sample period, and the accumulators for the current one
+    LatencyTelemetry latency[LATENCY_STAGE_COUNT];
+    uint32_t latencyCount[LATENCY_STAGE_COUNT];
+    uint64_t latencySumUs[LATENCY_STAGE_COUNT];
+    uint32_t latencyMaxUs[LATENCY_STAGE_COUNT];
+    
+    // Previous run-time counters, keyed by task number
+    uint32_t prevTaskNumber[TELEMETRY_MAX_TASKS];
+    uint32_t prevRunTime[TELEMETRY_MAX_TASKS];
+    uint8_t prevCount;
+    uint32_t prevTotalRunTime;
+};
+
+extern Telemetry telemetry;
+
+#endif // TELEMETRY_H
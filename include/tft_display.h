@@ -13,10 +13,10 @@
 // Initialize display hardware and create display task
 void initDisplay();
 
-// Start the display task on Core 0
+// Start the display task (placement from TASK_TOPOLOGY)
 void startDisplayTask();
 
-// Display task function (runs on Core 0)
+// Display task function
 void displayTask(void* parameter);
 
 #endif // LCD_ENABLED
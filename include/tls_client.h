@@ -0,0 +1,101 @@
+/**
+ * Battery Guard Multi-Device Monitor - TLS Transport with Session Resumption
+ *
+ * Client implementation for MQTT_TLS builds: mbedTLS over a WiFiClient,
+ * used by the MQTT session in place of the plain socket.
+ *
+ * - The negotiated session (ID and/or ticket) is cached after every
+ *   handshake and offered on the next connect, so a reconnect after a
+ *   dropout is an abbreviated handshake (no certificate chain, no key
+ *   exchange) instead of seconds of RSA/ECDHE work.
+ * - The cached session is also serialized to RTC memory (TLS_SESSION_STORE
+ *   bytes), so it survives software/watchdog resets like the warm restart
+ *   snapshot. Power loss clears it.
+ * - The SSL context and its record buffers are allocated once and reset
+ *   between connections instead of being freed and reallocated.
+ *
+ * Each handshake is logged with its duration and the heap the connection
+ * holds afterwards; full vs resumed figures appear in the telemetry.
+ */
+
+#ifndef TLS_CLIENT_H
+#define TLS_CLIENT_H
+
+#if defined(MQTT_ENABLED) && defined(MQTT_TLS)
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include "config_defaults.h"
+
+#define TLS_HANDSHAKE_TIMEOUT_MS 15000
+#define TLS_WRITE_TIMEOUT_MS 5000
+#define TLS_SESSION_STORE 2048      // RTC bytes for the serialized session
+
+struct TlsHandshakeStats {
+    uint32_t count;
+    uint32_t lastMs;
+    uint32_t maxMs;
+    uint32_t lastHeapBytes;     // Heap held by the connection after the handshake
+};
+
+class TlsClient : public Client {
+public:
+    TlsClient();
+
+    // Broker CA (PEM). Without one the server certificate is not verified.
+    void setCACert(const char* pem) { caCert = pem; }
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char* host, uint16_t port);
+    size_t write(uint8_t b);
+    size_t write(const uint8_t* buf, size_t size);
+    int available();
+    int read();
+    int read(uint8_t* buf, size_t size);
+    int peek();
+    void flush() {}
+    void stop();
+    uint8_t connected();
+    operator bool() { return connected(); }
+
+    void printStats();
+    size_t formatStats(char* buf, size_t len);
+
+private:
+    WiFiClient tcp;
+    const char* caCert;
+    bool initialized;
+    bool established;
+    int peeked;                 // -1 = none
+
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_x509_crt ca;
+    mbedtls_ssl_config conf;
+    mbedtls_ssl_context ssl;
+
+    mbedtls_ssl_session session;
+    bool haveSession;
+    bool certificateSeen;       // Set by onVerify during the handshake
+
+    TlsHandshakeStats fullStats;
+    TlsHandshakeStats resumedStats;
+
+    bool setup();
+    void fail(const char* what, int ret);
+    void cacheSession();
+    void restoreSession();
+    void storeSession();
+
+    static int onVerify(void* ctx, mbedtls_x509_crt* crt, int depth, uint32_t* flags);
+    static int bioSend(void* ctx, const unsigned char* buf, size_t len);
+    static int bioRecv(void* ctx, unsigned char* buf, size_t len);
+};
+
+#endif // MQTT_ENABLED && MQTT_TLS
+
+#endif // TLS_CLIENT_H
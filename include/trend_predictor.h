@@ -0,0 +1,146 @@
+/**
+ * Battery Guard Multi-Device Monitor - Time-to-Empty / Time-to-Full
+ *
+ * Exponentially weighted linear regression of SOC over time, updated per
+ * frame in constant memory. Older frames fade with time constant tau
+ * (TREND_TAU_DISCHARGE_MS / TREND_TAU_CHARGE_MS), so irregular frame
+ * spacing and reconnect gaps are weighted by age, not by count.
+ *
+ * The fit keeps weighted means and co-moments (West's incremental update
+ * with forgetting) with the time origin moved to the newest frame on every
+ * update, so magnitudes stay small and float precision is enough.
+ *
+ * Charging and discharging are fitted separately: a charge-state change
+ * restarts the fit. Prediction: hours until the fitted SOC reaches
+ * TREND_RESERVE_SOC (discharging) or 100% (charging), with bounds from the
+ * 90% confidence interval of the slope. The interval treats frames as
+ * independent, so with 1% SOC steps it is on the narrow side.
+ */
+
+#ifndef TREND_PREDICTOR_H
+#define TREND_PREDICTOR_H
+
+#include "port_lock.h"
+#include "config_defaults.h"
+#include "types.h"
+
+#define TREND_MIN_SPAN_H 0.25f      // Fit must cover this much time before predicting
+#define TREND_Z 1.645f              // Two-sided 90% interval
+
+struct TrendPrediction {
+    bool valid;                 // Enough history for a fit
+    bool charging;
+    float socPerHour;           // Fitted slope
+    float socPerHourError;      // Standard error of the slope
+    float hours;                // To threshold, -1 = not heading there
+    float hoursMin;             // Fast end of the interval, -1 = n/a
+    float hoursMax;             // Slow end, -1 = unbounded
+};
+
+class TrendPredictor {
+public:
+    TrendPredictor() {
+        portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+        lock = unlocked;
+        restart(0, false);
+    }
+
+    // Forget the fit (slot re-provisioned)
+    void reset() {
+        portENTER_CRITICAL(&lock);
+        restart(0, false);
+        portEXIT_CRITICAL(&lock);
+    }
+
+    // Per parsed frame (sample task)
+    void update(unsigned long nowMs, float soc, bool isCharging) {
+        portENTER_CRITICAL(&lock);
+        if (weight == 0 || isCharging != charging) {
+            restart(nowMs, isCharging);
+        }
+
+        float dtHours = (nowMs - lastMs) / 3600000.0f;
+        float decay = expf(-dtHours / tauHours);
+        lastMs = nowMs;
+        spanHours += dtHours;
+
+        // Move the origin to this frame: x of the new sample is 0
+        meanX -= dtHours;
+        weight = decay * weight + 1;
+        weightSq = decay * decay * weightSq + 1;
+        sxx *= decay;
+        sxy *= decay;
+        syy *= decay;
+
+        float dx = 0 - meanX;
+        float dy = soc - meanY;
+        meanX += dx / weight;
+        meanY += dy / weight;
+        sxx += dx * (0 - meanX);
+        sxy += dx * (soc - meanY);
+        syy += dy * (soc - meanY);
+        portEXIT_CRITICAL(&lock);
+    }
+
+    TrendPrediction predict(unsigned long nowMs) const {
+        TrendPrediction p = { false, false, 0, 0, -1, -1, -1 };
+        portENTER_CRITICAL(&lock);
+        float w = weight, w2 = weightSq, mx = meanX, my = meanY;
+        float xx = sxx, xy = sxy, yy = syy, span = spanHours;
+        unsigned long last = lastMs;
+        p.charging = charging;
+        portEXIT_CRITICAL(&lock);
+
+        float effectiveN = (w2 > 0) ? w * w / w2 : 0;
+        if (span < TREND_MIN_SPAN_H || effectiveN < 3 || xx <= 0) return p;
+
+        p.valid = true;
+        p.socPerHour = xy / xx;
+        float residual = (yy - p.socPerHour * xy) / w;        // Weighted residual variance
+        if (residual < 0) residual = 0;
+        p.socPerHourError = sqrtf(residual / (xx * (effectiveN - 2) / effectiveN));
+
+        // Fitted SOC now (x = hours since the newest frame)
+        float x = (nowMs - last) / 3600000.0f;
+        float fitted = my + p.socPerHour * (x - mx);
+        float target = p.charging ? 100.0f : (float)TREND_RESERVE_SOC;
+        float remaining = p.charging ? target - fitted : fitted - target;
+        if (remaining <= 0) {
+            p.hours = 0;
+            return p;
+        }
+
+        // Rate towards the target (positive = heading there)
+        float rate = p.charging ? p.socPerHour : -p.socPerHour;
+        float margin = TREND_Z * p.socPerHourError;
+        if (rate > 0) {
+            p.hours = remaining / rate;
+            p.hoursMin = remaining / (rate + margin);
+            if (rate - margin > 0) p.hoursMax = remaining / (rate - margin);
+        }
+        return p;
+    }
+
+private:
+    mutable portMUX_TYPE lock;
+    bool charging;
+    float tauHours;
+    unsigned long lastMs;       // Time of the newest frame (x = 0)
+    float spanHours;            // History covered since the last restart
+    float weight;               // Sum of weights
+    float weightSq;             // Sum of squared weights (effective sample size)
+    float meanX, meanY;         // Weighted means (x in hours relative to lastMs)
+    float sxx, sxy, syy;        // Weighted co-moments
+
+    void restart(unsigned long nowMs, bool isCharging) {
+        charging = isCharging;
+        tauHours = (isCharging ? TREND_TAU_CHARGE_MS : TREND_TAU_DISCHARGE_MS) / 3600000.0f;
+        lastMs = nowMs;
+        spanHours = 0;
+        weight = weightSq = 0;
+        meanX = meanY = 0;
+        sxx = sxy = syy = 0;
+    }
+};
+
+#endif // TREND_PREDICTOR_H
@@ -5,7 +5,12 @@
 #ifndef TYPES_H
 #define TYPES_H
 
-#include <Arduino.h>
+#ifdef ARDUINO
+  #include <Arduino.h>
+#else
+  #include <stdint.h>
+  #include <stdio.h>
+#endif
 
 // ============================================================================
 // Battery Type Definitions
@@ -62,6 +67,15 @@ inline const char* getBatteryStatusMqtt(uint8_t status) {
     }
 }
 
+// ============================================================================
+// Device Protocols (see protocol_decoder.h)
+// ============================================================================
+enum ProtocolId : uint8_t {
+    PROTOCOL_BM6 = 0,           // intAct Battery Guard (default)
+    PROTOCOL_BM2 = 1,           // Ancel BM300 Pro
+    PROTOCOL_COUNT
+};
+
 // ============================================================================
 // Device Configuration Structure
 // ============================================================================
@@ -72,6 +86,7 @@ struct DeviceConfig {
     BatteryType type;           // Battery type (LEAD_ACID or AGM for automatic mode)
     bool enabled;               // Enable monitoring for this device
     const uint8_t* key;         // Pointer to AES key for this device
+    ProtocolId protocol;        // Frame/handshake protocol (omitted = PROTOCOL_BM6)
 };
 
 // ============================================================================
@@ -0,0 +1,102 @@
+/**
+ * Battery Guard Multi-Device Monitor - UDP Frame Stream
+ *
+ * Fire-and-forget stream of every device's latest frame for consumers that
+ * want the full 1 Hz data without a broker: no connection, no retransmits,
+ * no head-of-line blocking behind a slow TCP peer. The sample bus sink only
+ * copies the reading into the device's slot; UdpTask sends the slots updated
+ * since the last datagram every UDP_INTERVAL_MS as one datagram.
+ *
+ * Datagram (little-endian, UDP_HEADER_BYTES + count * UDP_RECORD_BYTES):
+ *
+ *   0  u16  magic 0x4742 ("BG")
+ *   2  u8   version (UDP_VERSION)
+ *   3  u8   record count
+ *   4  u32  gateway id (UDP_GATEWAY_ID, default: eFuse MAC bytes 2-5)
+ *   8  u32  sequence (+1 per datagram, 0 after boot)
+ *  12  i64  send time, UTC epoch ms (0 = clock not synced)
+ *
+ *  per record:
+ *   0  u8[6] device MAC (display order)
+ *   6  u16  voltage (mV)
+ *   8  u8   SOC (%)
+ *   9  i8   temperature (°C)
+ *  10  u8   status byte
+ *  11  u8   frames replaced in the slot since the previous datagram
+ *  12  u16  rapid voltage rise
+ *  14  u16  rapid voltage drop
+ *  16  u32  age at send (ms since BLE arrival)
+ *
+ * tools/udp_receiver.py decodes the stream and reports loss and latency.
+ */
+
+#ifndef UDP_STREAMER_H
+#define UDP_STREAMER_H
+
+#ifdef UDP_ENABLED
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "config_defaults.h"
+#include "types.h"
+#include "sample_bus.h"
+
+#define UDP_MAGIC 0x4742
+#define UDP_VERSION 1
+#define UDP_HEADER_BYTES 20
+#define UDP_RECORD_BYTES 20
+
+struct UdpStats {
+    uint32_t datagrams;
+    uint32_t records;
+    uint32_t replaced;          // Frames overwritten before they were sent
+    uint32_t sendErrors;        // beginPacket/endPacket failures (no route, no buffer)
+    uint32_t lastSendUs;        // Build + send time of the last datagram
+};
+
+class UdpStreamer {
+public:
+    UdpStreamer();
+
+    // Start UdpTask
+    bool begin();
+
+    // Sample task: store the latest reading of a device
+    bool update(const SampleRecord& record);
+
+    void printStats();
+    size_t formatStats(char* buf, size_t len);
+
+private:
+    struct Slot {
+        bool fresh;             // Updated since the last datagram
+        uint8_t replaced;
+        uint8_t mac[6];
+        uint16_t voltageMv;
+        uint8_t soc;
+        int8_t temperature;
+        uint8_t status;
+        uint16_t rapidVoltageRise;
+        uint16_t rapidVoltageDrop;
+        int64_t arrivalUs;
+    };
+
+    Slot slots[MAX_MONITORS];
+    portMUX_TYPE lock;
+    uint32_t gatewayId;
+    uint32_t sequence;
+    TaskHandle_t task;
+    WiFiUDP udp;
+    UdpStats stats;
+
+    static void taskEntry(void* param);
+    void run();
+    void send();
+};
+
+extern UdpStreamer udpStreamer;
+
+#endif // UDP_ENABLED
+
+#endif // UDP_STREAMER_H
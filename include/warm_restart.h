@@ -0,0 +1,23 @@
+/**
+ * Battery Guard Multi-Device Monitor - Warm Restart
+ *
+ * Keeps a compact snapshot of every monitor (device address, last reading,
+ * notification cadence, wall-clock time) in RTC slow memory. RTC_NOINIT
+ * memory survives software, watchdog and panic resets, so after such a reset
+ * known devices are reconnected directly instead of waiting for a scan hit.
+ */
+
+#ifndef WARM_RESTART_H
+#define WARM_RESTART_H
+
+#include <Arduino.h>
+#include "battery_monitor.h"
+
+// Write the current monitor state into RTC memory
+void warmRestartSave(const BatteryMonitor* monitors, uint8_t count);
+
+// Restore monitors from RTC memory after a non-power-on reset.
+// Returns the number of monitors that were restored (0 on cold boot).
+uint8_t warmRestartRestore(BatteryMonitor* monitors, uint8_t count);
+
+#endif // WARM_RESTART_H
@@ -0,0 +1,27 @@
+/**
+ * Battery Guard Multi-Device Monitor - WiFi Link
+ *
+ * Station-mode WiFi for every network feature (MQTT, InfluxDB, UDP stream). Association
+ * runs in the background and the driver reconnects on its own; link changes
+ * arrive as WiFi events, which log them, restart SNTP after every
+ * (re)association and mark network activity for the coexistence scheduler.
+ */
+
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <Arduino.h>
+#include "config_defaults.h"
+
+#if defined(MQTT_ENABLED) || defined(INFLUX_ENABLED) || defined(UDP_ENABLED)
+#define WIFI_ENABLED
+
+// Start association (non-blocking, safe to call more than once)
+void wifiLinkBegin();
+
+// True while associated with an IP address
+bool wifiLinkUp();
+
+#endif
+
+#endif // WIFI_LINK_H
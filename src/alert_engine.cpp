@@ -0,0 +1,533 @@
+#include "alert_engine.h"
+#include <Preferences.h>
+#include "telemetry.h"
+#include "debug.h"
+
+// Global instance
+AlertEngine alertEngine;
+
+#define ALERT_NAMESPACE "bg-alerts"
+#define ALERT_VERSION 1
+#define ALERT_QUEUE_DEPTH 8
+
+static portMUX_TYPE alertMux = portMUX_INITIALIZER_UNLOCKED;
+
+// NVS layout (blob "rules")
+struct StoredRules {
+    uint32_t version;
+    AlertRuleSource rules[ALERT_MAX_RULES];
+};
+
+static const char* const SIGNAL_NAMES[SIG_COUNT] = {
+    "voltage", "soc", "temperature", "charging", "resting", "soh",
+    "soc_rate", "to_reserve_h", "vdrop_1m", "vrise_1m"
+};
+
+AlertEngine::AlertEngine() :
+    stagedCount(0), stagedReady(false), resultPending(false),
+    activeCount(0), activeSignals(0), alertQueue(NULL), alertDrops(0) {
+    memset(sources, 0, sizeof(sources));
+    memset(states, 0, sizeof(states));
+    memset(events, 0, sizeof(events));
+    result[0] = '\0';
+}
+
+// ============================================================================
+// Bytecode
+// ============================================================================
+enum AlertOp : uint8_t {
+    OP_END,
+    OP_SIGNAL,                  // arg: AlertSignal
+    OP_CONST,                   // arg: constant index
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_AND, OP_OR, OP_NOT
+};
+
+// Recursive descent:  or := and ("or" and)*   and := unary ("and" unary)*
+//                     unary := "not" unary | "(" or ")" | operand [relop operand]
+struct AlertCompiler {
+    const char* p;
+    AlertProgram& out;
+    uint8_t depth;
+    uint8_t constCount;
+    const char* error;
+
+    AlertCompiler(const char* expr, AlertProgram& program) :
+        p(expr), out(program), depth(0), constCount(0), error(nullptr) {}
+
+    void skipSpaces() {
+        while (*p == ' ') p++;
+    }
+
+    // Consume keyword if it is the next word
+    bool keyword(const char* word) {
+        skipSpaces();
+        size_t n = strlen(word);
+        if (strncmp(p, word, n) == 0 && !isalnum((unsigned char)p[n]) && p[n] != '_') {
+            p += n;
+            return true;
+        }
+        return false;
+    }
+
+    void emit(uint8_t byte) {
+        if (out.length >= ALERT_CODE_LEN - 1) {
+            fail("expression too long");
+            return;
+        }
+        out.code[out.length++] = byte;
+    }
+
+    void push() {
+        if (++depth > ALERT_STACK_DEPTH) fail("expression too deep");
+    }
+
+    void fail(const char* message) {
+        if (!error) error = message;
+    }
+
+    void parseOr() {
+        parseAnd();
+        while (!error && keyword("or")) {
+            parseAnd();
+            emit(OP_OR);
+            depth--;
+        }
+    }
+
+    void parseAnd() {
+        parseUnary();
+        while (!error && keyword("and")) {
+            parseUnary();
+            emit(OP_AND);
+            depth--;
+        }
+    }
+
+    void parseUnary() {
+        if (keyword("not")) {
+            parseUnary();
+            emit(OP_NOT);
+            return;
+        }
+        skipSpaces();
+        if (*p == '(') {
+            p++;
+            parseOr();
+            skipSpaces();
+            if (*p != ')') {
+                fail("missing ')'");
+                return;
+            }
+            p++;
+            return;
+        }
+        parseOperand();
+        if (error) return;
+
+        skipSpaces();
+        uint8_t op = OP_END;
+        if (p[0] == '<' && p[1] == '=')      { op = OP_LE; p += 2; }
+        else if (p[0] == '>' && p[1] == '=') { op = OP_GE; p += 2; }
+        else if (p[0] == '=' && p[1] == '=') { op = OP_EQ; p += 2; }
+        else if (p[0] == '!' && p[1] == '=') { op = OP_NE; p += 2; }
+        else if (p[0] == '<')                { op = OP_LT; p += 1; }
+        else if (p[0] == '>')                { op = OP_GT; p += 1; }
+        if (op == OP_END) return;  // Bare operand is used as a boolean
+
+        parseOperand();
+        emit(op);
+        depth--;
+    }
+
+    void parseOperand() {
+        skipSpaces();
+        if (isdigit((unsigned char)*p) || *p == '-' || *p == '.') {
+            char* end;
+            float value = strtof(p, &end);
+            if (end == p) {
+                fail("invalid number");
+                return;
+            }
+            p = end;
+            // Reuse identical constants
+            uint8_t index = 0;
+            while (index < constCount && out.consts[index] != value) index++;
+            if (index == constCount) {
+                if (constCount >= ALERT_MAX_CONSTS) {
+                    fail("too many constants");
+                    return;
+                }
+                out.consts[constCount++] = value;
+            }
+            emit(OP_CONST);
+            emit(index);
+            push();
+            return;
+        }
+
+        for (uint8_t s = 0; s < SIG_COUNT; s++) {
+            if (keyword(SIGNAL_NAMES[s])) {
+                emit(OP_SIGNAL);
+                emit(s);
+                out.signals |= (uint16_t)(1 << s);
+                push();
+                return;
+            }
+        }
+        fail("unknown signal");
+    }
+};
+
+const char* AlertEngine::compile(const char* expr, AlertProgram& program) {
+    memset(&program, 0, sizeof(program));
+    AlertCompiler compiler(expr, program);
+    compiler.parseOr();
+    compiler.skipSpaces();
+    if (!compiler.error && *compiler.p != '\0') {
+        compiler.fail("unexpected text");
+    }
+    if (!compiler.error && compiler.depth != 1) {
+        compiler.fail("incomplete expression");
+    }
+    compiler.emit(OP_END);
+    return compiler.error;
+}
+
+bool AlertEngine::run(const AlertProgram& program, const float* signals) {
+    float stack[ALERT_STACK_DEPTH];
+    uint8_t sp = 0;
+    const uint8_t* pc = program.code;
+
+    while (true) {
+        switch (*pc++) {
+            case OP_SIGNAL: stack[sp++] = signals[*pc++]; break;
+            case OP_CONST:  stack[sp++] = program.consts[*pc++]; break;
+            case OP_LT:  sp--; stack[sp - 1] = stack[sp - 1] <  stack[sp]; break;
+            case OP_LE:  sp--; stack[sp - 1] = stack[sp - 1] <= stack[sp]; break;
+            case OP_GT:  sp--; stack[sp - 1] = stack[sp - 1] >  stack[sp]; break;
+            case OP_GE:  sp--; stack[sp - 1] = stack[sp - 1] >= stack[sp]; break;
+            case OP_EQ:  sp--; stack[sp - 1] = stack[sp - 1] == stack[sp]; break;
+            case OP_NE:  sp--; stack[sp - 1] = stack[sp - 1] != stack[sp]; break;
+            case OP_AND: sp--; stack[sp - 1] = (stack[sp - 1] != 0) && (stack[sp] != 0); break;
+            case OP_OR:  sp--; stack[sp - 1] = (stack[sp - 1] != 0) || (stack[sp] != 0); break;
+            case OP_NOT: stack[sp - 1] = stack[sp - 1] == 0; break;
+            default:     return sp > 0 && stack[sp - 1] != 0;
+        }
+    }
+}
+
+// ============================================================================
+// Loading & Persistence (network task after setup)
+// ============================================================================
+void AlertEngine::begin() {
+    #ifdef MQTT_ENABLED
+        alertQueue = xQueueCreate(ALERT_QUEUE_DEPTH, sizeof(AlertMessage));
+    #endif
+
+    Preferences prefs;
+    if (prefs.begin(ALERT_NAMESPACE, true)) {
+        StoredRules stored;
+        if (prefs.getBytes("rules", &stored, sizeof(stored)) == sizeof(stored) &&
+            stored.version == ALERT_VERSION) {
+            memcpy(sources, stored.rules, sizeof(sources));
+        }
+        prefs.end();
+    }
+    for (uint8_t i = 0; i < ALERT_MAX_RULES; i++) {
+        sources[i].id[ALERT_ID_LEN - 1] = '\0';
+        sources[i].when[ALERT_EXPR_LEN - 1] = '\0';
+        sources[i].clear[ALERT_EXPR_LEN - 1] = '\0';
+        sources[i].device[sizeof(sources[i].device) - 1] = '\0';
+    }
+    stage();
+    if (stagedCount > 0) {
+        Serial.printf("[ALERT] %d rule(s) loaded\n", stagedCount);
+    }
+}
+
+void AlertEngine::save() {
+    StoredRules stored;
+    stored.version = ALERT_VERSION;
+    memcpy(stored.rules, sources, sizeof(sources));
+
+    Preferences prefs;
+    if (!prefs.begin(ALERT_NAMESPACE, false)) {
+        Serial.println("[ALERT] ERROR: Could not open NVS");
+        return;
+    }
+    prefs.putBytes("rules", &stored, sizeof(stored));
+    prefs.end();
+}
+
+// Compile all sources and hand them to the sample task
+void AlertEngine::stage() {
+    ActiveRule compiled[ALERT_MAX_RULES];
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < ALERT_MAX_RULES; i++) {
+        const AlertRuleSource& src = sources[i];
+        if (src.id[0] == '\0') continue;
+
+        ActiveRule& rule = compiled[count];
+        const char* error = compile(src.when, rule.when);
+        if (!error && src.clear[0]) {
+            error = compile(src.clear, rule.clear);
+        } else if (!error) {
+            memset(&rule.clear, 0, sizeof(rule.clear));
+        }
+        if (error) {
+            Serial.printf("[ALERT] Rule %s skipped: %s\n", src.id, error);
+            continue;
+        }
+        memcpy(rule.id, src.id, sizeof(rule.id));
+        memcpy(rule.device, src.device, sizeof(rule.device));
+        rule.forMs = src.forSeconds * 1000UL;
+        rule.clearForMs = src.clearForSeconds * 1000UL;
+        count++;
+    }
+
+    portENTER_CRITICAL(&alertMux);
+    memcpy(staged, compiled, count * sizeof(ActiveRule));
+    stagedCount = count;
+    stagedReady = true;
+    portEXIT_CRITICAL(&alertMux);
+}
+
+// Sample task: switch to the staged rule set (alert states start over)
+void AlertEngine::adopt() {
+    portENTER_CRITICAL(&alertMux);
+    memcpy(active, staged, stagedCount * sizeof(ActiveRule));
+    activeCount = stagedCount;
+    stagedReady = false;
+    portEXIT_CRITICAL(&alertMux);
+
+    activeSignals = 0;
+    for (uint8_t r = 0; r < activeCount; r++) {
+        activeSignals |= active[r].when.signals | active[r].clear.signals;
+    }
+    memset(states, 0, sizeof(states));
+}
+
+// ============================================================================
+// Rule Commands (network task)
+// ============================================================================
+void AlertEngine::setRule(const AlertRuleSource& rule) {
+    AlertProgram program;
+    const char* error = compile(rule.when, program);
+    if (!error && rule.clear[0]) error = compile(rule.clear, program);
+    if (!error && rule.id[0] == '\0') error = "missing id";
+    if (error) {
+        setResult("set", false, error);
+        return;
+    }
+
+    // Replace a rule with the same id, else take a free slot
+    int8_t slot = -1;
+    for (uint8_t i = 0; i < ALERT_MAX_RULES && slot < 0; i++) {
+        if (strcmp(sources[i].id, rule.id) == 0) slot = i;
+    }
+    for (uint8_t i = 0; i < ALERT_MAX_RULES && slot < 0; i++) {
+        if (sources[i].id[0] == '\0') slot = i;
+    }
+    if (slot < 0) {
+        setResult("set", false, "rule table full");
+        return;
+    }
+
+    sources[slot] = rule;
+    save();
+    stage();
+    setResult("set", true, nullptr);
+    Serial.printf("[ALERT] Rule %s: when \"%s\" for %us\n", rule.id, rule.when, rule.forSeconds);
+}
+
+void AlertEngine::deleteRule(const char* id) {
+    for (uint8_t i = 0; i < ALERT_MAX_RULES; i++) {
+        if (sources[i].id[0] && strcmp(sources[i].id, id) == 0) {
+            memset(&sources[i], 0, sizeof(sources[i]));
+            save();
+            stage();
+            setResult("delete", true, nullptr);
+            return;
+        }
+    }
+    setResult("delete", false, "unknown rule");
+}
+
+void AlertEngine::rejectCommand(const char* error) {
+    setResult("?", false, error);
+}
+
+void AlertEngine::listRules() {
+    char buf[sizeof(result)];
+    size_t pos = snprintf(buf, sizeof(buf), "{\"op\":\"list\",\"ok\":true,\"rules\":[");
+    bool first = true;
+    for (uint8_t i = 0; i < ALERT_MAX_RULES && pos < sizeof(buf); i++) {
+        const AlertRuleSource& src = sources[i];
+        if (src.id[0] == '\0') continue;
+        pos += snprintf(buf + pos, sizeof(buf) - pos,
+            "%s{\"id\":\"%s\",\"device\":\"%s\",\"when\":\"%s\",\"for\":%u,\"clear\":\"%s\",\"clear_for\":%u}",
+            first ? "" : ",", src.id, src.device, src.when, src.forSeconds, src.clear, src.clearForSeconds);
+        first = false;
+    }
+    if (pos < sizeof(buf)) {
+        snprintf(buf + pos, sizeof(buf) - pos, "]}");
+    }
+
+    portENTER_CRITICAL(&alertMux);
+    memcpy(result, buf, sizeof(result));
+    result[sizeof(result) - 1] = '\0';
+    resultPending = true;
+    portEXIT_CRITICAL(&alertMux);
+}
+
+void AlertEngine::setResult(const char* op, bool ok, const char* error) {
+    portENTER_CRITICAL(&alertMux);
+    if (ok) {
+        snprintf(result, sizeof(result), "{\"op\":\"%s\",\"ok\":true}", op);
+    } else {
+        snprintf(result, sizeof(result), "{\"op\":\"%s\",\"ok\":false,\"error\":\"%s\"}", op, error);
+    }
+    resultPending = true;
+    portEXIT_CRITICAL(&alertMux);
+
+    if (!ok) {
+        Serial.printf("[ALERT] %s rejected: %s\n", op, error);
+    }
+}
+
+bool AlertEngine::takeResult(char* buf, size_t len) {
+    if (!resultPending) return false;
+    portENTER_CRITICAL(&alertMux);
+    strncpy(buf, result, len - 1);
+    buf[len - 1] = '\0';
+    resultPending = false;
+    portEXIT_CRITICAL(&alertMux);
+    return true;
+}
+
+bool AlertEngine::takeAlert(AlertMessage& message) {
+    return alertQueue && xQueueReceive(alertQueue, &message, 0) == pdTRUE;
+}
+
+// ============================================================================
+// Evaluation (sample task, per frame)
+// ============================================================================
+
+// Rapid voltage counter increments, remembered with their arrival time
+void AlertEngine::recordEvents(const BatteryMonitor* monitor, uint8_t index, unsigned long nowMs) {
+    DeviceEvents& ev = events[index];
+    if (!ev.seen) {
+        ev.seen = true;
+        ev.lastDrop = monitor->rapidVoltageDrop;
+        ev.lastRise = monitor->rapidVoltageRise;
+        return;
+    }
+    if (monitor->rapidVoltageDrop != ev.lastDrop) {
+        ev.lastDrop = monitor->rapidVoltageDrop;
+        ev.dropTimes[ev.dropNext] = nowMs;
+        ev.dropNext = (ev.dropNext + 1) % ALERT_EVENT_HISTORY;
+    }
+    if (monitor->rapidVoltageRise != ev.lastRise) {
+        ev.lastRise = monitor->rapidVoltageRise;
+        ev.riseTimes[ev.riseNext] = nowMs;
+        ev.riseNext = (ev.riseNext + 1) % ALERT_EVENT_HISTORY;
+    }
+}
+
+static float countRecent(const unsigned long* times, unsigned long nowMs) {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < ALERT_EVENT_HISTORY; i++) {
+        if (times[i] != 0 && nowMs - times[i] <= 60000) count++;
+    }
+    return count;
+}
+
+void AlertEngine::loadSignals(const BatteryMonitor* monitor, uint8_t index, unsigned long nowMs, float* signals) {
+    signals[SIG_VOLTAGE] = monitor->voltage;
+    signals[SIG_SOC] = monitor->soc;
+    signals[SIG_TEMPERATURE] = monitor->temperature;
+    signals[SIG_CHARGING] = monitor->status == STATUS_CHARGING;
+
+    if (activeSignals & (1 << SIG_RESTING)) {
+        signals[SIG_RESTING] = monitor->health.isResting();
+    }
+    if (activeSignals & (1 << SIG_SOH)) {
+        signals[SIG_SOH] = monitor->health.stateOfHealth();
+    }
+    if (activeSignals & ((1 << SIG_SOC_RATE) | (1 << SIG_TO_RESERVE_H))) {
+        TrendPrediction trend = monitor->trend.predict(nowMs);
+        signals[SIG_SOC_RATE] = trend.valid ? trend.socPerHour : 0;
+        signals[SIG_TO_RESERVE_H] = (trend.valid && !trend.charging && trend.hours >= 0) ? trend.hours : 1e9f;
+    }
+    if (activeSignals & (1 << SIG_VDROP_1M)) {
+        signals[SIG_VDROP_1M] = countRecent(events[index].dropTimes, nowMs);
+    }
+    if (activeSignals & (1 << SIG_VRISE_1M)) {
+        signals[SIG_VRISE_1M] = countRecent(events[index].riseTimes, nowMs);
+    }
+}
+
+void AlertEngine::evaluate(const BatteryMonitor* monitor, uint8_t index, unsigned long nowMs) {
+    if (stagedReady) adopt();
+    if (activeCount == 0 || index >= MAX_MONITORS) return;
+
+    int64_t startUs = clockMicros();
+
+    recordEvents(monitor, index, nowMs);
+    float signals[SIG_COUNT];
+    loadSignals(monitor, index, nowMs, signals);
+
+    for (uint8_t r = 0; r < activeCount; r++) {
+        const ActiveRule& rule = active[r];
+        if (rule.device[0] && strcmp(rule.device, monitor->config->mqttName) != 0) continue;
+
+        RuleState& state = states[r][index];
+        bool holding;
+        uint32_t holdMs;
+        if (!state.active) {
+            holding = run(rule.when, signals);
+            holdMs = rule.forMs;
+        } else {
+            holding = rule.clear.length ? run(rule.clear, signals) : !run(rule.when, signals);
+            holdMs = rule.clearForMs;
+        }
+
+        if (!holding) {
+            state.pending = false;
+            continue;
+        }
+        if (!state.pending) {
+            state.pending = true;
+            state.since = nowMs;
+        }
+        if (nowMs - state.since >= holdMs) {
+            state.active = !state.active;
+            state.pending = false;
+            emit(rule, monitor, state.active);
+        }
+    }
+
+    telemetry.recordLatency(LATENCY_RULES, (uint32_t)(clockMicros() - startUs));
+}
+
+void AlertEngine::emit(const ActiveRule& rule, const BatteryMonitor* monitor, bool raised) {
+    Serial.printf("[ALERT] %s: %s %s (%.2fV, SOC %d%%, %d°C)\n", monitor->config->name, rule.id,
+        raised ? "raised" : "cleared", monitor->voltage, monitor->soc, monitor->temperature);
+
+    if (!alertQueue) return;
+    AlertMessage message;
+    memcpy(message.rule, rule.id, sizeof(message.rule));
+    strncpy(message.device, monitor->config->mqttName, sizeof(message.device) - 1);
+    message.device[sizeof(message.device) - 1] = '\0';
+    message.raised = raised;
+    message.voltage = monitor->voltage;
+    message.soc = monitor->soc;
+    message.temperature = monitor->temperature;
+    message.epochMs = monitor->sampleEpochMs;
+    if (xQueueSend(alertQueue, &message, 0) != pdTRUE) {
+        alertDrops++;
+        DEBUG_PRINTF("[ALERT] Queue full, %lu alert(s) dropped\n", (unsigned long)alertDrops);
+    }
+}
@@ -0,0 +1,45 @@
+#include "clock_source.h"
+#include <sys/time.h>
+
+#ifdef VIRTUAL_CLOCK
+
+volatile uint64_t g_virtualClockUs = 0;
+uint32_t g_virtualRandomState = 1;
+
+#endif // VIRTUAL_CLOCK
+
+// Anything earlier than 2020-09-13 means the RTC was never set
+static const time_t MIN_VALID_EPOCH = 1600000000;
+
+// UTC microseconds minus clockMicros(); 0 until the first sync
+static int64_t wallOffsetUs = 0;
+
+#ifdef ARDUINO
+static portMUX_TYPE wallOffsetMux = portMUX_INITIALIZER_UNLOCKED;
+#define WALL_OFFSET_LOCK()   portENTER_CRITICAL(&wallOffsetMux)
+#define WALL_OFFSET_UNLOCK() portEXIT_CRITICAL(&wallOffsetMux)
+#else
+// Host (native tests): single-threaded access
+#define WALL_OFFSET_LOCK()
+#define WALL_OFFSET_UNLOCK()
+#endif
+
+void clockSyncWallTime() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    int64_t mono = clockMicros();
+    if (tv.tv_sec < MIN_VALID_EPOCH) return;
+    
+    int64_t offset = (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec - mono;
+    WALL_OFFSET_LOCK();
+    wallOffsetUs = offset;
+    WALL_OFFSET_UNLOCK();
+}
+
+int64_t clockEpochMs(int64_t monoUs) {
+    WALL_OFFSET_LOCK();
+    int64_t offset = wallOffsetUs;
+    WALL_OFFSET_UNLOCK();
+    if (offset == 0) return 0;
+    return (monoUs + offset) / 1000;
+}
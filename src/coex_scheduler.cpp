@@ -0,0 +1,74 @@
+#include "coex_scheduler.h"
+#include "debug.h"
+
+#ifdef COEX_PREFERENCE
+  #include <esp_coexist.h>
+#endif
+
+// Global instance
+CoexScheduler coexScheduler;
+
+CoexScheduler::CoexScheduler() :
+    monitors(nullptr), monitorCount(0), lastActivity(0),
+    deferredSince(0), deferCount(0) {
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    deferLock = unlocked;
+}
+
+void CoexScheduler::begin(const BatteryMonitor* mons, uint8_t count) {
+    monitors = mons;
+    monitorCount = count;
+    
+    #ifdef COEX_PREFERENCE
+    esp_coex_preference_set(COEX_PREFERENCE);
+    Serial.printf("[COEX] Coexistence preference set to %d\n", (int)COEX_PREFERENCE);
+    #endif
+}
+
+void CoexScheduler::noteNetworkActivity() {
+    lastActivity = clockMillis();
+}
+
+bool CoexScheduler::allowBulkWork() {
+    unsigned long now = clockMillis();
+    
+    bool quiet = true;
+    for (uint8_t i = 0; i < monitorCount; i++) {
+        const BatteryMonitor& mon = monitors[i];
+        if (mon.state != STATE_MONITORING || mon.cadence.lastArrival == 0) continue;
+        if (mon.cadence.samples < LIVENESS_MIN_SAMPLES) continue;
+        
+        unsigned long sinceFrame = now - mon.cadence.lastArrival;
+        
+        // Overdue devices don't get a window - don't let them block forever
+        if (sinceFrame > 2 * mon.cadence.mean) continue;
+        
+        // Next frame expected within the guard interval: not a quiet window
+        if (sinceFrame + COEX_GUARD_MS >= mon.cadence.mean) {
+            quiet = false;
+            break;
+        }
+    }
+    
+    // The deferral state is shared by the MQTT I/O and Influx tasks
+    unsigned long deferredMs = 0;
+    portENTER_CRITICAL(&deferLock);
+    if (!quiet) {
+        if (deferredSince == 0) {
+            deferredSince = now;
+            deferCount++;
+        }
+        deferredMs = now - deferredSince;
+        if (deferredMs < COEX_MAX_DEFER_MS) {
+            portEXIT_CRITICAL(&deferLock);
+            return false;
+        }
+    }
+    deferredSince = 0;
+    portEXIT_CRITICAL(&deferLock);
+    
+    if (!quiet) {
+        DEBUG_PRINTF("[COEX] Bulk work deferred %lums, running anyway\n", deferredMs);
+    }
+    return true;
+}
@@ -0,0 +1,285 @@
+#include "connection_engine.h"
+#include "debug.h"
+
+typedef BatteryMonitor::Transport Transport;
+typedef BatteryMonitor::Logger Logger;
+
+// Time budget per phase (index = ConnectPhase). NimBLE enforces the connect
+// timeout; the blocking discover/subscribe calls are checked when they
+// return, the handshake before every write.
+static const uint32_t PHASE_TIMEOUT_MS[PHASE_COUNT] = {
+    CONNECT_TIMEOUT_MS,
+    DISCOVER_TIMEOUT_MS,
+    SUBSCRIBE_TIMEOUT_MS,
+    HANDSHAKE_TIMEOUT_MS
+};
+
+ConnectionEngine::ConnectionEngine(NotifyHandler onNotify) :
+    notifyHandler(onNotify) {}
+
+// ============================================================================
+// Full Connection Sequence
+// ============================================================================
+bool ConnectionEngine::connect(BatteryMonitor* monitor) {
+    if (monitor->state == STATE_COOLDOWN) return false;
+    
+    // Client is pooled per monitor (allocated once in setup())
+    if (!monitor->pClient) {
+        monitor->state = STATE_DISCONNECTED;
+        return false;
+    }
+    
+    monitor->connectMetrics.attempts++;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        monitor->connectMetrics.lastPhaseMs[i] = 0;
+    }
+    
+    if (!runConnect(monitor)) return false;
+    if (!runDiscover(monitor)) return false;
+    if (!runSubscribe(monitor)) return false;
+    if (!runHandshake(monitor)) return false;
+    
+    ConnectionMetrics& m = monitor->connectMetrics;
+    m.successes++;
+    m.lastTotalMs = 0;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        m.lastTotalMs += m.lastPhaseMs[i];
+    }
+    m.totalMsSum += m.lastTotalMs;
+    
+    Logger::printf("[%s] Connect phases: connect=%lums discover=%lums subscribe=%lums handshake=%lums | total=%lums (avg %lums, %lu/%lu ok)\n",
+        monitor->config->name,
+        (unsigned long)m.lastPhaseMs[PHASE_CONNECT], (unsigned long)m.lastPhaseMs[PHASE_DISCOVER],
+        (unsigned long)m.lastPhaseMs[PHASE_SUBSCRIBE], (unsigned long)m.lastPhaseMs[PHASE_HANDSHAKE],
+        (unsigned long)m.lastTotalMs, (unsigned long)m.averageTotalMs(),
+        (unsigned long)m.successes, (unsigned long)m.attempts);
+    
+    return true;
+}
+
+// ============================================================================
+// Phase: Connect
+// ============================================================================
+bool ConnectionEngine::runConnect(BatteryMonitor* monitor) {
+    monitor->state = STATE_CONNECTING;
+    char mac[18];
+    monitor->formatMacAddress(mac);
+    Logger::printf("[%s] Connecting to %s...\n", monitor->config->name, mac);
+    
+    DEBUG_TIMESTAMP();
+    DEBUG_PRINTF("[%s] Attempting connection (Attempt %d, RSSI %d, timeout %lums)...\n", 
+        monitor->config->name, monitor->connectRetries + 1, monitor->lastAdvRssi,
+        (unsigned long)CONNECT_TIMEOUT_MS);
+    
+    unsigned long startTime = clockMillis();
+    bool connected = Transport::connect(monitor->pClient, monitor->deviceAddress, CONNECT_TIMEOUT_MS);
+    // NimBLE rounds the timeout up to whole seconds; the budget still applies
+    connected &= finishPhase(monitor, PHASE_CONNECT, startTime);
+    
+    DEBUG_TIMESTAMP();
+    DEBUG_PRINTF("[%s] connect() returned: %s (took %lums)\n", 
+        monitor->config->name, connected ? "true" : "false",
+        (unsigned long)monitor->connectMetrics.lastPhaseMs[PHASE_CONNECT]);
+    
+    if (!connected) {
+        DEBUG_TIMESTAMP();
+        DEBUG_PRINTF("[%s] BLE Error Code: %d\n", monitor->config->name, Transport::lastError(monitor->pClient));
+        fail(monitor, PHASE_CONNECT);
+        return false;
+    }
+    
+    Logger::printf("[%s] Connected successfully!\n", monitor->config->name);
+    return true;
+}
+
+// ============================================================================
+// Phase: Service & Characteristic Discovery
+// ============================================================================
+bool ConnectionEngine::runDiscover(BatteryMonitor* monitor) {
+    DEBUG_TIMESTAMP();
+    DEBUG_PRINTF("[%s] Discovering services...\n", monitor->config->name);
+    
+    unsigned long startTime = clockMillis();
+    
+    const ProtocolDecoder* decoder = monitor->decoder;
+    Transport::Service* pService = Transport::getService(monitor->pClient, decoder->serviceUuid);
+    if (!pService) {
+        finishPhase(monitor, PHASE_DISCOVER, startTime);
+        Logger::printf("[%s] ERROR: Service %s not found\n", 
+            monitor->config->name, decoder->serviceUuid);
+        fail(monitor, PHASE_DISCOVER);
+        return false;
+    }
+    
+    monitor->pWriteChar = decoder->writeUuid
+        ? Transport::getCharacteristic(pService, decoder->writeUuid) : nullptr;
+    monitor->pNotifyChar = Transport::getCharacteristic(pService, decoder->notifyUuid);
+    
+    if (!finishPhase(monitor, PHASE_DISCOVER, startTime)) {
+        fail(monitor, PHASE_DISCOVER);
+        return false;
+    }
+    
+    if ((decoder->writeUuid && !monitor->pWriteChar) || !monitor->pNotifyChar) {
+        Logger::printf("[%s] ERROR: Characteristics not found (Write: %s, Notify: %s)\n", 
+            monitor->config->name, 
+            monitor->pWriteChar ? "OK" : "FAIL",
+            monitor->pNotifyChar ? "OK" : "FAIL");
+        fail(monitor, PHASE_DISCOVER);
+        return false;
+    }
+    
+    DEBUG_TIMESTAMP();
+    DEBUG_PRINTF("[%s] Characteristics found!\n", monitor->config->name);
+    return true;
+}
+
+// ============================================================================
+// Phase: Notification Subscription
+// ============================================================================
+bool ConnectionEngine::runSubscribe(BatteryMonitor* monitor) {
+    DEBUG_TIMESTAMP();
+    DEBUG_PRINTF("[%s] Subscribing to notifications...\n", monitor->config->name);
+    
+    if (!Transport::canNotify(monitor->pNotifyChar)) {
+        Logger::printf("[%s] ERROR: Characteristic cannot notify\n", monitor->config->name);
+        fail(monitor, PHASE_SUBSCRIBE);
+        return false;
+    }
+    
+    // Reset counters before the first notification can arrive
+    monitor->notifyCount = 0;
+    monitor->cadence.lastArrival = 0;
+    
+    unsigned long startTime = clockMillis();
+    bool subscribed = Transport::subscribe(monitor->pNotifyChar, notifyHandler);
+    if (!finishPhase(monitor, PHASE_SUBSCRIBE, startTime)) {
+        fail(monitor, PHASE_SUBSCRIBE);
+        return false;
+    }
+    
+    if (!subscribed) {
+        Logger::printf("[%s] ERROR: Failed to subscribe to notifications\n", monitor->config->name);
+        fail(monitor, PHASE_SUBSCRIBE);
+        return false;
+    }
+    
+    DEBUG_TIMESTAMP();
+    DEBUG_PRINTF("[%s] Notification subscription successful!\n", monitor->config->name);
+    return true;
+}
+
+// ============================================================================
+// Phase: Handshake (sequence supplied by the protocol decoder)
+// ============================================================================
+bool ConnectionEngine::runHandshake(BatteryMonitor* monitor) {
+    monitor->state = STATE_HANDSHAKE;
+    
+    DEBUG_TIMESTAMP();
+    DEBUG_PRINTF("[%s] Starting %s handshake sequence (Type: 0x%02X)...\n", 
+        monitor->config->name, monitor->decoder->name, monitor->config->type);
+    
+    unsigned long startTime = clockMillis();
+    
+    uint8_t commands[HANDSHAKE_MAX_COMMANDS][16];
+    uint8_t commandCount = monitor->decoder->buildHandshake(monitor->config, commands);
+    if (commandCount > 0) {
+        clockDelay(100);  // Let the subscription settle before the first write
+    }
+    
+    // Encrypt and send each command, as long as the budget lasts
+    for (int i = 0; i < commandCount; i++) {
+        if (clockMillis() - startTime > PHASE_TIMEOUT_MS[PHASE_HANDSHAKE]) {
+            finishPhase(monitor, PHASE_HANDSHAKE, startTime);
+            Logger::printf("[%s] ERROR: Handshake out of time before write #%d\n", monitor->config->name, i + 1);
+            fail(monitor, PHASE_HANDSHAKE);
+            return false;
+        }
+        
+        uint8_t encrypted[16];
+        BatteryMonitor::Cipher::encrypt(commands[i], encrypted, monitor->config->key);
+        
+        DEBUG_TIMESTAMP();
+        DEBUG_PRINTF("[%s] Write #%d plaintext: ", monitor->config->name, i + 1);
+        for (int j = 0; j < 16; j++) {
+            DEBUG_PRINTF("%02X ", commands[i][j]);
+        }
+        DEBUG_PRINTLN("");
+        
+        DEBUG_TIMESTAMP();
+        DEBUG_PRINTF("[%s] Write #%d encrypted: ", monitor->config->name, i + 1);
+        for (int j = 0; j < 16; j++) {
+            DEBUG_PRINTF("%02X ", encrypted[j]);
+        }
+        DEBUG_PRINTLN("");
+        
+        if (!monitor->pWriteChar || !Transport::write(monitor->pWriteChar, encrypted, 16)) {
+            finishPhase(monitor, PHASE_HANDSHAKE, startTime);
+            Logger::printf("[%s] ERROR: Handshake write #%d failed\n", monitor->config->name, i + 1);
+            fail(monitor, PHASE_HANDSHAKE);
+            return false;
+        }
+        DEBUG_TIMESTAMP();
+        DEBUG_PRINTF("[%s] Write #%d result: OK\n", monitor->config->name, i + 1);
+        clockDelay(50); // Small delay between writes
+    }
+    
+    if (!finishPhase(monitor, PHASE_HANDSHAKE, startTime)) {
+        fail(monitor, PHASE_HANDSHAKE);
+        return false;
+    }
+    
+    DEBUG_TIMESTAMP();
+    Logger::printf("[%s] Handshake complete, waiting for notifications...\n", 
+        monitor->config->name);
+    
+    unsigned long nowTime = clockMillis();
+    monitor->connectRetries = 0;
+    monitor->state = STATE_MONITORING;
+    monitor->stateEnterTime = nowTime;
+    monitor->lastNotificationTime = nowTime;
+    monitor->lastUpdateTime = nowTime;
+    
+    DEBUG_TIMESTAMP();
+    DEBUG_PRINTF("[%s] Set stateEnterTime=%lu, lastNotificationTime=%lu\n",
+        monitor->config->name, monitor->stateEnterTime, monitor->lastNotificationTime);
+    return true;
+}
+
+// ============================================================================
+// Helpers
+// ============================================================================
+bool ConnectionEngine::finishPhase(BatteryMonitor* monitor, ConnectPhase phase, unsigned long startTime) {
+    uint32_t elapsed = clockMillis() - startTime;
+    monitor->connectMetrics.lastPhaseMs[phase] = elapsed;
+    
+    if (elapsed > PHASE_TIMEOUT_MS[phase]) {
+        monitor->connectMetrics.overruns[phase]++;
+        Logger::printf("[%s] ERROR: %s phase took %lums (budget %lums)\n",
+            monitor->config->name, phaseToString(phase),
+            (unsigned long)elapsed, (unsigned long)PHASE_TIMEOUT_MS[phase]);
+        return false;
+    }
+    return true;
+}
+
+void ConnectionEngine::fail(BatteryMonitor* monitor, ConnectPhase phase) {
+    monitor->connectMetrics.failures[phase]++;
+    
+    // Same teardown for every phase, so no path leaves a half-open link behind
+    monitor->cleanup();
+    if (monitor->connectRetries < UINT8_MAX) {
+        monitor->connectRetries++;      // Saturates: backoff stays at the cap, hint prints once
+    }
+    
+    uint32_t delayMs = monitor->scheduleRetry(clockMillis());
+    ConnectionMetrics& m = monitor->connectMetrics;
+    
+    Logger::printf("[%s] Connection failed in %s phase (%d in a row, %lu/%lu ok), retry in %lums\n", 
+        monitor->config->name, phaseToString(phase), monitor->connectRetries,
+        (unsigned long)m.successes, (unsigned long)m.attempts, (unsigned long)delayMs);
+    
+    if (monitor->connectRetries == MAX_CONNECT_RETRIES) {
+        Logger::printf("[HINT] Make sure Battery Guard app is closed on your phone!\n");
+    }
+}
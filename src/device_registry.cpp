@@ -0,0 +1,490 @@
+#include "device_registry.h"
+#include <Preferences.h>
+#include "debug.h"
+
+// Global instance
+DeviceRegistry deviceRegistry;
+
+#define REGISTRY_NAMESPACE "bg-devices"
+#define REGISTRY_VERSION 2             // 2: key bytes stored with each device
+
+// How long other devices are observed after a change
+static const uint32_t DISRUPTION_WINDOW_MS = 15000;
+
+static portMUX_TYPE registryMux = portMUX_INITIALIZER_UNLOCKED;
+
+// NVS layout (blob "table")
+struct StoredDevice {
+    char serial[13];
+    char name[DEVICE_NAME_LEN];
+    char mqttName[DEVICE_NAME_LEN];
+    uint8_t type;
+    uint8_t enabled;
+    uint8_t protocol;
+    uint8_t keyIndex;
+    uint8_t key[16];
+};
+
+struct StoredTable {
+    uint32_t version;
+    uint8_t count;
+    StoredDevice devices[MAX_MONITORS];
+};
+
+// Version 1 had no key bytes, only keyIndex (1 or 2)
+struct StoredDeviceV1 {
+    char serial[13];
+    char name[DEVICE_NAME_LEN];
+    char mqttName[DEVICE_NAME_LEN];
+    uint8_t type;
+    uint8_t enabled;
+    uint8_t protocol;
+    uint8_t keyIndex;
+};
+
+struct StoredTableV1 {
+    uint32_t version;
+    uint8_t count;
+    StoredDeviceV1 devices[MAX_MONITORS];
+};
+
+static const char* OP_NAMES[] = { "add", "modify", "remove", "list", "reset" };
+
+DeviceRegistry::DeviceRegistry() :
+    slotCount(0), commandQueue(NULL), resultPending(false),
+    watchSlot(-1), watchStart(0), watchApplyMs(0), watchMonitoring(0), watchMissed(0) {
+    memset(slots, 0, sizeof(slots));
+    memset(retiredValid, 0, sizeof(retiredValid));
+    for (uint8_t i = 0; i < MAX_MONITORS; i++) {
+        networkDirty[i] = false;
+    }
+    result[0] = '\0';
+}
+
+// ============================================================================
+// Loading & Persistence
+// ============================================================================
+static const uint8_t* builtinKey(uint8_t keyIndex) {
+    return (keyIndex == 2) ? AES_KEY_2 : AES_KEY_1;
+}
+
+static void bindConfig(DeviceSlot& slot, BatteryType type, bool enabled, ProtocolId protocol) {
+    slot.config.serial = slot.serial;
+    slot.config.name = slot.name;
+    slot.config.mqttName = slot.mqttName;
+    slot.config.type = type;
+    slot.config.enabled = enabled;
+    slot.config.key = slot.key;
+    slot.config.protocol = protocol;
+}
+
+// Identity for a runtime-provisioned device (config.h devices use the
+// compile-time DEVICE_IDENTITIES)
+static bool buildIdentity(DeviceSlot& slot) {
+    slot.identity.mac = device_table::parseMac(slot.serial);
+    int stateLen = snprintf(slot.identity.stateTopic.str, DEVICE_TOPIC_LEN, "%s/batteryguard/%s",
+        MQTT_PREFIX, slot.mqttName);
+    int idLen = snprintf(slot.identity.discoveryId.str, DEVICE_TOPIC_LEN, "batteryguard_%s",
+        slot.mqttName);
+    return stateLen < DEVICE_TOPIC_LEN && idLen < DEVICE_TOPIC_LEN;
+}
+
+uint8_t DeviceRegistry::load() {
+    commandQueue = xQueueCreate(4, sizeof(DeviceCommand));
+
+    if (loadFromNvs()) {
+        Serial.printf("[PROV] %d device slot(s) loaded from NVS (config.h DEVICES not used)\n", slotCount);
+    } else {
+        loadFromConfig();
+    }
+    return slotCount;
+}
+
+bool DeviceRegistry::loadFromNvs() {
+    Preferences prefs;
+    if (!prefs.begin(REGISTRY_NAMESPACE, true)) return false;
+
+    StoredTable table;
+    size_t len = prefs.getBytesLength("table");
+    if (len == sizeof(StoredTableV1)) {
+        // Upgrade in memory; written back as version 2 on the next change
+        StoredTableV1 old;
+        prefs.getBytes("table", &old, sizeof(old));
+        memset(&table, 0, sizeof(table));
+        table.version = old.version == 1 ? REGISTRY_VERSION : 0;
+        table.count = old.count;
+        for (uint8_t i = 0; i < MAX_MONITORS; i++) {
+            const StoredDeviceV1& from = old.devices[i];
+            StoredDevice& to = table.devices[i];
+            memcpy(to.serial, from.serial, sizeof(to.serial));
+            memcpy(to.name, from.name, sizeof(to.name));
+            memcpy(to.mqttName, from.mqttName, sizeof(to.mqttName));
+            to.type = from.type;
+            to.enabled = from.enabled;
+            to.protocol = from.protocol;
+            to.keyIndex = (from.keyIndex == 2) ? 2 : 1;
+            memcpy(to.key, builtinKey(to.keyIndex), sizeof(to.key));
+        }
+    } else {
+        len = prefs.getBytes("table", &table, sizeof(table));
+    }
+    prefs.end();
+    if (len != sizeof(table) && len != sizeof(StoredTableV1)) return false;
+    if (table.version != REGISTRY_VERSION || table.count > MAX_MONITORS) {
+        return false;
+    }
+
+    slotCount = table.count;
+    for (uint8_t i = 0; i < slotCount; i++) {
+        const StoredDevice& stored = table.devices[i];
+        DeviceSlot& slot = slots[i];
+        memcpy(slot.serial, stored.serial, sizeof(slot.serial));
+        memcpy(slot.name, stored.name, sizeof(slot.name));
+        memcpy(slot.mqttName, stored.mqttName, sizeof(slot.mqttName));
+        slot.serial[sizeof(slot.serial) - 1] = '\0';
+        slot.name[sizeof(slot.name) - 1] = '\0';
+        slot.mqttName[sizeof(slot.mqttName) - 1] = '\0';
+        slot.keyIndex = stored.keyIndex;
+        memcpy(slot.key, stored.key, sizeof(slot.key));
+        slot.used = stored.serial[0] != '\0';
+        bindConfig(slot, (BatteryType)stored.type, stored.enabled && slot.used,
+            (ProtocolId)(stored.protocol < PROTOCOL_COUNT ? stored.protocol : PROTOCOL_BM6));
+        buildIdentity(slot);
+    }
+    return true;
+}
+
+void DeviceRegistry::loadFromConfig() {
+    slotCount = DEVICE_COUNT;
+    for (uint8_t i = 0; i < slotCount; i++) {
+        const DeviceConfig& device = DEVICES[i];
+        DeviceSlot& slot = slots[i];
+        strncpy(slot.serial, device.serial, sizeof(slot.serial) - 1);
+        strncpy(slot.name, device.name, sizeof(slot.name) - 1);
+        strncpy(slot.mqttName, device.mqttName, sizeof(slot.mqttName) - 1);
+        slot.keyIndex = (device.key == AES_KEY_1) ? 1 : (device.key == AES_KEY_2) ? 2 : 0;
+        memcpy(slot.key, device.key, sizeof(slot.key));
+        slot.used = true;
+        bindConfig(slot, device.type, device.enabled, device.protocol);
+        slot.identity = DEVICE_IDENTITIES.entries[i];
+    }
+}
+
+void DeviceRegistry::save() {
+    StoredTable table;
+    memset(&table, 0, sizeof(table));
+    table.version = REGISTRY_VERSION;
+    table.count = slotCount;
+    for (uint8_t i = 0; i < slotCount; i++) {
+        const DeviceSlot& slot = slots[i];
+        StoredDevice& stored = table.devices[i];
+        if (!slot.used) continue;
+        memcpy(stored.serial, slot.serial, sizeof(stored.serial));
+        memcpy(stored.name, slot.name, sizeof(stored.name));
+        memcpy(stored.mqttName, slot.mqttName, sizeof(stored.mqttName));
+        stored.type = slot.config.type;
+        stored.enabled = slot.config.enabled;
+        stored.protocol = slot.config.protocol;
+        stored.keyIndex = slot.keyIndex;
+        memcpy(stored.key, slot.key, sizeof(stored.key));
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(REGISTRY_NAMESPACE, false)) {
+        Serial.println("[PROV] ERROR: Could not open NVS");
+        return;
+    }
+    prefs.putBytes("table", &table, sizeof(table));
+    prefs.end();
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+bool DeviceRegistry::submit(const DeviceCommand& command) {
+    return commandQueue && xQueueSend(commandQueue, &command, 0) == pdTRUE;
+}
+
+void DeviceRegistry::rejectCommand(const char* error) {
+    setResult("?", false, error);
+}
+
+int8_t DeviceRegistry::findSerial(const char* serial) const {
+    for (uint8_t i = 0; i < slotCount; i++) {
+        if (slots[i].used && strcasecmp(slots[i].serial, serial) == 0) return i;
+    }
+    return -1;
+}
+
+bool DeviceRegistry::mqttNameTaken(const char* mqttName, int8_t except) const {
+    for (uint8_t i = 0; i < slotCount; i++) {
+        if (i != except && slots[i].used && strcmp(slots[i].mqttName, mqttName) == 0) return true;
+    }
+    return false;
+}
+
+// Build the new slot contents from a command (current = slot being modified)
+bool DeviceRegistry::fillSlot(DeviceSlot& slot, const DeviceCommand& command, const DeviceSlot* current, const char** error) {
+    if (current) {
+        slot = *current;
+    } else {
+        memset(&slot, 0, sizeof(slot));
+        strncpy(slot.serial, command.serial, sizeof(slot.serial) - 1);
+        strncpy(slot.name, command.serial, sizeof(slot.name) - 1);
+        slot.config.type = LEAD_ACID;
+        slot.config.enabled = true;
+        slot.config.protocol = PROTOCOL_BM6;
+        slot.keyIndex = 0;
+    }
+    slot.used = true;
+
+    if (command.name[0]) strncpy(slot.name, command.name, sizeof(slot.name) - 1);
+    if (command.mqttName[0]) strncpy(slot.mqttName, command.mqttName, sizeof(slot.mqttName) - 1);
+    BatteryType type = (command.type >= 0) ? (BatteryType)command.type : slot.config.type;
+    bool enabled = (command.enabled >= 0) ? command.enabled != 0 : slot.config.enabled;
+    ProtocolId protocol = (command.protocol >= 0) ? (ProtocolId)command.protocol : slot.config.protocol;
+    // keyIndex 0 on an existing slot is its own config.h key; kept unless
+    // the command names a key
+    if (command.keyIndex >= 0) slot.keyIndex = command.keyIndex;
+    if (slot.keyIndex == 0 && (!current || command.keyIndex == 0)) {
+        slot.keyIndex = (protocol == PROTOCOL_BM2) ? 2 : 1;
+    }
+
+    if (!device_table::isValidSerial(slot.serial)) { *error = "serial must be 12 hex digits"; return false; }
+    if (!device_table::isValidMqttName(slot.mqttName)) { *error = "invalid or missing mqtt name"; return false; }
+    if (type < LEAD_ACID || type > LITHIUM_MANUAL) { *error = "invalid type"; return false; }
+    if (protocol >= PROTOCOL_COUNT) { *error = "invalid protocol"; return false; }
+    if (slot.keyIndex > 2) { *error = "key must be 1 or 2"; return false; }
+
+    if (slot.keyIndex != 0) memcpy(slot.key, builtinKey(slot.keyIndex), sizeof(slot.key));
+    bindConfig(slot, type, enabled, protocol);
+    if (!buildIdentity(slot)) { *error = "mqtt name too long"; return false; }
+    return true;
+}
+
+// Fresh monitor state for a slot, reset in place (its locks may be held by
+// other tasks); the pooled BLE client is kept
+void DeviceRegistry::reinitMonitor(BatteryMonitor& monitor, uint8_t index) {
+    monitor.cleanup();
+    monitor.reset();
+    monitor.init(index, &slots[index].config, &slots[index].identity);
+}
+
+void DeviceRegistry::markNetworkChange(uint8_t index, bool hadIdentity) {
+    portENTER_CRITICAL(&registryMux);
+    retiredValid[index] = hadIdentity;
+    networkDirty[index] = true;
+    portEXIT_CRITICAL(&registryMux);
+}
+
+int8_t DeviceRegistry::applyPending(BatteryMonitor* monitors, uint8_t& count) {
+    DeviceCommand command;
+    if (!commandQueue || xQueueReceive(commandQueue, &command, 0) != pdTRUE) return -1;
+
+    const char* op = OP_NAMES[command.op];
+    const char* error = nullptr;
+    unsigned long start = clockMillis();
+
+    switch (command.op) {
+        case DEVICE_CMD_LIST:
+            listResult();
+            return -1;
+
+        case DEVICE_CMD_RESET: {
+            Preferences prefs;
+            if (prefs.begin(REGISTRY_NAMESPACE, false)) {
+                prefs.clear();
+                prefs.end();
+            }
+            Serial.println("[PROV] NVS device table cleared, config.h is used after the next restart");
+            setResult(op, true, nullptr);
+            return -1;
+        }
+
+        case DEVICE_CMD_ADD: {
+            if (findSerial(command.serial) >= 0) { setResult(op, false, "serial already configured"); return -1; }
+            int8_t index = -1;
+            for (uint8_t i = 0; i < slotCount; i++) {
+                if (!slots[i].used) { index = i; break; }
+            }
+            if (index < 0 && slotCount < MAX_MONITORS) index = slotCount;
+            if (index < 0) { setResult(op, false, "all slots in use"); return -1; }
+
+            DeviceSlot next;
+            if (!fillSlot(next, command, nullptr, &error)) { setResult(op, false, error); return -1; }
+            if (mqttNameTaken(next.mqttName, index)) { setResult(op, false, "mqtt name already used"); return -1; }
+
+            slots[index] = next;
+            bindConfig(slots[index], next.config.type, next.config.enabled, next.config.protocol);
+            reinitMonitor(monitors[index], index);
+            if (index == slotCount) {
+                slotCount++;
+                count = slotCount;
+            }
+            markNetworkChange(index, false);
+            save();
+            startWatch(monitors, count, index, clockMillis() - start);
+            Serial.printf("[PROV] Added %s (%s) in slot %d\n", slots[index].name, slots[index].serial, index);
+            setResult(op, true, nullptr);
+            return index;
+        }
+
+        case DEVICE_CMD_MODIFY: {
+            int8_t index = findSerial(command.serial);
+            if (index < 0) { setResult(op, false, "unknown serial"); return -1; }
+
+            DeviceSlot next;
+            if (!fillSlot(next, command, &slots[index], &error)) { setResult(op, false, error); return -1; }
+            if (mqttNameTaken(next.mqttName, index)) { setResult(op, false, "mqtt name already used"); return -1; }
+
+            const DeviceConfig& old = slots[index].config;
+            bool linkChanged = next.config.type != old.type || next.config.enabled != old.enabled ||
+                next.config.protocol != old.protocol || memcmp(next.key, slots[index].key, sizeof(next.key)) != 0;
+            bool topicChanged = strcmp(next.mqttName, slots[index].mqttName) != 0 ||
+                strcmp(next.name, slots[index].name) != 0;
+
+            if (topicChanged) {
+                portENTER_CRITICAL(&registryMux);
+                retired[index] = slots[index].identity;
+                portEXIT_CRITICAL(&registryMux);
+            }
+            if (linkChanged) {
+                slots[index] = next;
+                bindConfig(slots[index], next.config.type, next.config.enabled, next.config.protocol);
+                reinitMonitor(monitors[index], index);
+            } else {
+                // Names only: update in place, the link stays up
+                memcpy(slots[index].name, next.name, sizeof(next.name));
+                memcpy(slots[index].mqttName, next.mqttName, sizeof(next.mqttName));
+                slots[index].identity = next.identity;
+            }
+            if (topicChanged || linkChanged) {
+                markNetworkChange(index, topicChanged);
+            }
+            save();
+            startWatch(monitors, count, index, clockMillis() - start);
+            Serial.printf("[PROV] Modified %s (%s)%s\n", slots[index].name, slots[index].serial,
+                linkChanged ? ", reconnecting" : "");
+            setResult(op, true, nullptr);
+            return index;
+        }
+
+        case DEVICE_CMD_REMOVE: {
+            int8_t index = findSerial(command.serial);
+            if (index < 0) { setResult(op, false, "unknown serial"); return -1; }
+
+            portENTER_CRITICAL(&registryMux);
+            retired[index] = slots[index].identity;
+            portEXIT_CRITICAL(&registryMux);
+
+            // Slot stays bound to its monitor as a disabled entry
+            slots[index].used = false;
+            slots[index].config.enabled = false;
+            reinitMonitor(monitors[index], index);
+            markNetworkChange(index, true);
+            save();
+            startWatch(monitors, count, index, clockMillis() - start);
+            Serial.printf("[PROV] Removed %s (%s) from slot %d\n", slots[index].name, slots[index].serial, index);
+            setResult(op, true, nullptr);
+            return index;
+        }
+    }
+    return -1;
+}
+
+// ============================================================================
+// Disruption Measurement
+// ============================================================================
+void DeviceRegistry::startWatch(const BatteryMonitor* monitors, uint8_t count, int8_t index, uint32_t applyMs) {
+    watchSlot = index;
+    watchStart = clockMillis();
+    watchApplyMs = applyMs;
+    watchMonitoring = 0;
+    watchMissed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (i == index) continue;
+        if (monitors[i].state == STATE_MONITORING) watchMonitoring++;
+        watchMissed += monitors[i].cadence.missed;
+    }
+}
+
+void DeviceRegistry::checkDisruption(const BatteryMonitor* monitors, uint8_t count) {
+    if (watchSlot < 0) return;
+
+    if (clockMillis() - watchStart < DISRUPTION_WINDOW_MS) return;
+
+    uint8_t monitoring = 0;
+    uint32_t missed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (i == watchSlot) continue;
+        if (monitors[i].state == STATE_MONITORING) monitoring++;
+        missed += monitors[i].cadence.missed;
+    }
+    Serial.printf("[PROV] Change to slot %d: applied in %lums | other devices monitoring %d -> %d, missed frames +%lu in %lus\n",
+        watchSlot, (unsigned long)watchApplyMs, watchMonitoring, monitoring,
+        (unsigned long)(missed - watchMissed), (unsigned long)(DISRUPTION_WINDOW_MS / 1000));
+    watchSlot = -1;
+}
+
+// ============================================================================
+// Results for the Network Task
+// ============================================================================
+void DeviceRegistry::setResult(const char* op, bool ok, const char* error) {
+    portENTER_CRITICAL(&registryMux);
+    if (ok) {
+        snprintf(result, sizeof(result), "{\"op\":\"%s\",\"ok\":true}", op);
+    } else {
+        snprintf(result, sizeof(result), "{\"op\":\"%s\",\"ok\":false,\"error\":\"%s\"}", op, error);
+    }
+    resultPending = true;
+    portEXIT_CRITICAL(&registryMux);
+
+    if (!ok) {
+        Serial.printf("[PROV] %s rejected: %s\n", op, error);
+    }
+}
+
+void DeviceRegistry::listResult() {
+    char buf[sizeof(result)];
+    size_t pos = snprintf(buf, sizeof(buf), "{\"op\":\"list\",\"ok\":true,\"devices\":[");
+    bool first = true;
+    for (uint8_t i = 0; i < slotCount && pos < sizeof(buf); i++) {
+        const DeviceSlot& slot = slots[i];
+        if (!slot.used) continue;
+        pos += snprintf(buf + pos, sizeof(buf) - pos,
+            "%s{\"slot\":%d,\"serial\":\"%s\",\"name\":\"%s\",\"mqtt\":\"%s\",\"type\":%d,\"protocol\":\"%s\",\"key\":%d,\"enabled\":%s}",
+            first ? "" : ",", i, slot.serial, slot.name, slot.mqttName, slot.config.type,
+            decoderFor(slot.config.protocol)->name, slot.keyIndex, slot.config.enabled ? "true" : "false");
+        first = false;
+    }
+    if (pos < sizeof(buf)) {
+        snprintf(buf + pos, sizeof(buf) - pos, "]}");
+    }
+
+    portENTER_CRITICAL(&registryMux);
+    memcpy(result, buf, sizeof(result));
+    result[sizeof(result) - 1] = '\0';
+    resultPending = true;
+    portEXIT_CRITICAL(&registryMux);
+}
+
+bool DeviceRegistry::takeResult(char* buf, size_t len) {
+    if (!resultPending) return false;
+    portENTER_CRITICAL(&registryMux);
+    strncpy(buf, result, len - 1);
+    buf[len - 1] = '\0';
+    resultPending = false;
+    portEXIT_CRITICAL(&registryMux);
+    return true;
+}
+
+bool DeviceRegistry::takeNetworkChange(uint8_t index, DeviceIdentity& old, bool& hadOld) {
+    if (!networkDirty[index]) return false;
+    portENTER_CRITICAL(&registryMux);
+    hadOld = retiredValid[index];
+    if (hadOld) old = retired[index];
+    retiredValid[index] = false;
+    networkDirty[index] = false;
+    portEXIT_CRITICAL(&registryMux);
+    return true;
+}
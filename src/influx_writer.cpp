@@ -0,0 +1,353 @@
+#ifdef INFLUX_ENABLED
+
+#include "influx_writer.h"
+#include "task_topology.h"
+#include "coex_scheduler.h"
+#include "clock_source.h"
+#include "wifi_link.h"
+
+static_assert(INFLUX_BATCHES >= 3, "INFLUX_BATCHES: one filling, one sending, at least one backlog");
+static_assert(INFLUX_BATCH_BYTES >= INFLUX_LINE_MAX && INFLUX_BATCH_BYTES <= 65535, "INFLUX_BATCH_BYTES out of range");
+
+#ifdef INFLUX_TOKEN
+  #define INFLUX_AUTH_HEADER "Authorization: Token " INFLUX_TOKEN "\r\n"
+#else
+  #define INFLUX_AUTH_HEADER ""
+#endif
+
+// Global instance
+InfluxWriter influxWriter;
+
+InfluxWriter::InfluxWriter() :
+    filling(-1),
+    nextSequence(0),
+    task(nullptr),
+    retryAtMs(0),
+    backoffMs(INFLUX_RETRY_MIN_MS) {
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    lock = unlocked;
+    for (uint8_t i = 0; i < INFLUX_BATCHES; i++) {
+        batches[i].state = BATCH_FREE;
+        batches[i].length = 0;
+        batches[i].lines = 0;
+    }
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool InfluxWriter::begin() {
+    Serial.printf("[INFLUX] Writing to %s:%d (batch %luB / %lums, %lu buffers)\n",
+        INFLUX_HOST, INFLUX_PORT, (unsigned long)INFLUX_BATCH_BYTES,
+        (unsigned long)INFLUX_FLUSH_MS, (unsigned long)INFLUX_BATCHES);
+    return startTask(TASK_INFLUX, taskEntry, this, &task);
+}
+
+// ============================================================================
+// Batching (sample task)
+// ============================================================================
+
+// Tag values: escape ',', '=' and ' '
+static size_t appendTag(char* buf, size_t len, const char* value) {
+    size_t n = 0;
+    for (const char* p = value; *p && n + 2 < len; p++) {
+        if (*p == ',' || *p == '=' || *p == ' ') buf[n++] = '\\';
+        buf[n++] = *p;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+bool InfluxWriter::add(const SampleRecord& record) {
+    int64_t epochMs = record.epochMs ? record.epochMs : clockEpochMs(record.arrivalUs);
+    if (epochMs == 0 || !record.monitor->config) {
+        return false;           // No wall clock yet
+    }
+
+    char line[INFLUX_LINE_MAX];
+    size_t n = snprintf(line, sizeof(line), "%s,device=", INFLUX_MEASUREMENT);
+    n += appendTag(line + n, sizeof(line) - n, record.monitor->config->mqttName);
+    n += snprintf(line + n, sizeof(line) - n, ",serial=%s voltage=%.2f,soc=%ui,temperature=%di,"
+        "status=%ui,vrise=%ui,vdrop=%ui %lld\n",
+        record.monitor->config->serial, record.voltage, record.soc, record.temperature,
+        record.status, record.rapidVoltageRise, record.rapidVoltageDrop, (long long)epochMs);
+    if (n >= sizeof(line)) return false;
+
+    bool sealed = false;
+    portENTER_CRITICAL(&lock);
+    if (filling >= 0 && batches[filling].length + n > INFLUX_BATCH_BYTES) {
+        seal(filling);
+        sealed = true;
+    }
+    if (filling < 0) {
+        filling = claim();
+    }
+    Batch& batch = batches[filling];
+    if (batch.length == 0) batch.openedMs = clockMillis();
+    memcpy(batch.data + batch.length, line, n);
+    batch.length += n;
+    batch.lines++;
+    stats.lines++;
+    portEXIT_CRITICAL(&lock);
+
+    if (sealed && task) xTaskNotifyGive(task);
+    return true;
+}
+
+// Under lock
+void InfluxWriter::seal(int8_t index) {
+    batches[index].state = BATCH_SEALED;
+    batches[index].sequence = nextSequence++;
+    if (index == filling) filling = -1;
+}
+
+// Under lock: a free buffer, or the oldest unsent batch if the backlog is full
+int8_t InfluxWriter::claim() {
+    int8_t oldest = -1;
+    for (int8_t i = 0; i < INFLUX_BATCHES; i++) {
+        if (batches[i].state == BATCH_FREE) {
+            oldest = i;
+            break;
+        }
+        if (batches[i].state == BATCH_SEALED &&
+            (oldest < 0 || (int32_t)(batches[i].sequence - batches[oldest].sequence) < 0)) {
+            oldest = i;
+        }
+    }
+    Batch& batch = batches[oldest];
+    if (batch.state == BATCH_SEALED) {
+        stats.linesDropped += batch.lines;
+    }
+    batch.state = BATCH_FILLING;
+    batch.length = 0;
+    batch.lines = 0;
+    return oldest;
+}
+
+// Seal the filling batch once it is due, then take the oldest sealed one
+int8_t InfluxWriter::takeNext(unsigned long now) {
+    int8_t next = -1;
+    portENTER_CRITICAL(&lock);
+    if (filling >= 0 && batches[filling].length > 0 &&
+        now - batches[filling].openedMs >= INFLUX_FLUSH_MS) {
+        seal(filling);
+    }
+    for (int8_t i = 0; i < INFLUX_BATCHES; i++) {
+        if (batches[i].state == BATCH_SEALED &&
+            (next < 0 || (int32_t)(batches[i].sequence - batches[next].sequence) < 0)) {
+            next = i;
+        }
+    }
+    if (next >= 0) batches[next].state = BATCH_SENDING;
+    portEXIT_CRITICAL(&lock);
+    return next;
+}
+
+uint8_t InfluxWriter::backlog() {
+    uint8_t count = 0;
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < INFLUX_BATCHES; i++) {
+        if (batches[i].state == BATCH_SEALED || batches[i].state == BATCH_SENDING) count++;
+    }
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
+
+// ============================================================================
+// Writer Task
+// ============================================================================
+
+void InfluxWriter::taskEntry(void* param) {
+    ((InfluxWriter*)param)->run();
+}
+
+void InfluxWriter::run() {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INFLUX_POLL_MS));
+        unsigned long now = clockMillis();
+        if (!wifiLinkUp()) continue;
+        if (retryAtMs != 0 && (long)(now - retryAtMs) < 0) continue;
+
+        int8_t index = takeNext(now);
+        if (index < 0) continue;
+        if (!coexScheduler.allowBulkWork()) {
+            portENTER_CRITICAL(&lock);
+            batches[index].state = BATCH_SEALED;
+            portEXIT_CRITICAL(&lock);
+            continue;
+        }
+
+        for (; index >= 0; index = takeNext(clockMillis())) {
+            Batch& batch = batches[index];
+            int status = post(batch);
+            coexScheduler.noteNetworkActivity();
+
+            bool retry = status < 0 || status == 429 || status >= 500;
+            if (retry) {
+                stats.failures++;
+                retryAtMs = clockMillis() + backoffMs;
+                Serial.printf("[INFLUX] Write failed (%d), %d batch(es) queued, retry in %lums\n",
+                    status, backlog(), (unsigned long)backoffMs);
+                backoffMs = backoffMs * 2 > INFLUX_RETRY_MAX_MS ? INFLUX_RETRY_MAX_MS : backoffMs * 2;
+            } else if (status >= 300) {
+                // Bad data or auth: retrying the same body will not help
+                Serial.printf("[INFLUX] Batch rejected (%d), %u lines dropped\n", status, batch.lines);
+                stats.linesDropped += batch.lines;
+            } else {
+                stats.linesWritten += batch.lines;
+                retryAtMs = 0;
+                backoffMs = INFLUX_RETRY_MIN_MS;
+            }
+
+            portENTER_CRITICAL(&lock);
+            batch.state = retry ? BATCH_SEALED : BATCH_FREE;
+            portEXIT_CRITICAL(&lock);
+            if (retry) break;
+        }
+    }
+}
+
+// One POST; a keep-alive connection the server closed while idle gets one
+// immediate retry on a fresh connection. Returns the HTTP status, -1 on
+// network errors.
+int InfluxWriter::post(const Batch& batch) {
+    bool reused = client.connected();
+    unsigned long start = clockMillis();
+    int status = request(batch);
+    if (status < 0 && reused) {
+        status = request(batch);
+    }
+    if (status >= 0) {
+        stats.posts++;
+        stats.lastPostMs = clockMillis() - start;
+        if (stats.lastPostMs > stats.maxPostMs) stats.maxPostMs = stats.lastPostMs;
+    }
+    return status;
+}
+
+int InfluxWriter::request(const Batch& batch) {
+    if (!client.connected()) {
+        client.stop();
+        if (!client.connect(INFLUX_HOST, INFLUX_PORT)) {
+            return -1;
+        }
+        stats.connects++;
+    }
+
+    char header[320];
+    int n = snprintf(header, sizeof(header),
+        "POST %s HTTP/1.1\r\n"
+        "Host: %s:%d\r\n"
+        INFLUX_AUTH_HEADER
+        "Content-Type: text/plain; charset=utf-8\r\n"
+        "Content-Length: %u\r\n"
+        "Connection: keep-alive\r\n\r\n",
+        INFLUX_PATH, INFLUX_HOST, INFLUX_PORT, batch.length);
+    if (n <= 0 || n >= (int)sizeof(header) ||
+        client.write((const uint8_t*)header, n) != (size_t)n ||
+        client.write((const uint8_t*)batch.data, batch.length) != batch.length) {
+        client.stop();
+        return -1;
+    }
+    stats.bytes += batch.length;
+
+    // Status line and headers
+    unsigned long deadline = clockMillis() + INFLUX_HTTP_TIMEOUT_MS;
+    char line[128];
+    if (!readLine(line, sizeof(line), deadline) || strncmp(line, "HTTP/1.", 7) != 0) {
+        client.stop();
+        return -1;
+    }
+    const char* code = strchr(line, ' ');
+    int status = code ? atoi(code + 1) : 0;
+
+    long contentLength = -1;
+    bool keepAlive = true;
+    while (true) {
+        if (!readLine(line, sizeof(line), deadline)) {
+            client.stop();
+            return -1;
+        }
+        if (line[0] == '\0') break;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            contentLength = atol(line + 15);
+        } else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line + 11, "close")) {
+            keepAlive = false;
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            keepAlive = false;  // Chunked error bodies are not parsed, reconnect instead
+        }
+    }
+
+    // Drain the body (error details) so the connection can be reused
+    if (contentLength > 0) {
+        #ifdef DEBUG_MODE
+        Serial.print("[INFLUX] Response: ");
+        #endif
+        while (contentLength > 0 && (long)(clockMillis() - deadline) < 0) {
+            if (client.available() > 0) {
+                int c = client.read();
+                #ifdef DEBUG_MODE
+                if (c >= 0) Serial.write((uint8_t)c);
+                #endif
+                contentLength--;
+            } else {
+                clockDelay(1);
+            }
+        }
+        #ifdef DEBUG_MODE
+        Serial.println();
+        #endif
+        if (contentLength > 0) keepAlive = false;
+    } else if (contentLength < 0 && status != 204) {
+        keepAlive = false;
+    }
+    if (!keepAlive) client.stop();
+    return status;
+}
+
+// One header line without CR/LF; false on timeout or a closed connection
+bool InfluxWriter::readLine(char* buf, size_t len, unsigned long deadline) {
+    size_t n = 0;
+    while ((long)(clockMillis() - deadline) < 0) {
+        if (client.available() <= 0) {
+            if (!client.connected()) return false;
+            clockDelay(1);
+            continue;
+        }
+        int c = client.read();
+        if (c < 0 || c == '\r') continue;
+        if (c == '\n') {
+            buf[n] = '\0';
+            return true;
+        }
+        if (n + 1 < len) buf[n++] = (char)c;
+    }
+    return false;
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+void InfluxWriter::printStats() {
+    Serial.printf("[TELEMETRY]   influx lines=%lu written=%lu dropped=%lu posts=%lu failures=%lu "
+        "connects=%lu backlog=%u post=%lums (max %lums)\n",
+        (unsigned long)stats.lines, (unsigned long)stats.linesWritten,
+        (unsigned long)stats.linesDropped, (unsigned long)stats.posts,
+        (unsigned long)stats.failures, (unsigned long)stats.connects, backlog(),
+        (unsigned long)stats.lastPostMs, (unsigned long)stats.maxPostMs);
+}
+
+// "influx":{...}; returns the number of characters written
+size_t InfluxWriter::formatStats(char* buf, size_t len) {
+    if (len == 0) return 0;
+    size_t pos = snprintf(buf, len,
+        "\"influx\":{\"lines\":%lu,\"written\":%lu,\"drop\":%lu,\"posts\":%lu,\"failures\":%lu,"
+        "\"connects\":%lu,\"bytes\":%lu,\"backlog\":%u,\"post_ms\":%lu,\"post_max_ms\":%lu}",
+        (unsigned long)stats.lines, (unsigned long)stats.linesWritten,
+        (unsigned long)stats.linesDropped, (unsigned long)stats.posts,
+        (unsigned long)stats.failures, (unsigned long)stats.connects,
+        (unsigned long)stats.bytes, backlog(),
+        (unsigned long)stats.lastPostMs, (unsigned long)stats.maxPostMs);
+    return pos < len ? pos : len;
+}
+
+#endif // INFLUX_ENABLED
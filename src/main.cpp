@@ -13,10 +13,18 @@
 
 #include <Arduino.h>
 #include <NimBLEDevice.h>
-#include <mbedtls/aes.h>
-#include "config.h"
+#include "config_defaults.h"
 #include "types.h"
+#include "debug.h"
 #include "battery_monitor.h"
+#include "connection_engine.h"
+#include "warm_restart.h"
+#include "coex_scheduler.h"
+#include "telemetry.h"
+#include "task_topology.h"
+#include "sample_bus.h"
+#include "device_registry.h"
+#include "alert_engine.h"
 
 #ifdef LCD_ENABLED
   #include "tft_display.h"
@@ -26,41 +34,16 @@
   #include "mqtt_client.h"
 #endif
 
-// Debug mode controlled by platformio.ini build flags
-#ifndef DEBUG_MODE
-  #define DEBUG_MODE 0
+#ifdef INFLUX_ENABLED
+  #include "wifi_link.h"
+  #include "influx_writer.h"
 #endif
 
-#if DEBUG_MODE
-  #define DEBUG_PRINT(x) Serial.print(x)
-  #define DEBUG_PRINTF(...) Serial.printf(__VA_ARGS__)
-  #define DEBUG_PRINTLN(x) Serial.println(x)
-  #define DEBUG_TIMESTAMP() Serial.printf("[%6.2fs] ", millis()/1000.0)
-#else
-  #define DEBUG_PRINT(x)
-  #define DEBUG_PRINTF(...)
-  #define DEBUG_PRINTLN(x)
-  #define DEBUG_TIMESTAMP()
+#ifdef UDP_ENABLED
+  #include "wifi_link.h"
+  #include "udp_streamer.h"
 #endif
 
-// ============================================================================
-// AES Initialization Vector (Zero IV)
-// ============================================================================
-const uint8_t AES_IV[16] = {
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
-
-// ============================================================================
-// BLE UUIDs
-// ============================================================================
-static const NimBLEUUID SERVICE_UUID("0000fff0-0000-1000-8000-00805f9b34fb");
-static const NimBLEUUID CHAR_WRITE_UUID("0000fff3-0000-1000-8000-00805f9b34fb");   // Handshake
-static const NimBLEUUID CHAR_NOTIFY_UUID("0000fff4-0000-1000-8000-00805f9b34fb");  // Data
-
-// ============================================================================
-// Device State Machine
-// ============================================================================
 // ============================================================================
 // Global Variables
 // ============================================================================
@@ -68,6 +51,18 @@ BatteryMonitor monitors[4];
 uint8_t activeMonitorCount = 0;
 NimBLEScan* pBLEScan;
 bool scanningActive = false;
+unsigned long firstSampleMs = 0;  // Uptime of first valid sample (boot metric)
+uint8_t warmRestoredCount = 0;    // Devices restored from RTC memory at boot
+
+// Raw notifications handed from the NimBLE host task to SampleTask
+struct RawFrame {
+    uint8_t monitorIndex;
+    uint8_t generation;             // Monitor generation at arrival (see reset())
+    uint8_t data[16];
+    int64_t arrivalUs;              // esp_timer time of arrival
+};
+static QueueHandle_t sampleQueue = NULL;
+static volatile uint32_t sampleQueueDrops = 0;
 
 #ifdef LCD_ENABLED
   // Display data for each monitor (shared with display task)
@@ -75,117 +70,24 @@ bool scanningActive = false;
 #endif
 
 // ============================================================================
-// AES Encryption/Decryption
-// ============================================================================
-void aes_encrypt(const uint8_t* input, uint8_t* output, const uint8_t* key) {
-    uint8_t iv_copy[16];
-    memcpy(iv_copy, AES_IV, 16);  // Make a copy since CBC modifies IV
-    
-    mbedtls_aes_context aes;
-    mbedtls_aes_init(&aes);
-    mbedtls_aes_setkey_enc(&aes, key, 128);
-    mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_ENCRYPT, 16, iv_copy, input, output);
-    mbedtls_aes_free(&aes);
-}
-
-void aes_decrypt(const uint8_t* input, uint8_t* output, const uint8_t* key) {
-    uint8_t iv_copy[16];
-    memcpy(iv_copy, AES_IV, 16);  // Make a copy since CBC modifies IV
-    
-    mbedtls_aes_context aes;
-    mbedtls_aes_init(&aes);
-    mbedtls_aes_setkey_dec(&aes, key, 128);
-    mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_DECRYPT, 16, iv_copy, input, output);
-    mbedtls_aes_free(&aes);
-}
-
-// ============================================================================
-// Handshake Commands (Standard Mode - 6 Writes)
-// ============================================================================
-void sendHandshake(BatteryMonitor* monitor) {
-    if (!monitor->pWriteChar) {
-        Serial.printf("[%s] ERROR: Write characteristic not available\n", monitor->config->name);
-        return;
-    }
-    
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Starting handshake sequence (Type: 0x%02X)...\n", 
-        monitor->config->name, monitor->config->type);
-    
-    // Define 6 handshake commands
-    uint8_t commands[6][16] = {
-        // Write #1: Session Init
-        {0xD1, 0x55, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        // Write #2: Battery Type
-        {0xD1, 0x55, 0x08, monitor->config->type, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        // Write #3: Config 0x1E
-        {0xD1, 0x55, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        // Write #4: Config 0xCA94
-        {0xD1, 0x55, 0x05, 0x00, 0x00, 0x00, 0x00, 0xCA, 0x94, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        // Write #5: Pre-finalization
-        {0xD1, 0x55, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        // Write #6: Finalization
-        {0xD1, 0x55, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
-    };
-    
-    // Encrypt and send each command
-    for (int i = 0; i < 6; i++) {
-        uint8_t encrypted[16];
-        aes_encrypt(commands[i], encrypted, monitor->config->key);
-        
-        DEBUG_TIMESTAMP();
-        DEBUG_PRINTF("[%s] Write #%d plaintext: ", monitor->config->name, i + 1);
-        for (int j = 0; j < 16; j++) {
-            DEBUG_PRINTF("%02X ", commands[i][j]);
-        }
-        DEBUG_PRINTLN("");
-        
-        DEBUG_TIMESTAMP();
-        DEBUG_PRINTF("[%s] Write #%d encrypted: ", monitor->config->name, i + 1);
-        for (int j = 0; j < 16; j++) {
-            DEBUG_PRINTF("%02X ", encrypted[j]);
-        }
-        DEBUG_PRINTLN("");
-        
-        bool writeSuccess = monitor->pWriteChar->writeValue(encrypted, 16, false);
-        DEBUG_TIMESTAMP();
-        DEBUG_PRINTF("[%s] Write #%d result: %s\n", monitor->config->name, i + 1, writeSuccess ? "OK" : "FAILED");
-        delay(50); // Small delay between writes
-    }
-    
-    DEBUG_TIMESTAMP();
-    Serial.printf("[%s] Handshake complete, waiting for notifications...\n", 
-        monitor->config->name);
-    
-    unsigned long nowTime = millis();
-    monitor->state = STATE_MONITORING;
-    monitor->stateEnterTime = nowTime;
-    monitor->lastNotificationTime = nowTime;
-    monitor->lastUpdateTime = nowTime;
-    
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Set stateEnterTime=%lu, lastNotificationTime=%lu\n",
-        monitor->config->name, monitor->stateEnterTime, monitor->lastNotificationTime);
-}
-
-// ============================================================================
-// Notification Callback
+// Notification Callback (NimBLE host task - keep short)
 // ============================================================================
 void notifyCallback(NimBLERemoteCharacteristic* pChar, uint8_t* pData, size_t length, bool isNotify) {
     // Find which monitor this notification belongs to
-    BatteryMonitor* monitor = nullptr;
+    int monitorIndex = -1;
     for (int i = 0; i < activeMonitorCount; i++) {
         if (monitors[i].pNotifyChar == pChar) {
-            monitor = &monitors[i];
+            monitorIndex = i;
             break;
         }
     }
     
-    if (!monitor) {
+    if (monitorIndex < 0) {
         DEBUG_TIMESTAMP();
         DEBUG_PRINTLN("Notification from unknown monitor");
         return;
     }
+    BatteryMonitor* monitor = &monitors[monitorIndex];
     
     if (length != 16) {
         DEBUG_TIMESTAMP();
@@ -193,16 +95,35 @@ void notifyCallback(NimBLERemoteCharacteristic* pChar, uint8_t* pData, size_t le
         return;
     }
     
+    // Arrival is recorded here so liveness doesn't depend on SampleTask
+    RawFrame frame;
+    frame.monitorIndex = monitorIndex;
+    frame.generation = monitor->generation;
+    frame.arrivalUs = clockMicros();
+    memcpy(frame.data, pData, 16);
+    monitor->recordFrameArrival(clockMillis(), coexScheduler.lastNetworkActivity());
+    
+    if (xQueueSend(sampleQueue, &frame, 0) != pdTRUE) {
+        sampleQueueDrops++;
+    }
+}
+
+// ============================================================================
+// Sample Processing (SampleTask)
+// ============================================================================
+void processFrame(BatteryMonitor* monitor, int monitorIndex, const RawFrame& frame) {
+    const uint8_t* pData = frame.data;
+    
     DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Notification received (%d bytes) - RAW: ", monitor->config->name, length);
-    for (int i = 0; i < length; i++) {
+    DEBUG_PRINTF("[%s] Notification received (16 bytes) - RAW: ", monitor->config->name);
+    for (int i = 0; i < 16; i++) {
         DEBUG_PRINTF("%02X ", pData[i]);
     }
     DEBUG_PRINTLN("");
     
     // Decrypt notification
     uint8_t decrypted[16];
-    aes_decrypt(pData, decrypted, monitor->config->key);
+    BatteryMonitor::Cipher::decrypt(pData, decrypted, monitor->config->key);
     
     DEBUG_TIMESTAMP();
     DEBUG_PRINTF("[%s] Decrypted: ", monitor->config->name);
@@ -211,78 +132,130 @@ void notifyCallback(NimBLERemoteCharacteristic* pChar, uint8_t* pData, size_t le
     }
     DEBUG_PRINTLN("");
     
-    // Skip first 5 notifications (contain invalid data like 61°C)
-    monitor->notifyCount++;
-    if (monitor->notifyCount <= 5) {
+    // Skip the protocol's warm-up notifications (BM6: first 5 contain
+    // invalid data like 61°C). Counting stops after warm-up so it can't wrap.
+    const ProtocolDecoder* decoder = monitor->decoder;
+    if (monitor->notifyCount < decoder->warmupFrames) {
+        monitor->notifyCount++;
         DEBUG_TIMESTAMP();
-        DEBUG_PRINTF("[%s] Skipping notification #%d (first 5 contain invalid data)\n", 
-            monitor->config->name, monitor->notifyCount);
-        monitor->lastNotificationTime = millis();  // Update to prevent timeout
+        DEBUG_PRINTF("[%s] Skipping notification #%d (first %d contain invalid data)\n", 
+            monitor->config->name, monitor->notifyCount, decoder->warmupFrames);
         return;
     }
     
-    // Verify header
-    if (decrypted[0] != 0xD1 || decrypted[1] != 0x55) {
+    DecodedSample sample;
+    if (!decoder->parse(decrypted, sample)) {
         DEBUG_TIMESTAMP();
-        DEBUG_PRINTF("[%s] Invalid header: %02X %02X\n", monitor->config->name, decrypted[0], decrypted[1]);
+        DEBUG_PRINTF("[%s] Invalid %s header: %02X %02X\n", monitor->config->name, decoder->name,
+            decrypted[0], decrypted[1]);
         return;
     }
     
-    // Parse data (based on Android app analysis)
-    // Byte 3: Temperature sign (1 = negative)
-    // Byte 4: Temperature value
-    if (decrypted[3] == 1) {
-        monitor->temperature = -(int8_t)decrypted[4];
-    } else {
-        monitor->temperature = (int8_t)decrypted[4];
+    int64_t epochMs = clockEpochMs(frame.arrivalUs);
+    portENTER_CRITICAL(&monitor->sampleLock);
+    monitor->temperature = sample.temperature;
+    monitor->status = sample.status;
+    monitor->soc = sample.soc;
+    monitor->voltage = sample.voltage;
+    monitor->rapidVoltageRise = sample.rapidVoltageRise;
+    monitor->rapidVoltageDrop = sample.rapidVoltageDrop;
+    monitor->lastUpdateTime = clockMillis();
+    monitor->sampleArrivalUs = frame.arrivalUs;
+    monitor->sampleEpochMs = epochMs;
+    monitor->restoredSample = false;
+    portEXIT_CRITICAL(&monitor->sampleLock);
+    monitor->stats.add(monitor->lastUpdateTime, monitor->voltage, monitor->temperature);
+    
+    monitor->trend.update(monitor->lastUpdateTime, monitor->soc, monitor->status == STATUS_CHARGING);
+    
+    HealthEvent healthEvent = monitor->health.update(monitor->lastUpdateTime, monitor->voltage,
+        monitor->status, monitor->rapidVoltageDrop);
+    if (healthEvent == HEALTH_REST) {
+        Serial.printf("[%s] Resting at %.2fV -> OCV SOC %d%% (device %d%%), SoH %d\n",
+            monitor->config->name, monitor->health.restVoltage(), monitor->health.ocvSoc(),
+            monitor->soc, monitor->health.stateOfHealth());
+    } else if (healthEvent == HEALTH_CRANK) {
+        Serial.printf("[%s] Crank: sag %.2fV (min %.2fV), SoH %d\n",
+            monitor->config->name, monitor->health.crankSag(), monitor->health.crankMinVoltage(),
+            monitor->health.stateOfHealth());
     }
     
-    monitor->status = decrypted[5];
-    monitor->soc = decrypted[6];
-    monitor->voltage = ((decrypted[7] << 8) | decrypted[8]) / 100.0f;
-    monitor->rapidVoltageRise = (decrypted[9] << 8) | decrypted[10];
-    monitor->rapidVoltageDrop = (decrypted[11] << 8) | decrypted[12];
-    monitor->lastUpdateTime = millis();
-    monitor->lastNotificationTime = millis();
-    
-    // ALWAYS log parsed bytes for debugging status issues
-    Serial.printf("[PARSE] %s: Byte[4]=Temp:%d°C | Byte[5]=Status:0x%02X(%s) | Byte[6]=SOC:%d%% | Byte[7-8]=V:%.2f | Byte[9-10]=VRise:%d | Byte[11-12]=VDrop:%d\n",
-        monitor->config->name,
-        monitor->temperature, 
-        decrypted[5], getBatteryStatusText(monitor->status),
-        monitor->soc,
-        monitor->voltage,
-        monitor->rapidVoltageRise,
-        monitor->rapidVoltageDrop);
-    
-    // Summary log output
-    Serial.printf("%s (%s): %.2fV | %d%% | %d°C | %s | VRise:%d | VDrop:%d\n",
-        monitor->config->name, monitor->config->serial,
-        monitor->voltage, monitor->soc, monitor->temperature, getBatteryStatusText(monitor->status),
-        monitor->rapidVoltageRise, monitor->rapidVoltageDrop);
-    
-    // Update display data
-    #ifdef LCD_ENABLED
-        int monitorIndex = -1;
+    // Edge alert rules see the updated health/trend state
+    alertEngine.evaluate(monitor, monitorIndex, monitor->lastUpdateTime);
+    
+    telemetry.recordLatency(LATENCY_PARSE, (uint32_t)(clockMicros() - frame.arrivalUs));
+    
+    if (firstSampleMs == 0) {
+        firstSampleMs = clockMillis();
+        Serial.printf("[BOOT] Time to first sample: %lums\n", firstSampleMs);
+    }
+    
+    // Fan the reading out to the compiled-in sinks
+    SampleRecord record;
+    record.monitor = monitor;
+    record.monitorIndex = monitorIndex;
+    record.voltage = monitor->voltage;
+    record.soc = monitor->soc;
+    record.temperature = monitor->temperature;
+    record.status = monitor->status;
+    record.rapidVoltageRise = monitor->rapidVoltageRise;
+    record.rapidVoltageDrop = monitor->rapidVoltageDrop;
+    record.arrivalUs = frame.arrivalUs;
+    record.epochMs = monitor->sampleEpochMs;
+    SampleBus::publish(record);
+}
+
+void sampleTask(void* parameter) {
+    RawFrame frame;
+    while (true) {
+        if (xQueueReceive(sampleQueue, &frame, portMAX_DELAY) == pdTRUE) {
+            BatteryMonitor* monitor = &monitors[frame.monitorIndex];
+            if (frame.generation != monitor->generation) continue;  // Slot re-provisioned since
+            processFrame(monitor, frame.monitorIndex, frame);
+        }
+    }
+}
+
+// ============================================================================
+// Network Task (MQTT connection, publishing, telemetry upload)
+// ============================================================================
+#ifdef MQTT_ENABLED
+// Worst case with every counter at its maximum, 24 tasks and MQTT+TLS+
+// InfluxDB+UDP is ~2.7 KB; formatJson refuses (returns 0) rather than truncate
+static char telemetryJson[3072];
+static volatile bool telemetryPending = false;
+
+void networkTask(void* parameter) {
+    while (true) {
+        mqttClient.loop();
+        
         for (int i = 0; i < activeMonitorCount; i++) {
-            if (&monitors[i] == monitor) {
-                monitorIndex = i;
-                break;
-            }
+            mqttClient.publishAvailability(&monitors[i]);
+            mqttClient.publishBatteryData(&monitors[i]);
         }
         
-        if (monitorIndex >= 0 && monitorIndex < MAX_MONITORS) {
-            g_displayData[monitorIndex].active = true;
-            g_displayData[monitorIndex].connected = (monitor->state == STATE_MONITORING);
-            strncpy(g_displayData[monitorIndex].name, monitor->config->name, sizeof(g_displayData[monitorIndex].name) - 1);
-            g_displayData[monitorIndex].voltage = monitor->voltage;
-            g_displayData[monitorIndex].soc = monitor->soc;
-            g_displayData[monitorIndex].temperature = monitor->temperature;
-            g_displayData[monitorIndex].status = monitor->status;
-            g_displayData[monitorIndex].lastUpdate = millis();
+        if (telemetryPending) {
+            mqttClient.publishTelemetry(telemetryJson);
+            telemetryPending = false;
         }
-    #endif
+        
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
 }
+#endif
+
+// ============================================================================
+// Storage Task (warm restart snapshot)
+// ============================================================================
+void storageTask(void* parameter) {
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(WARM_SNAPSHOT_INTERVAL_MS));
+        warmRestartSave(monitors, activeMonitorCount);
+    }
+}
+
+// Single connect/discover/subscribe/handshake implementation
+ConnectionEngine connectionEngine(notifyCallback);
 
 // ============================================================================
 // Client Callbacks
@@ -302,153 +275,29 @@ public:
         DEBUG_PRINTF("[%s] CALLBACK: onDisconnect fired (reason: %d)\n", 
             monitor->config->name, pClient->getLastError());
         Serial.printf("[%s] Disconnected\n", monitor->config->name);
-        monitor->state = STATE_DISCONNECTED;
+        // Keep cooldown if the engine gave up on this attempt
+        if (monitor->state != STATE_COOLDOWN) {
+            monitor->state = STATE_DISCONNECTED;
+        }
         monitor->pWriteChar = nullptr;
         monitor->pNotifyChar = nullptr;
     }
 };
 
-// ============================================================================
-// Connection Management
-// ============================================================================
-bool connectToDevice(BatteryMonitor* monitor, NimBLEAdvertisedDevice* device) {
-    if (monitor->state == STATE_COOLDOWN) return false;
-    
-    monitor->state = STATE_CONNECTING;
-    Serial.printf("[%s] Connecting to %s...\n", 
-        monitor->config->name, monitor->getMacAddress().c_str());
-    
-    // Stop scanning before connecting - critical for ESP32
-    if (NimBLEDevice::getScan()->isScanning()) {
-        DEBUG_TIMESTAMP();
-        DEBUG_PRINTLN("Stopping scan before connection attempt");
-        NimBLEDevice::getScan()->stop();
-        delay(100); // Give time for scan to fully stop
-    }
-    
-    // Create client if needed
-    if (!monitor->pClient) {
-        DEBUG_TIMESTAMP();
-        DEBUG_PRINTF("[%s] Creating new BLE client\n", monitor->config->name);
-        monitor->pClient = NimBLEDevice::createClient();
-        monitor->pClient->setClientCallbacks(new ClientCallbacks(monitor), false);
-        DEBUG_TIMESTAMP();
-        DEBUG_PRINTF("[%s] Client created, callbacks set\n", monitor->config->name);
-    }
-    
-    // Get MAC address from device
-    NimBLEAddress deviceAddress = device->getAddress();
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Attempting connection to %s (Attempt %d/%d)...\n", 
-        monitor->config->name, deviceAddress.toString().c_str(),
-        monitor->connectRetries + 1, MAX_CONNECT_RETRIES);
-    
-    // Connect using MAC address (not device pointer) - this is more reliable
-    // Use default timeout (30 seconds) - Bridge solution takes ~30s to connect
-    
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Starting connection (using default 30s timeout)...\n", monitor->config->name);
-    
-    unsigned long startTime = millis();
-    bool connected = monitor->pClient->connect(deviceAddress);
-    unsigned long connectTime = millis() - startTime;
-    
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] connect() returned: %s (took %lums)\n", 
-        monitor->config->name, connected ? "true" : "false", connectTime);
-    
-    if (!connected) {
-        int lastError = monitor->pClient->getLastError();
-        DEBUG_TIMESTAMP();
-        DEBUG_PRINTF("[%s] BLE Error Code: %d\n", monitor->config->name, lastError);
-        
-        Serial.printf("[%s] Connection failed (Attempt %d/%d)\n", 
-            monitor->config->name, monitor->connectRetries + 1, MAX_CONNECT_RETRIES);
-        
-        // Delete and recreate client for next attempt - clears any stale state
-        if (monitor->pClient) {
-            DEBUG_TIMESTAMP();
-            DEBUG_PRINTLN("Deleting client to clear state");
-            NimBLEDevice::deleteClient(monitor->pClient);
-            monitor->pClient = nullptr;
-        }
-        
-        monitor->connectRetries++;
-        
-        if (monitor->connectRetries >= MAX_CONNECT_RETRIES) {
-            Serial.printf("[%s] Max retries reached, entering cooldown (30s)\n", 
-                monitor->config->name);
-            Serial.println("[HINT] Make sure Battery Guard app is closed on your phone!");
-            monitor->state = STATE_COOLDOWN;
-            monitor->lastRetryTime = millis();
-        } else {
-            monitor->state = STATE_DISCONNECTED;
-        }
-        return false;
-    }
-    
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Connection established! Getting service...\n", monitor->config->name);
-    
-    // Get service
-    NimBLERemoteService* pService = monitor->pClient->getService(SERVICE_UUID);
-    if (!pService) {
-        Serial.printf("[%s] ERROR: Service %s not found\n", 
-            monitor->config->name, SERVICE_UUID.toString().c_str());
-        monitor->pClient->disconnect();
-        return false;
-    }
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Service found!\n", monitor->config->name);
-    
-    // Get characteristics
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Getting characteristics...\n", monitor->config->name);
-    monitor->pWriteChar = pService->getCharacteristic(CHAR_WRITE_UUID);
-    monitor->pNotifyChar = pService->getCharacteristic(CHAR_NOTIFY_UUID);
-    
-    if (!monitor->pWriteChar || !monitor->pNotifyChar) {
-        Serial.printf("[%s] ERROR: Characteristics not found (Write: %s, Notify: %s)\n", 
-            monitor->config->name, 
-            monitor->pWriteChar ? "OK" : "FAIL",
-            monitor->pNotifyChar ? "OK" : "FAIL");
-        monitor->pClient->disconnect();
-        return false;
-    }
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Characteristics found!\n", monitor->config->name);
-    
-    // Subscribe to notifications
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Subscribing to notifications...\n", monitor->config->name);
-    if (monitor->pNotifyChar->canNotify()) {
-        if (!monitor->pNotifyChar->subscribe(true, notifyCallback)) {
-            Serial.printf("[%s] ERROR: Failed to subscribe to notifications\n", monitor->config->name);
-            monitor->pClient->disconnect();
-            return false;
-        }
-        DEBUG_TIMESTAMP();
-        DEBUG_PRINTF("[%s] Notification subscription successful!\n", monitor->config->name);
-    } else {
-        Serial.printf("[%s] ERROR: Characteristic cannot notify\n", monitor->config->name);
-        monitor->pClient->disconnect();
-        return false;
+// One callbacks object per monitor slot, allocated statically and handed to
+// the pooled client with deleteCallbacks=false
+ClientCallbacks clientCallbacks[4] = {
+    ClientCallbacks(&monitors[0]), ClientCallbacks(&monitors[1]),
+    ClientCallbacks(&monitors[2]), ClientCallbacks(&monitors[3])
+};
+
+// Slots can hold disabled entries (config.h or removed at runtime)
+uint8_t enabledMonitorCount() {
+    uint8_t count = 0;
+    for (int i = 0; i < activeMonitorCount; i++) {
+        if (monitors[i].config->enabled) count++;
     }
-    
-    // Success - reset retry counter
-    monitor->connectRetries = 0;
-    monitor->state = STATE_HANDSHAKE;
-    monitor->notifyCount = 0;  // Reset notification counter
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] State -> HANDSHAKE\n", monitor->config->name);
-    
-    // Send handshake
-    delay(100);
-    DEBUG_TIMESTAMP();
-    DEBUG_PRINTF("[%s] Sending handshake sequence...\n", monitor->config->name);
-    sendHandshake(monitor);
-    
-    return true;
+    return count;
 }
 
 // ============================================================================
@@ -462,31 +311,35 @@ class ScanCallbacks : public NimBLEAdvertisedDeviceCallbacks {
         }
         DEBUG_PRINTLN("");
         
-        // Check if this is a Battery Guard device
-        if (!device->haveName() || device->getName() != "Battery Guard") {
+        // Check if this is a supported battery monitor
+        if (!device->haveName()) {
+            return;
+        }
+        const ProtocolDecoder* decoder = decoderForAdvertisedName(device->getName().c_str());
+        if (!decoder) {
             return;
         }
         
-        DEBUG_PRINTF("Found Battery Guard: %s\n", device->getAddress().toString().c_str());
-        
-        // Get MAC address without colons
-        String mac = device->getAddress().toString().c_str();
-        mac.replace(":", "");
-        mac.toUpperCase();
+        DEBUG_PRINTF("Found %s device: %s\n", decoder->name, device->getAddress().toString().c_str());
         
-        DEBUG_PRINTF("MAC without colons: %s\n", mac.c_str());
+        const uint8_t* native = device->getAddress().getNative();
         
         // Check if this device is in our configuration
         for (int i = 0; i < activeMonitorCount; i++) {
             BatteryMonitor* monitor = &monitors[i];
             
-            String configSerial = monitor->config->serial;
-            configSerial.toUpperCase();
+            // Binary MAC compare (parsed from config.h at compile time)
+            if (!monitor->identity->mac.matchesNative(native)) continue;
             
-            // Check if MAC matches first
-            if (mac != configSerial) continue;
+            if (monitor->decoder != decoder) {
+                DEBUG_PRINTF("Skipping: advertises %s, configured as %s\n", decoder->name, monitor->decoder->name);
+                continue;
+            }
+            
+            // MAC matches - remember signal strength and age for the retry policy
+            bool strongEnough = monitor->recordAdvertisement(device->getRSSI(), clockMillis());
             
-            // MAC matches - now check if we can connect
+            // Now check if we can connect
             DEBUG_PRINTF("MAC match! State: %s, enabled: %d, connected: %d\n", 
                 stateToString(monitor->state), monitor->config->enabled, 
                 (monitor->pClient && monitor->pClient->isConnected()) ? 1 : 0);
@@ -496,7 +349,7 @@ class ScanCallbacks : public NimBLEAdvertisedDeviceCallbacks {
                 continue;
             }
             if (monitor->state == STATE_COOLDOWN) {
-                DEBUG_PRINTF("Skipping: in cooldown\n");
+                DEBUG_PRINTF("Skipping: in backoff\n");
                 continue;
             }
             if (monitor->state == STATE_CONNECTING || monitor->state == STATE_MONITORING || monitor->state == STATE_HANDSHAKE) {
@@ -507,22 +360,24 @@ class ScanCallbacks : public NimBLEAdvertisedDeviceCallbacks {
                 DEBUG_PRINTF("Skipping: already connected\n");
                 continue;
             }
+            if (!strongEnough) {
+                DEBUG_PRINTF("Skipping: RSSI %d below %d\n", device->getRSSI(), MIN_CONNECT_RSSI);
+                continue;
+            }
             
-            DEBUG_PRINTF("Comparing MAC '%s' with config '%s'\n", mac.c_str(), configSerial.c_str());
+            Serial.printf("[%s] Found device: %s - STOPPING SCAN!\n", 
+                monitor->config->name, device->getAddress().toString().c_str());
             
-            if (mac == configSerial) {
-                Serial.printf("[%s] Found device: %s - STOPPING SCAN!\n", 
-                    monitor->config->name, device->getAddress().toString().c_str());
-                
-                // Stop scanning immediately in callback
-                NimBLEDevice::getScan()->stop();
-                delay(100);
-                
-                // Mark as ready to connect and store address
-                monitor->state = STATE_SCANNING;
-                monitor->deviceAddress = device->getAddress();
-                return;
-            }
+            // Stop scanning immediately in callback
+            NimBLEDevice::getScan()->stop();
+            clockDelay(100);
+            
+            // Mark as ready to connect and store address
+            monitor->state = STATE_SCANNING;
+            portENTER_CRITICAL(&monitor->sampleLock);
+            monitor->deviceAddress = device->getAddress();
+            portEXIT_CRITICAL(&monitor->sampleLock);
+            return;
         }
         
         DEBUG_PRINTF("Device not in config list\n");
@@ -533,8 +388,8 @@ class ScanCallbacks : public NimBLEAdvertisedDeviceCallbacks {
 // Setup
 // ============================================================================
 void setup() {
+    // Serial is not awaited - BLE should start as early as possible
     Serial.begin(115200);
-    while (!Serial) delay(10);
     
     Serial.println("\n\n============================================================");
     Serial.println("Battery Guard Multi-Device Monitor");
@@ -565,16 +420,22 @@ void setup() {
     pBLEScan->setInterval(SCAN_INTERVAL);
     pBLEScan->setWindow(SCAN_WINDOW);
     
-    // Initialize monitors
-    for (int i = 0; i < DEVICE_COUNT && i < 4; i++) {
-        if (DEVICES[i].enabled) {
-            monitors[activeMonitorCount].init(i, &DEVICES[i]);
-            activeMonitorCount++;
-        }
+    // One pooled client per slot, so devices can be provisioned at runtime
+    for (int i = 0; i < MAX_MONITORS; i++) {
+        monitors[i].configIndex = i;
+        monitors[i].attachClient(&clientCallbacks[i]);
+    }
+    
+    // Device table from NVS (runtime provisioning) or config.h; slot i = monitors[i]
+    activeMonitorCount = deviceRegistry.load();
+    for (int i = 0; i < activeMonitorCount; i++) {
+        const DeviceSlot& slot = deviceRegistry.slot(i);
+        monitors[i].init(i, &slot.config, &slot.identity);
     }
     
-    Serial.printf("\nMonitoring %d device(s):\n", activeMonitorCount);
+    Serial.printf("\nMonitoring %d device(s):\n", enabledMonitorCount());
     for (int i = 0; i < activeMonitorCount; i++) {
+        if (!monitors[i].config->enabled) continue;
         Serial.printf("  [%d] %s (%s) - Type: 0x%02X\n", 
             i + 1, monitors[i].config->name, monitors[i].config->serial, 
             monitors[i].config->type);
@@ -582,6 +443,14 @@ void setup() {
     
     Serial.println("============================================================\n");
     
+    // Edge alert rules from NVS (before the first frame is evaluated)
+    alertEngine.begin();
+    
+    // Sample pipeline: NimBLE host task → queue → SampleTask
+    applyControlTaskPriority();
+    sampleQueue = xQueueCreate(SAMPLE_QUEUE_DEPTH, sizeof(RawFrame));
+    startTask(TASK_SAMPLES, sampleTask, NULL);
+    
     // Initialize LCD display
     #ifdef LCD_ENABLED
         Serial.println("[LCD] Starting display task...");
@@ -589,19 +458,39 @@ void setup() {
         Serial.println("[LCD] Display task started");
     #endif
     
-    // Initialize MQTT client
+    // Defer bulk network work to gaps between BLE notifications
+    coexScheduler.begin(monitors, MAX_MONITORS);
+    
+    // After a watchdog/software reset, reconnect known devices directly
+    warmRestoredCount = warmRestartRestore(monitors, activeMonitorCount);
+    
+    // Start scanning first so BLE discovery runs while WiFi associates
+    pBLEScan->start(0, false);
+    scanningActive = true;
+    
+    // Initialize MQTT client (WiFi/broker connect continue in the background)
     #ifdef MQTT_ENABLED
         Serial.println("[MQTT] Initializing MQTT client...");
-        if (mqttClient.begin()) {
-            Serial.println("[MQTT] MQTT client initialized successfully");
-        } else {
-            Serial.println("[MQTT] MQTT client initialization failed!");
-        }
+        mqttClient.begin();
+        startTask(TASK_NETWORK, networkTask, NULL);
+        Serial.println("[MQTT] MQTT client started, connecting in background");
     #endif
     
-    // Start scanning
-    pBLEScan->start(0, false);
-    scanningActive = true;
+    // InfluxDB writer (shares the WiFi link with MQTT if both are enabled)
+    #ifdef INFLUX_ENABLED
+        wifiLinkBegin();
+        influxWriter.begin();
+    #endif
+    
+    // UDP frame stream
+    #ifdef UDP_ENABLED
+        wifiLinkBegin();
+        udpStreamer.begin();
+    #endif
+    
+    startTask(TASK_STORAGE, storageTask, NULL);
+    
+    Serial.printf("[BOOT] Setup complete after %lums\n", clockMillis());
 }
 
 // ============================================================================
@@ -609,7 +498,7 @@ void setup() {
 // ============================================================================
 void loop() {
     // Check monitor states first
-    unsigned long now = millis();
+    unsigned long now = clockMillis();
     bool needToConnect = false;
     
     // Debug: Show all monitor states every 5 seconds
@@ -623,10 +512,31 @@ void loop() {
         }
         DEBUG_PRINTF("| needToConnect=%d scanningActive=%d isScanning=%d\n", 
             needToConnect, scanningActive, pBLEScan->isScanning());
+        // Missed frames per device, and how many overlapped WiFi activity
+        DEBUG_TIMESTAMP();
+        DEBUG_PRINT("Missed frames (total/during net): ");
+        for (int i = 0; i < activeMonitorCount; i++) {
+            DEBUG_PRINTF("[%d:%lu/%lu] ", i, (unsigned long)monitors[i].cadence.missed,
+                (unsigned long)monitors[i].cadence.missedNet);
+        }
+        DEBUG_PRINTF("| bulk deferrals=%lu\n", (unsigned long)coexScheduler.deferrals());
+        // Heap profile should stay flat across reconnects (pooled clients)
+        DEBUG_TIMESTAMP();
+        DEBUG_PRINTF("Heap: free=%u min=%u largest=%u\n",
+            ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getMaxAllocHeap());
         lastStateDebug = now;
     }
     #endif
     
+    // Runtime provisioning: only the changed slot is reconnected
+    int8_t changedSlot = deviceRegistry.applyPending(monitors, activeMonitorCount);
+    #ifdef LCD_ENABLED
+        if (changedSlot >= 0) {
+            g_displayData[changedSlot].active = false;  // Refilled by the next sample
+        }
+    #endif
+    deviceRegistry.checkDisruption(monitors, activeMonitorCount);
+    
     for (int i = 0; i < activeMonitorCount; i++) {
         BatteryMonitor* monitor = &monitors[i];
         
@@ -644,121 +554,43 @@ void loop() {
                 DEBUG_PRINTLN("Stopping scan to connect to device");
                 pBLEScan->stop();
                 scanningActive = false;
-                delay(100);  // Give BLE stack time to stop
+                clockDelay(100);  // Give BLE stack time to stop
             }
             
-            // Now connect (refactored to not need device pointer)
-            monitor->state = STATE_CONNECTING;
-            Serial.printf("[%s] Connecting to %s...\n", 
-                monitor->config->name, monitor->deviceAddress.toString().c_str());
-            
-            // Create client
-            monitor->pClient = NimBLEDevice::createClient();
-            monitor->pClient->setClientCallbacks(new ClientCallbacks(monitor), false);
-            
-            DEBUG_TIMESTAMP();
-            DEBUG_PRINTF("[%s] Attempting connection (Attempt %d/%d)...\n", 
-                monitor->config->name, monitor->connectRetries + 1, MAX_CONNECT_RETRIES);
-            
-            unsigned long startTime = millis();
-            bool connected = monitor->pClient->connect(monitor->deviceAddress);
-            unsigned long connectTime = millis() - startTime;
-            
-            DEBUG_TIMESTAMP();
-            DEBUG_PRINTF("[%s] connect() returned: %s (took %lums)\n", 
-                monitor->config->name, connected ? "true" : "false", connectTime);
-            
-            if (!connected) {
-                Serial.printf("[%s] Connection failed (Attempt %d/%d)\n", 
-                    monitor->config->name, monitor->connectRetries + 1, MAX_CONNECT_RETRIES);
-                
-                NimBLEDevice::deleteClient(monitor->pClient);
-                monitor->pClient = nullptr;
-                monitor->connectRetries++;
-                
-                if (monitor->connectRetries >= MAX_CONNECT_RETRIES) {
-                    Serial.printf("[%s] Max retries reached, entering cooldown\n", monitor->config->name);
-                    monitor->state = STATE_COOLDOWN;
-                    monitor->lastRetryTime = now;
-                } else {
-                    DEBUG_TIMESTAMP();
-                    DEBUG_PRINTF("[%s] Setting state to DISCONNECTED for retry\n", monitor->config->name);
-                    monitor->state = STATE_DISCONNECTED;
-                }
-            } else {
-                // Connected! Now get service and characteristics
+            // Only connect on a fresh advertisement; otherwise wait to hear it again
+            if (!monitor->recentlyHeard(clockMillis())) {
                 DEBUG_TIMESTAMP();
-                DEBUG_PRINTF("[%s] Connection successful! Discovering services...\n", monitor->config->name);
-                
-                NimBLERemoteService* pService = monitor->pClient->getService(SERVICE_UUID);
-                if (!pService) {
-                    Serial.printf("[%s] ERROR: Service not found\n", monitor->config->name);
-                    monitor->pClient->disconnect();
-                    monitor->state = STATE_DISCONNECTED;
-                    continue;
-                }
-                
-                monitor->pWriteChar = pService->getCharacteristic(CHAR_WRITE_UUID);
-                monitor->pNotifyChar = pService->getCharacteristic(CHAR_NOTIFY_UUID);
-                
-                if (!monitor->pWriteChar || !monitor->pNotifyChar) {
-                    Serial.printf("[%s] ERROR: Characteristics not found\n", monitor->config->name);
-                    monitor->pClient->disconnect();
-                    monitor->state = STATE_DISCONNECTED;
-                    continue;
-                }
-                
-                // Subscribe to notifications
-                if (monitor->pNotifyChar->canNotify()) {
-                    if (!monitor->pNotifyChar->subscribe(true, notifyCallback)) {
-                        Serial.printf("[%s] ERROR: Failed to subscribe\n", monitor->config->name);
-                        monitor->pClient->disconnect();
-                        monitor->state = STATE_DISCONNECTED;
-                        continue;
-                    }
-                }
-                
-                // Success! Send handshake
-                Serial.printf("[%s] Connected successfully!\n", monitor->config->name);
-                monitor->connectRetries = 0;
-                monitor->state = STATE_HANDSHAKE;
-                monitor->notifyCount = 0;  // Reset notification counter
-                delay(100);
-                sendHandshake(monitor);
+                DEBUG_PRINTF("[%s] Advertisement too old, rescanning\n", monitor->config->name);
+                monitor->state = STATE_DISCONNECTED;
+                continue;
             }
             
+            // Connect, discover, subscribe and handshake in one place
+            connectionEngine.connect(monitor);
+            
             needToConnect = true;  // Don't try multiple connections in one loop
         }
         
-        // Check cooldown state
-        if (monitor->state == STATE_COOLDOWN) {
-            if (now - monitor->lastRetryTime >= RETRY_COOLDOWN_MS) {
-                Serial.printf("[%s] Cooldown expired, resuming scan\n", monitor->config->name);
-                monitor->state = STATE_DISCONNECTED;
-                monitor->connectRetries = 0;
-            }
+        // Check backoff state
+        if (monitor->state == STATE_COOLDOWN && !monitor->isInCooldown()) {
+            DEBUG_TIMESTAMP();
+            DEBUG_PRINTF("[%s] Backoff expired, waiting for advertisement\n", monitor->config->name);
         }
         
-        // Check notification timeout (only after grace period)
-        if (monitor->state == STATE_MONITORING) {
-            unsigned long currentTime = millis();  // Get fresh time
-            unsigned long timeInState = currentTime - monitor->stateEnterTime;
-            if (timeInState > 2000) {  // Grace period: 2 seconds after entering MONITORING
-                unsigned long timeSinceNotif = currentTime - monitor->lastNotificationTime;
-                if (timeSinceNotif > NOTIFICATION_TIMEOUT_MS) {
-                    DEBUG_TIMESTAMP();
-                    DEBUG_PRINTF("[%s] Notification timeout: now=%lu, lastNotif=%lu, diff=%lums (threshold: %lu)\n", 
-                        monitor->config->name, currentTime, monitor->lastNotificationTime, timeSinceNotif, NOTIFICATION_TIMEOUT_MS);
-                    Serial.printf("[%s] Notification timeout, disconnecting\n", monitor->config->name);
-                    monitor->cleanup();
-                }
-            }
+        // Check link liveness (only after grace period)
+        unsigned long currentTime = clockMillis();  // Get fresh time
+        if (monitor->linkStale(currentTime)) {
+            unsigned long timeSinceNotif = elapsedMs(currentTime, monitor->lastNotificationTime);
+            uint32_t timeout = monitor->livenessTimeoutMs();
+            DEBUG_TIMESTAMP();
+            DEBUG_PRINTF("[%s] Notification timeout: now=%lu, lastNotif=%lu, diff=%lums (threshold: %lu)\n", 
+                monitor->config->name, currentTime, monitor->lastNotificationTime, timeSinceNotif, (unsigned long)timeout);
+            // Detection latency = silence before the link was declared stale
+            Serial.printf("[%s] Link stale after %lums without data (expected every %.0fms +/- %.0fms, threshold %lums), disconnecting\n",
+                monitor->config->name, timeSinceNotif,
+                monitor->cadence.mean, monitor->cadence.jitter, (unsigned long)timeout);
+            monitor->cleanup();
         }
-        
-        // Publish MQTT data if enabled (check all monitors, regardless of state)
-        #ifdef MQTT_ENABLED
-            mqttClient.publishBatteryData(monitor);
-        #endif
     }
     
     // Keep scanningActive flag in sync with actual scan state
@@ -769,13 +601,20 @@ void loop() {
     }
     
     // Check if ALL enabled devices are in MONITORING state
-    bool allMonitoring = true;
+    uint8_t monitoringCount = 0;
     for (int i = 0; i < activeMonitorCount; i++) {
-        if (monitors[i].state != STATE_MONITORING) {
-            allMonitoring = false;
-            break;
+        if (monitors[i].state == STATE_MONITORING) {
+            monitoringCount++;
         }
     }
+    bool allMonitoring = (monitoringCount == enabledMonitorCount());
+    
+    // Warm restart: report recovery time once restored devices are back
+    if (warmRestoredCount > 0 && monitoringCount >= warmRestoredCount) {
+        Serial.printf("[BOOT] Warm recovery: %d device(s) monitoring after %lums\n",
+            monitoringCount, clockMillis());
+        warmRestoredCount = 0;
+    }
     
     // Stop scan only if ALL devices are monitoring (Multi-Device Support)
     if (allMonitoring && scanningActive) {
@@ -793,10 +632,31 @@ void loop() {
         scanningActive = true;
     }
     
-    // Update MQTT client
-    #ifdef MQTT_ENABLED
-        mqttClient.loop();
-    #endif
+    // Task/heap telemetry (serial + MQTT)
+    static unsigned long lastTelemetry = 0;
+    if (now - lastTelemetry >= TELEMETRY_INTERVAL_MS) {
+        lastTelemetry = now;
+        telemetry.sample();
+        telemetry.printSerial();
+        SampleBus::printStats();
+        if (sampleQueueDrops) {
+            Serial.printf("[TELEMETRY] Sample queue drops: %lu\n", (unsigned long)sampleQueueDrops);
+        }
+        #ifdef INFLUX_ENABLED
+            influxWriter.printStats();
+        #endif
+        #ifdef UDP_ENABLED
+            udpStreamer.printStats();
+        #endif
+        #ifdef MQTT_ENABLED
+            mqttClient.printSessionStats();
+            
+            // Handed to NetworkTask (skipped if the previous one is still pending)
+            if (!telemetryPending && telemetry.formatJson(telemetryJson, sizeof(telemetryJson)) > 0) {
+                telemetryPending = true;
+            }
+        #endif
+    }
     
-    delay(100);
+    clockDelay(100);
 }
\ No newline at end of file
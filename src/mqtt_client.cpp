@@ -1,142 +1,280 @@
 #ifdef MQTT_ENABLED
 
 #include "mqtt_client.h"
+#include "coex_scheduler.h"
+#include "telemetry.h"
+#include "device_registry.h"
+#include "alert_engine.h"
+#include "wifi_link.h"
 #include <ArduinoJson.h>
-#include <time.h>
+
+static_assert(MQTT_BACKLOG_SAMPLES >= 1 && MQTT_BACKLOG_SAMPLES <= 255, "MQTT_BACKLOG_SAMPLES: 1 to 255");
 
 // Global instance
 MQTTClient mqttClient;
 
 // Constructor
 MQTTClient::MQTTClient() : 
-    mqttClient(wifiClient),
-    lastReconnectAttempt(0) {
+    session(transport),
+    sessionRestarted(false),
+    firstPublishMs(0) {
     for (int i = 0; i < MAX_DEVICES; i++) {
         lastPublishTime[i] = 0;
+        restoredPublished[i] = false;
+        discoveryPublished[i] = false;
+        availabilityPublished[i] = -1;
+        latestValid[i] = false;
+        backlog[i].first = 0;
+        backlog[i].count = 0;
     }
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    latestLock = unlocked;
 }
 
-// Initialize WiFi and MQTT
+// Initialize WiFi and MQTT (non-blocking - association and broker connect
+// continue in the background)
 bool MQTTClient::begin() {
     #ifdef DEBUG_MODE
     Serial.println("[MQTT] Initializing...");
     #endif
     
-    if (!connectWiFi()) {
-        return false;
-    }
-    
-    // Configure MQTT server
-    mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
-    mqttClient.setBufferSize(1024);  // Increase buffer for Home Assistant discovery
+    // Configure MQTT session
+    #if defined(MQTT_TLS) && defined(MQTT_TLS_CA_CERT)
+    transport.setCACert(MQTT_TLS_CA_CERT);
+    #endif
+    String clientId = "BatteryGuard-";
+    clientId += String((uint32_t)ESP.getEfuseMac(), HEX);
+    session.setServer(MQTT_SERVER, MQTT_PORT);
+    session.setClientId(clientId.c_str());
+    #ifdef MQTT_USERNAME
+    session.setCredentials(MQTT_USERNAME, MQTT_PASSWORD);
+    #endif
     
-    return connectMQTT();
+    // Broker publishes "offline" for us if the connection drops
+    String topic = buildStateTopic("_gateway");
+    topic += "/status";
+    strlcpy(statusTopic, topic.c_str(), sizeof(statusTopic));
+    session.setWill(statusTopic, "offline");
+    session.setCallbacks(onMessage, onSessionConnected);
+    
+    topic = buildStateTopic("_gateway");
+    topic += "/cmd";
+    session.subscribe(topic.c_str());
+    topic = buildStateTopic("_gateway");
+    topic += "/rules";
+    session.subscribe(topic.c_str());
+    
+    wifiLinkBegin();
+    return session.start();
 }
 
-// Connect to WiFi
-bool MQTTClient::connectWiFi() {
-    #ifdef DEBUG_MODE
-    Serial.printf("[MQTT] Connecting to WiFi: %s\n", WIFI_SSID);
-    #endif
-    
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+// Runs in the session's I/O task after every CONNACK
+void MQTTClient::onSessionConnected() {
+    mqttClient.session.publish(mqttClient.statusTopic, "online", true, 1);
+    mqttClient.sessionRestarted = true;     // Device availability is republished
+    coexScheduler.noteNetworkActivity();
+}
+
+// Main loop
+void MQTTClient::loop() {
+    if (!session.connected()) return;
     
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-        delay(500);
-        #ifdef DEBUG_MODE
-        Serial.print(".");
-        #endif
-        attempts++;
+    if (sessionRestarted) {
+        sessionRestarted = false;
+        for (int i = 0; i < MAX_DEVICES; i++) {
+            availabilityPublished[i] = -1;
+        }
     }
-    
-    if (WiFi.status() != WL_CONNECTED) {
-        #ifdef DEBUG_MODE
-        Serial.println("\n[MQTT] WiFi connection failed!");
-        #endif
-        return false;
+    processRegistryChanges();
+    publishAlerts();
+}
+
+// ============================================================================
+// Device Provisioning
+// ============================================================================
+
+static void handleRuleCommand(JsonDocument& doc);
+
+// Command topic handler (runs in the session's I/O task). Payload example:
+// {"op":"add","serial":"50547B000000","name":"Car","mqtt":"car","type":1}
+void MQTTClient::onMessage(char* topic, uint8_t* payload, unsigned int length) {
+    bool ruleCommand = String(topic).endsWith("/rules");
+    StaticJsonDocument<512> doc;
+    if (deserializeJson(doc, payload, length)) {
+        if (ruleCommand) {
+            alertEngine.rejectCommand("invalid JSON");
+        } else {
+            deviceRegistry.rejectCommand("invalid JSON");
+        }
+        return;
+    }
+    if (ruleCommand) {
+        handleRuleCommand(doc);
+        return;
     }
     
-    #ifdef DEBUG_MODE
-    Serial.printf("\n[MQTT] WiFi connected! IP: %s\n", WiFi.localIP().toString().c_str());
-    #endif
+    DeviceCommand command;
+    memset(&command, 0, sizeof(command));
+    command.type = -1;
+    command.enabled = -1;
+    command.protocol = -1;
+    command.keyIndex = -1;
+    
+    const char* op = doc["op"] | "";
+    if (strcmp(op, "add") == 0)         command.op = DEVICE_CMD_ADD;
+    else if (strcmp(op, "modify") == 0) command.op = DEVICE_CMD_MODIFY;
+    else if (strcmp(op, "remove") == 0) command.op = DEVICE_CMD_REMOVE;
+    else if (strcmp(op, "list") == 0)   command.op = DEVICE_CMD_LIST;
+    else if (strcmp(op, "reset") == 0)  command.op = DEVICE_CMD_RESET;
+    else {
+        deviceRegistry.rejectCommand("unknown op");
+        return;
+    }
     
-    // Configure NTP time synchronization (GMT+1, DST+1)
-    configTime(3600, 3600, "pool.ntp.org", "time.nist.gov");
-    #ifdef DEBUG_MODE
-    Serial.println("[MQTT] NTP time sync started");
-    #endif
+    strlcpy(command.serial, doc["serial"] | "", sizeof(command.serial));
+    strlcpy(command.name, doc["name"] | "", sizeof(command.name));
+    strlcpy(command.mqttName, doc["mqtt"] | "", sizeof(command.mqttName));
+    if (doc.containsKey("type"))    command.type = doc["type"].as<int16_t>();
+    if (doc.containsKey("enabled")) command.enabled = doc["enabled"].as<bool>() ? 1 : 0;
+    if (doc.containsKey("key"))     command.keyIndex = doc["key"].as<int8_t>();
+    if (doc.containsKey("protocol")) {
+        if (doc["protocol"].is<const char*>()) {
+            const char* name = doc["protocol"];
+            command.protocol = PROTOCOL_COUNT;  // Unknown name, rejected by the registry
+            for (int i = 0; i < PROTOCOL_COUNT; i++) {
+                if (strcasecmp(name, decoderFor((ProtocolId)i)->name) == 0) {
+                    command.protocol = i;
+                }
+            }
+        } else {
+            command.protocol = doc["protocol"].as<int8_t>();
+        }
+    }
     
-    return true;
+    if (!deviceRegistry.submit(command)) {
+        deviceRegistry.rejectCommand("busy");
+    }
 }
 
-// Connect to MQTT broker
-bool MQTTClient::connectMQTT() {
-    #ifdef DEBUG_MODE
-    Serial.printf("[MQTT] Connecting to broker: %s:%d\n", MQTT_SERVER, MQTT_PORT);
-    #endif
-    
-    String clientId = "BatteryGuard-";
-    clientId += String((uint32_t)ESP.getEfuseMac(), HEX);
-    
-    #ifdef MQTT_USERNAME
-    bool connected = mqttClient.connect(clientId.c_str(), MQTT_USERNAME, MQTT_PASSWORD);
-    #else
-    bool connected = mqttClient.connect(clientId.c_str());
-    #endif
-    
-    if (connected) {
-        #ifdef DEBUG_MODE
-        Serial.println("[MQTT] Connected to broker!");
-        #endif
-        return true;
+// Rule topic handler. Payload example:
+// {"op":"set","id":"low_voltage","when":"voltage < 11.8","for":30,"clear":"voltage > 12.1"}
+static void handleRuleCommand(JsonDocument& doc) {
+    const char* op = doc["op"] | "";
+    if (strcmp(op, "set") == 0) {
+        AlertRuleSource rule;
+        memset(&rule, 0, sizeof(rule));
+        strlcpy(rule.id, doc["id"] | "", sizeof(rule.id));
+        strlcpy(rule.device, doc["device"] | "", sizeof(rule.device));
+        strlcpy(rule.when, doc["when"] | "", sizeof(rule.when));
+        strlcpy(rule.clear, doc["clear"] | "", sizeof(rule.clear));
+        rule.forSeconds = doc["for"] | 0;
+        rule.clearForSeconds = doc["clear_for"] | 0;
+        alertEngine.setRule(rule);
+    } else if (strcmp(op, "delete") == 0) {
+        alertEngine.deleteRule(doc["id"] | "");
+    } else if (strcmp(op, "list") == 0) {
+        alertEngine.listRules();
     } else {
-        #ifdef DEBUG_MODE
-        Serial.printf("[MQTT] Connection failed, rc=%d\n", mqttClient.state());
-        #endif
-        return false;
+        alertEngine.rejectCommand("unknown op");
     }
 }
 
-// Reconnection logic
-void MQTTClient::reconnect() {
-    unsigned long now = millis();
+// Raised/cleared alerts (not retained) and rule command results
+void MQTTClient::publishAlerts() {
+    char result[640];
+    if (alertEngine.takeResult(result, sizeof(result))) {
+        String topic = buildStateTopic("_gateway");
+        topic += "/rules/result";
+        session.publish(topic.c_str(), result, false);
+    }
     
-    // Try reconnecting every 5 seconds
-    if (now - lastReconnectAttempt > 5000) {
-        lastReconnectAttempt = now;
-        
-        // Check WiFi first
-        if (WiFi.status() != WL_CONNECTED) {
-            #ifdef DEBUG_MODE
-            Serial.println("[MQTT] WiFi disconnected, reconnecting...");
-            #endif
-            connectWiFi();
+    AlertMessage alert;
+    while (alertEngine.takeAlert(alert)) {
+        StaticJsonDocument<256> doc;
+        doc["rule"] = alert.rule;
+        doc["device"] = alert.device;
+        doc["state"] = alert.raised ? "raised" : "cleared";
+        doc["voltage"] = round(alert.voltage * 100.0) / 100.0;
+        doc["soc"] = alert.soc;
+        doc["temperature"] = alert.temperature;
+        if (alert.epochMs != 0) {
+            doc["timestamp"] = alert.epochMs;
         }
+        char payload[256];
+        serializeJson(doc, payload, sizeof(payload));
         
-        // Try MQTT reconnect
-        if (WiFi.status() == WL_CONNECTED && !mqttClient.connected()) {
-            #ifdef DEBUG_MODE
-            Serial.println("[MQTT] Reconnecting to broker...");
-            #endif
-            connectMQTT();
+        String topic = buildStateTopic("_gateway");
+        topic += "/alert";
+        session.publish(topic.c_str(), payload, false, 1);
+        coexScheduler.noteNetworkActivity();
+    }
+}
+
+// Publish command results and follow name/topic changes of provisioned devices
+void MQTTClient::processRegistryChanges() {
+    char result[640];
+    if (deviceRegistry.takeResult(result, sizeof(result))) {
+        String topic = buildStateTopic("_gateway");
+        topic += "/cmd/result";
+        session.publish(topic.c_str(), result, false);
+        coexScheduler.noteNetworkActivity();
+    }
+    
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        DeviceIdentity old;
+        bool hadOld = false;
+        if (!deviceRegistry.takeNetworkChange(i, old, hadOld)) continue;
+        
+        if (hadOld) {
+            removeHomeAssistantDiscovery(&old);
+            session.publish(buildAvailabilityTopic(&old).c_str(), "", true, 1);
         }
+        // Discovery and the first state go out again under the new identity
+        discoveryPublished[i] = false;
+        availabilityPublished[i] = -1;
+        lastPublishTime[i] = 0;
+        restoredPublished[i] = false;
+        portENTER_CRITICAL(&latestLock);
+        latestValid[i] = false;             // Readings of the slot's previous device
+        backlog[i].count = 0;
+        portEXIT_CRITICAL(&latestLock);
     }
 }
 
-// Main loop
-void MQTTClient::loop() {
-    if (mqttClient.connected()) {
-        mqttClient.loop();
-    } else {
-        reconnect();
+// Clear retained discovery configs so Home Assistant drops the old entities
+void MQTTClient::removeHomeAssistantDiscovery(const DeviceIdentity* identity) {
+    #ifdef HOMEASSIST_FORMAT
+    static const char* const SENSORS[] = { "voltage", "soc", "temperature", "charge", "timestamp" };
+    for (size_t i = 0; i < sizeof(SENSORS) / sizeof(SENSORS[0]); i++) {
+        String topic = buildDiscoveryTopic(identity, SENSORS[i]);
+        session.publish(topic.c_str(), "", true, 1);
     }
+    coexScheduler.noteNetworkActivity();
+    #endif
 }
 
 // Check connection status
 bool MQTTClient::isConnected() {
-    return mqttClient.connected();
+    return session.connected();
+}
+
+void MQTTClient::printSessionStats() {
+    session.printStats();
+    #ifdef MQTT_TLS
+    transport.printStats();
+    #endif
+}
+
+// "mqtt":{...}[,"tls":{...}]
+size_t MQTTClient::formatSessionStats(char* buf, size_t len) {
+    size_t pos = session.formatStats(buf, len);
+    #ifdef MQTT_TLS
+    if (pos + 1 < len) {
+        buf[pos++] = ',';
+        pos += transport.formatStats(buf + pos, len - pos);
+    }
+    #endif
+    return pos;
 }
 
 // Build state topic
@@ -147,33 +285,252 @@ String MQTTClient::buildStateTopic(const char* mqttName) {
     return topic;
 }
 
+// Publish gateway telemetry (not retained, best effort)
+void MQTTClient::publishTelemetry(const char* payload) {
+    if (!session.connected()) return;
+    
+    String topic = buildStateTopic("_gateway");
+    topic += "/telemetry";
+    session.publish(topic.c_str(), payload, false);
+    coexScheduler.noteNetworkActivity();
+}
+
+// Build availability topic (<state topic>/availability)
+String MQTTClient::buildAvailabilityTopic(const DeviceIdentity* identity) {
+    String topic = identity->stateTopic.str;
+    topic += "/availability";
+    return topic;
+}
+
+// Retained online/offline per device, following the BLE link state
+void MQTTClient::publishAvailability(const BatteryMonitor* monitor) {
+    if (!monitor || !monitor->config || !session.connected()) return;
+    
+    int index = monitor->configIndex;
+    int8_t online = (monitor->config->enabled && monitor->state == STATE_MONITORING) ? 1 : 0;
+    if (online == availabilityPublished[index]) return;
+    
+    String topic = buildAvailabilityTopic(monitor->identity);
+    if (session.publish(topic.c_str(), online ? "online" : "offline", true, 1)) {
+        availabilityPublished[index] = online;
+        Serial.printf("[MQTT] %s %s\n", monitor->config->name, online ? "online" : "offline");
+    }
+    coexScheduler.noteNetworkActivity();
+}
+
 // Build Home Assistant discovery topic
-String MQTTClient::buildDiscoveryTopic(const char* mqttName, const char* sensor) {
-    String topic = "homeassistant/sensor/batteryguard_";
-    topic += mqttName;
+String MQTTClient::buildDiscoveryTopic(const DeviceIdentity* identity, const char* sensor) {
+    String topic = "homeassistant/sensor/";
+    topic += identity->discoveryId.str;
     topic += "_";
     topic += sensor;
     topic += "/config";
     return topic;
 }
 
+// "1m", "15m", "1h" (or seconds for odd window lengths)
+static void formatWindowLabel(uint32_t windowMs, char* buf, size_t len) {
+    if (windowMs % 3600000 == 0) {
+        snprintf(buf, len, "%luh", (unsigned long)(windowMs / 3600000));
+    } else if (windowMs % 60000 == 0) {
+        snprintf(buf, len, "%lum", (unsigned long)(windowMs / 60000));
+    } else {
+        snprintf(buf, len, "%lus", (unsigned long)(windowMs / 1000));
+    }
+}
+
+// {"1m":{"min":..,"max":..,"mean":..,"sd":..,"n":..}, ...}, empty windows omitted
+static void addWindowStats(JsonObject parent, const char* signal, const StatSummary* summary, float scale) {
+    JsonObject windows = parent.createNestedObject(signal);
+    for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++) {
+        if (summary[w].count == 0) continue;
+        char label[8];
+        formatWindowLabel(statsWindowMs(w), label, sizeof(label));
+        JsonObject window = windows.createNestedObject(label);
+        window["min"] = round(summary[w].min * scale) / scale;
+        window["max"] = round(summary[w].max * scale) / scale;
+        window["mean"] = round(summary[w].mean * scale) / scale;
+        window["sd"] = round(summary[w].stddev * scale) / scale;
+        window["n"] = summary[w].count;
+    }
+}
+
+bool MQTTClient::storeSample(const SampleRecord& record) {
+    if (record.monitorIndex >= MAX_DEVICES) return false;
+    bool connected = session.connected();
+    bool overwritten = false;
+    
+    portENTER_CRITICAL(&latestLock);
+    PublishSample& sample = latest[record.monitorIndex];
+    sample.voltage = record.voltage;
+    sample.soc = record.soc;
+    sample.temperature = record.temperature;
+    sample.status = record.status;
+    sample.restored = false;
+    sample.arrivalUs = record.arrivalUs;
+    sample.epochMs = record.epochMs;
+    latestValid[record.monitorIndex] = true;
+    
+    // Broker unreachable: keep one reading per publish interval for replay
+    SampleBacklog& ring = backlog[record.monitorIndex];
+    if (!connected) {
+        uint8_t newest = (ring.first + ring.count + MQTT_BACKLOG_SAMPLES - 1) % MQTT_BACKLOG_SAMPLES;
+        if (ring.count == 0 ||
+            record.arrivalUs - ring.entries[newest].arrivalUs >= (int64_t)MQTT_UPDATE_INTERVAL * 1000000) {
+            if (ring.count == MQTT_BACKLOG_SAMPLES) {
+                ring.first = (ring.first + 1) % MQTT_BACKLOG_SAMPLES;
+                ring.count--;
+                overwritten = true;
+            }
+            ring.entries[(ring.first + ring.count) % MQTT_BACKLOG_SAMPLES] = sample;
+            ring.count++;
+        }
+    }
+    portEXIT_CRITICAL(&latestLock);
+    return !overwritten;
+}
+
+bool MQTTClient::takeLatest(uint8_t index, PublishSample& sample) {
+    portENTER_CRITICAL(&latestLock);
+    bool valid = latestValid[index];
+    if (valid) sample = latest[index];
+    portEXIT_CRITICAL(&latestLock);
+    return valid;
+}
+
+bool MQTTClient::peekBacklog(uint8_t index, PublishSample& sample) {
+    portENTER_CRITICAL(&latestLock);
+    const SampleBacklog& ring = backlog[index];
+    bool pending = ring.count > 0;
+    if (pending) sample = ring.entries[ring.first];
+    portEXIT_CRITICAL(&latestLock);
+    return pending;
+}
+
+// Remove the oldest entry once it is queued (unless the sink replaced it)
+void MQTTClient::popBacklog(uint8_t index, int64_t arrivalUs) {
+    portENTER_CRITICAL(&latestLock);
+    SampleBacklog& ring = backlog[index];
+    if (ring.count > 0 && ring.entries[ring.first].arrivalUs == arrivalUs) {
+        ring.first = (ring.first + 1) % MQTT_BACKLOG_SAMPLES;
+        ring.count--;
+    }
+    portEXIT_CRITICAL(&latestLock);
+}
+
+// Readings buffered while the broker was unreachable, oldest first, as bulk
+// QoS 1 messages that are not retained (the live state publish after them
+// stays the retained one). Stops when the outbox is full; the rest goes out
+// next cycle.
+void MQTTClient::replayBacklog(const BatteryMonitor* monitor, int64_t latestArrivalUs) {
+    uint8_t index = monitor->configIndex;
+    const char* topic = monitor->identity->stateTopic.str;
+    PublishSample sample;
+    uint8_t replayed = 0;
+    while (peekBacklog(index, sample)) {
+        // The latest reading itself goes out as the live state publish
+        if (sample.arrivalUs != latestArrivalUs) {
+            String payload = buildBacklogPayload(sample);
+            if (!session.publish(topic, payload.c_str(), false, 1, true)) break;
+            replayed++;
+        }
+        popBacklog(index, sample.arrivalUs);
+    }
+    if (replayed > 0) {
+        coexScheduler.noteNetworkActivity();
+        Serial.printf("[MQTT] %s: %d buffered reading(s) queued\n", monitor->config->name, replayed);
+    }
+}
+
+// A reading restored after a warm restart never went through the sample
+// bus; it is read from the monitor under sampleLock
+void MQTTClient::copySample(const BatteryMonitor* monitor, PublishSample& sample) {
+    portENTER_CRITICAL(&monitor->sampleLock);
+    sample.voltage = monitor->voltage;
+    sample.soc = monitor->soc;
+    sample.temperature = monitor->temperature;
+    sample.status = monitor->status;
+    sample.restored = monitor->restoredSample;
+    sample.arrivalUs = monitor->sampleArrivalUs;
+    sample.epochMs = monitor->sampleEpochMs;
+    portEXIT_CRITICAL(&monitor->sampleLock);
+}
+
 // Build JSON payload
-String MQTTClient::buildJsonPayload(const BatteryMonitor* monitor) {
-    StaticJsonDocument<256> doc;
+String MQTTClient::buildJsonPayload(const BatteryMonitor* monitor, const PublishSample& sample) {
+    StaticJsonDocument<1536> doc;
     
-    doc["voltage"] = round(monitor->voltage * 100.0) / 100.0;  // Round to 2 decimals
-    doc["soc"] = monitor->soc;
-    doc["temperature"] = monitor->temperature;
+    doc["voltage"] = round(sample.voltage * 100.0) / 100.0;  // Round to 2 decimals
+    doc["soc"] = sample.soc;
+    doc["temperature"] = sample.temperature;
     
     // Use MQTT-specific status (without "Charge:" prefix)
-    doc["charge"] = getBatteryStatusMqtt(monitor->status);
+    doc["charge"] = getBatteryStatusMqtt(sample.status);
+    
+    // Duration of the last successful connection sequence
+    doc["connect_ms"] = monitor->connectMetrics.lastTotalMs;
+    doc["connect_ok"] = monitor->connectMetrics.successes;
+    doc["connect_attempts"] = monitor->connectMetrics.attempts;
+    doc["rssi"] = monitor->lastAdvRssi;
+    doc["missed_frames"] = monitor->cadence.missed;
+    doc["missed_net"] = monitor->cadence.missedNet;
+    if (sample.restored) {
+        doc["restored"] = true;  // Last reading from before a warm restart
+    }
+    
+    // Arrival time of the reading as UTC epoch milliseconds. A sample that
+    // arrived before the first NTP sync is converted now; omitted if the
+    // clock has never been synced.
+    int64_t timestamp = sample.epochMs;
+    if (timestamp == 0 && sample.arrivalUs != 0 && !sample.restored) {
+        timestamp = clockEpochMs(sample.arrivalUs);
+    }
+    if (timestamp != 0) {
+        doc["timestamp"] = timestamp;
+    }
+    
+    // Gateway-side health estimate (fields appear once measured)
+    const HealthEstimator& health = monitor->health;
+    JsonObject healthJson = doc.createNestedObject("health");
+    healthJson["resting"] = health.isResting();
+    if (health.restVoltage() > 0) {
+        healthJson["rest_v"] = round(health.restVoltage() * 100.0) / 100.0;
+        healthJson["ocv_soc"] = health.ocvSoc();
+    }
+    if (health.fullChargeRestVoltage() > 0) {
+        healthJson["full_rest_v"] = round(health.fullChargeRestVoltage() * 100.0) / 100.0;
+    }
+    if (health.cranks() > 0) {
+        healthJson["crank_sag"] = round(health.crankSag() * 100.0) / 100.0;
+        healthJson["crank_min_v"] = round(health.crankMinVoltage() * 100.0) / 100.0;
+        healthJson["cranks"] = health.cranks();
+    }
+    if (health.stateOfHealth() >= 0) {
+        healthJson["soh"] = health.stateOfHealth();
+    }
+    
+    // SOC trend: hours to TREND_RESERVE_SOC (discharging) or to full (charging)
+    TrendPrediction trend = monitor->trend.predict(clockMillis());
+    if (trend.valid) {
+        JsonObject trendJson = doc.createNestedObject("trend");
+        trendJson["charging"] = trend.charging;
+        trendJson["soc_per_h"] = round(trend.socPerHour * 100.0) / 100.0;
+        if (trend.hours >= 0) {
+            trendJson[trend.charging ? "to_full_h" : "to_reserve_h"] = round(trend.hours * 10.0) / 10.0;
+            if (trend.hoursMin >= 0) trendJson["h_min"] = round(trend.hoursMin * 10.0) / 10.0;
+            if (trend.hoursMax >= 0) trendJson["h_max"] = round(trend.hoursMax * 10.0) / 10.0;
+        }
+    }
     
-    // Add timestamp from NTP
-    time_t now;
-    time(&now);
-    char timestamp[25];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
-    doc["timestamp"] = timestamp;
+    // Full-rate signal summarised over the rolling windows
+    StatSummary voltageStats[STATS_WINDOW_COUNT];
+    StatSummary temperatureStats[STATS_WINDOW_COUNT];
+    monitor->stats.summarize(clockMillis(), voltageStats, temperatureStats);
+    if (voltageStats[STATS_SHORT].count > 0 || voltageStats[STATS_LONG].count > 0) {
+        JsonObject stats = doc.createNestedObject("stats");
+        addWindowStats(stats, "voltage", voltageStats, 1000.0f);
+        addWindowStats(stats, "temperature", temperatureStats, 10.0f);
+    }
     
     String output;
     serializeJson(doc, output);
@@ -181,18 +538,24 @@ String MQTTClient::buildJsonPayload(const BatteryMonitor* monitor) {
 }
 
 // Build Home Assistant configuration payload
-String MQTTClient::buildHomeAssistantConfig(const DeviceConfig* config, const char* sensor, const char* unit, const char* deviceClass) {
+String MQTTClient::buildHomeAssistantConfig(const BatteryMonitor* monitor, const char* sensor, const char* unit, const char* deviceClass) {
     StaticJsonDocument<768> doc;
+    const DeviceConfig* config = monitor->config;
+    const DeviceIdentity* identity = monitor->identity;
     
-    String objectId = "batteryguard_";
-    objectId += config->mqttName;
+    String objectId = identity->discoveryId.str;
     objectId += "_";
     objectId += sensor;
     
     doc["name"] = String(config->name) + " " + String(sensor);
     doc["unique_id"] = objectId;
-    doc["state_topic"] = buildStateTopic(config->mqttName);
-    doc["value_template"] = String("{{ value_json.") + sensor + " }}";
+    doc["state_topic"] = identity->stateTopic.str;
+    if (strcmp(sensor, "timestamp") == 0) {
+        // Payload carries epoch milliseconds
+        doc["value_template"] = "{{ (value_json.timestamp / 1000) | timestamp_custom('%Y-%m-%dT%H:%M:%S+00:00', false) }}";
+    } else {
+        doc["value_template"] = String("{{ value_json.") + sensor + " }}";
+    }
     
     if (unit && strlen(unit) > 0) {
         doc["unit_of_measurement"] = unit;
@@ -204,13 +567,21 @@ String MQTTClient::buildHomeAssistantConfig(const DeviceConfig* config, const ch
     
     // Add timestamp sensor availability
     if (strcmp(sensor, "timestamp") != 0) {
-        doc["json_attributes_topic"] = buildStateTopic(config->mqttName);
+        doc["json_attributes_topic"] = identity->stateTopic.str;
         doc["json_attributes_template"] = "{{ {'timestamp': value_json.timestamp} | tojson }}";
     }
     
+    // Unavailable when either the gateway or the device's BLE link is down
+    JsonArray availability = doc.createNestedArray("availability");
+    JsonObject gatewayAvailability = availability.createNestedObject();
+    gatewayAvailability["topic"] = buildStateTopic("_gateway") + "/status";
+    JsonObject deviceAvailability = availability.createNestedObject();
+    deviceAvailability["topic"] = buildAvailabilityTopic(identity);
+    doc["availability_mode"] = "all";
+    
     // Device info
     JsonObject device = doc.createNestedObject("device");
-    device["identifiers"][0] = String("batteryguard_") + config->mqttName;
+    device["identifiers"][0] = identity->discoveryId.str;
     device["name"] = config->name;
     device["manufacturer"] = "Battery Guard";
     device["model"] = "BLE Monitor";
@@ -220,62 +591,67 @@ String MQTTClient::buildHomeAssistantConfig(const DeviceConfig* config, const ch
     return output;
 }
 
-// Publish Home Assistant discovery messages
-void MQTTClient::publishHomeAssistantDiscovery(const DeviceConfig* config) {
+// Buffered reading: the values and their arrival time only (stats, health
+// and trend describe the present and go with the live state)
+String MQTTClient::buildBacklogPayload(const PublishSample& sample) {
+    StaticJsonDocument<256> doc;
+    doc["voltage"] = round(sample.voltage * 100.0) / 100.0;
+    doc["soc"] = sample.soc;
+    doc["temperature"] = sample.temperature;
+    doc["charge"] = getBatteryStatusMqtt(sample.status);
+    int64_t timestamp = sample.epochMs != 0 ? sample.epochMs : clockEpochMs(sample.arrivalUs);
+    if (timestamp != 0) {
+        doc["timestamp"] = timestamp;
+    }
+    doc["buffered"] = true;
+    
+    String output;
+    serializeJson(doc, output);
+    return output;
+}
+
+// Publish Home Assistant discovery messages (false if the outbox was full)
+bool MQTTClient::publishHomeAssistantDiscovery(const BatteryMonitor* monitor) {
     #ifdef HOMEASSIST_FORMAT
-    if (!mqttClient.connected()) return;
+    struct Sensor { const char* name; const char* unit; const char* deviceClass; };
+    static const Sensor SENSORS[] = {
+        { "voltage",     "V",   "voltage" },
+        { "soc",         "%",   "battery" },
+        { "temperature", "°C",  "temperature" },
+        { "charge",      "",    "" },
+        { "timestamp",   "",    "timestamp" },
+    };
     
     #ifdef DEBUG_MODE
-    Serial.printf("[MQTT] Publishing Home Assistant discovery for %s\n", config->name);
+    Serial.printf("[MQTT] Publishing Home Assistant discovery for %s\n", monitor->config->name);
     #endif
     
-    // Voltage sensor
-    String topic = buildDiscoveryTopic(config->mqttName, "voltage");
-    String payload = buildHomeAssistantConfig(config, "voltage", "V", "voltage");
-    mqttClient.publish(topic.c_str(), payload.c_str(), MQTT_RETAINED);
-    
-    delay(50);  // Small delay between discovery messages
-    
-    // SOC sensor
-    topic = buildDiscoveryTopic(config->mqttName, "soc");
-    payload = buildHomeAssistantConfig(config, "soc", "%", "battery");
-    mqttClient.publish(topic.c_str(), payload.c_str(), MQTT_RETAINED);
-    
-    delay(50);
-    
-    // Temperature sensor
-    topic = buildDiscoveryTopic(config->mqttName, "temperature");
-    payload = buildHomeAssistantConfig(config, "temperature", "°C", "temperature");
-    mqttClient.publish(topic.c_str(), payload.c_str(), MQTT_RETAINED);
-    
-    delay(50);
-    
-    // Charge status sensor
-    topic = buildDiscoveryTopic(config->mqttName, "charge");
-    payload = buildHomeAssistantConfig(config, "charge", "", "");
-    mqttClient.publish(topic.c_str(), payload.c_str(), MQTT_RETAINED);
-    
-    delay(50);
-    
-    // Timestamp sensor
-    topic = buildDiscoveryTopic(config->mqttName, "timestamp");
-    payload = buildHomeAssistantConfig(config, "timestamp", "", "timestamp");
-    mqttClient.publish(topic.c_str(), payload.c_str(), MQTT_RETAINED);
+    // Queued back to back; the session's inflight window paces them
+    bool queued = true;
+    for (size_t i = 0; i < sizeof(SENSORS) / sizeof(SENSORS[0]); i++) {
+        String topic = buildDiscoveryTopic(monitor->identity, SENSORS[i].name);
+        String payload = buildHomeAssistantConfig(monitor, SENSORS[i].name, SENSORS[i].unit, SENSORS[i].deviceClass);
+        queued &= session.publish(topic.c_str(), payload.c_str(), MQTT_RETAINED, 1, true);
+    }
+    coexScheduler.noteNetworkActivity();
     
     #ifdef DEBUG_MODE
-    Serial.println("[MQTT] Discovery published");
+    Serial.println(queued ? "[MQTT] Discovery queued" : "[MQTT] Discovery incomplete, outbox full");
     #endif
+    return queued;
+    #else
+    return true;
     #endif
 }
 
 // Publish battery state
-void MQTTClient::publishState(const BatteryMonitor* monitor) {
-    if (!mqttClient.connected()) {
+void MQTTClient::publishState(const BatteryMonitor* monitor, const PublishSample& sample) {
+    if (!session.connected()) {
         Serial.println("[MQTT] Not connected, skipping publish");
         return;
     }
     
-    unsigned long now = millis();
+    unsigned long now = clockMillis();
     int index = monitor->configIndex;
     
     // Check if enough time has passed since last publish (allow first publish immediately)
@@ -285,47 +661,82 @@ void MQTTClient::publishState(const BatteryMonitor* monitor) {
     
     lastPublishTime[index] = now;
     
-    String topic = buildStateTopic(monitor->config->mqttName);
-    String payload = buildJsonPayload(monitor);
+    const char* topic = monitor->identity->stateTopic.str;
+    String payload = buildJsonPayload(monitor, sample);
     
-    Serial.printf("[MQTT] Publishing to %s: %s\n", topic.c_str(), payload.c_str());
-    bool published = mqttClient.publish(topic.c_str(), payload.c_str(), MQTT_RETAINED);
+    Serial.printf("[MQTT] Publishing to %s: %s\n", topic, payload.c_str());
+    // A reading replayed after a warm restart is bulk; live ones are not
+    bool published = session.publish(topic, payload.c_str(), MQTT_RETAINED, 1, sample.restored);
+    coexScheduler.noteNetworkActivity();
     
     if (published) {
-        Serial.printf("[MQTT] ✓ Publish successful\n");
+        Serial.printf("[MQTT] ✓ Publish queued\n");
+        if (sample.arrivalUs != 0) {
+            telemetry.recordLatency(LATENCY_PUBLISH, (uint32_t)(clockMicros() - sample.arrivalUs));
+        }
+        if (firstPublishMs == 0) {
+            firstPublishMs = clockMillis();
+            Serial.printf("[BOOT] Time to first publish: %lums\n", firstPublishMs);
+        }
     } else {
-        Serial.println("[MQTT] ✗ Publish failed!");
+        Serial.println("[MQTT] ✗ Publish failed, outbox full!");
     }
 }
 
 // Public method to publish battery data
 void MQTTClient::publishBatteryData(const BatteryMonitor* monitor) {
-    unsigned long now = millis();
+    unsigned long now = clockMillis();
     
     if (!monitor || !monitor->config) {
         return;
     }
     
-    // Only publish when monitoring (device connected and receiving data)
-    if (monitor->state != STATE_MONITORING) {
+    // Network still coming up: MqttSink keeps the latest reading and a
+    // backlog, both go out as soon as the broker is reachable
+    if (!session.connected()) {
         return;
     }
     
-    // Wait for valid data (voltage > 0 means we've received at least one notification)
-    if (monitor->voltage <= 0.0f) {
+    // Latest reading from MqttSink, else the restored one (if any)
+    PublishSample sample;
+    if (!takeLatest(monitor->configIndex, sample)) {
+        copySample(monitor, sample);
+    }
+    PublishSample oldest;
+    bool buffered = peekBacklog(monitor->configIndex, oldest);
+    
+    // Live state only when monitoring (device connected and receiving data),
+    // except once for a reading restored after a warm restart. Voltage > 0
+    // means we've received at least one notification.
+    bool publishRestored = sample.restored && !restoredPublished[monitor->configIndex];
+    bool live = (monitor->state == STATE_MONITORING || publishRestored) && sample.voltage > 0.0f;
+    if (!live && !buffered) {
         return;
     }
     
-    // Publish discovery once on first publish
-    static bool discoveryPublished[MAX_DEVICES] = {false};
+    // Publish discovery once on first publish (queued as bulk: the session's
+    // I/O task sends it in a quiet BLE window)
     if (!discoveryPublished[monitor->configIndex]) {
         Serial.printf("[MQTT] Publishing Home Assistant discovery for %s\n", monitor->config->name);
-        publishHomeAssistantDiscovery(monitor->config);
+        if (!publishHomeAssistantDiscovery(monitor)) {
+            return;  // Retried next cycle once the outbox has drained
+        }
         discoveryPublished[monitor->configIndex] = true;
     }
     
+    if (buffered) {
+        replayBacklog(monitor, sample.arrivalUs);
+    }
+    if (!live) {
+        return;
+    }
+    
     // Publish state
-    publishState(monitor);
+    publishState(monitor, sample);
+    if (publishRestored) {
+        restoredPublished[monitor->configIndex] = true;
+        lastPublishTime[monitor->configIndex] = 0;  // First live sample goes out immediately
+    }
 }
 
 #endif // MQTT_ENABLED
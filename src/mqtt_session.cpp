@@ -0,0 +1,670 @@
+#ifdef MQTT_ENABLED
+
+#include "mqtt_session.h"
+#include "task_topology.h"
+#include "telemetry.h"
+#include "coex_scheduler.h"
+#include <WiFi.h>
+
+static_assert(MQTT_OUTBOX_BYTES % 4 == 0 && MQTT_OUTBOX_BYTES <= 32768, "MQTT_OUTBOX_BYTES: multiple of 4, at most 32768");
+
+// Packet types (fixed header, upper nibble)
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_SUBSCRIBE   0x82   // Reserved flag bits 0010
+#define MQTT_SUBACK      0x90
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_DISCONNECT  0xE0
+
+// Outbox entry states
+#define ENTRY_QUEUED     0
+#define ENTRY_INFLIGHT   1
+#define ENTRY_DONE       2
+#define ENTRY_WRAP       3      // Rest of the ring unused, continue at 0
+
+#define ENTRY_QOS_MASK   0x03
+#define ENTRY_RETAIN     0x04
+#define ENTRY_BULK       0x08
+
+MqttSession::MqttSession(Client& client) :
+    client(client),
+    host(nullptr),
+    port(1883),
+    username(nullptr),
+    password(nullptr),
+    willMessage(nullptr),
+    messageCallback(nullptr),
+    connectCallback(nullptr),
+    subscriptionCount(0),
+    lock(nullptr),
+    head(0), tail(0), used(0), unsent(0), cursor(0),
+    inflight(0),
+    nextPacketId(1),
+    ioTask(nullptr),
+    state(SESSION_DISCONNECTED),
+    bulkGate(-1),
+    isConnected(false),
+    sessionId(0),
+    subscribePending(false),
+    pingOutstanding(false),
+    lastConnectAttempt(0),
+    connectStartMs(0),
+    lastOutMs(0),
+    pingSentMs(0),
+    rxPhase(0), rxType(0), rxLength(0), rxShift(0), rxReceived(0) {
+    clientId[0] = '\0';
+    willTopic[0] = '\0';
+    memset(&stats, 0, sizeof(stats));
+}
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+void MqttSession::setServer(const char* serverHost, uint16_t serverPort) {
+    host = serverHost;
+    port = serverPort;
+}
+
+void MqttSession::setClientId(const char* id) {
+    strlcpy(clientId, id, sizeof(clientId));
+}
+
+void MqttSession::setCredentials(const char* user, const char* pass) {
+    username = user;
+    password = pass;
+}
+
+void MqttSession::setWill(const char* topic, const char* message) {
+    strlcpy(willTopic, topic, sizeof(willTopic));
+    willMessage = message;
+}
+
+void MqttSession::setCallbacks(MqttMessageCallback onMessage, MqttConnectCallback onConnect) {
+    messageCallback = onMessage;
+    connectCallback = onConnect;
+}
+
+bool MqttSession::subscribe(const char* topic) {
+    if (subscriptionCount >= MQTT_MAX_SUBSCRIPTIONS || strlen(topic) >= MQTT_MAX_TOPIC) {
+        return false;
+    }
+    strlcpy(subscriptions[subscriptionCount++], topic, MQTT_MAX_TOPIC);
+    subscribePending = true;
+    return true;
+}
+
+bool MqttSession::start() {
+    lock = xSemaphoreCreateMutex();
+    if (!lock) return false;
+    return startTask(TASK_MQTT_IO, taskEntry, this, &ioTask);
+}
+
+// ============================================================================
+// Outbox (publishers)
+// ============================================================================
+
+bool MqttSession::publish(const char* topic, const char* payload, bool retained, uint8_t qos, bool bulk) {
+    size_t topicLength = strlen(topic);
+    size_t payloadLength = strlen(payload);
+    size_t size = (sizeof(OutboxEntry) + topicLength + payloadLength + 3) & ~(size_t)3;
+    if (!lock || topicLength >= MQTT_MAX_TOPIC || size > MQTT_OUTBOX_BYTES / 2) {
+        stats.dropped++;
+        return false;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    // Free space is [head, end) + [0, tail) when head >= tail, else [head, tail)
+    uint16_t offset = head;
+    uint16_t gap = 0;
+    bool fits;
+    if (used == MQTT_OUTBOX_BYTES) {
+        fits = false;
+    } else if (head >= tail) {
+        if (MQTT_OUTBOX_BYTES - head >= size) {
+            fits = true;
+        } else {
+            // Too close to the end: skip the rest and continue at 0
+            gap = MQTT_OUTBOX_BYTES - head;
+            offset = 0;
+            fits = tail >= size;
+        }
+    } else {
+        fits = (size_t)(tail - head) >= size;
+    }
+    if (!fits) {
+        stats.dropped++;
+        xSemaphoreGive(lock);
+        return false;
+    }
+
+    if (gap >= sizeof(OutboxEntry)) {
+        entryAt(head)->state = ENTRY_WRAP;
+    }
+    OutboxEntry* entry = entryAt(offset);
+    entry->size = size;
+    entry->packetId = 0;
+    entry->topicLength = topicLength;
+    entry->payloadLength = payloadLength;
+    entry->state = ENTRY_QUEUED;
+    entry->flags = (qos ? 1 : 0) | (retained ? ENTRY_RETAIN : 0) | (bulk ? ENTRY_BULK : 0);
+    entry->session = 0;
+    entry->queuedUs = (uint32_t)clockMicros();
+    entry->sentUs = 0;
+    entry->lastSendMs = 0;
+    uint8_t* data = (uint8_t*)(entry + 1);
+    memcpy(data, topic, topicLength);
+    memcpy(data + topicLength, payload, payloadLength);
+
+    head = (offset + size) % MQTT_OUTBOX_BYTES;
+    used += gap + size;
+    unsent++;
+    stats.queued++;
+    if (used > stats.outboxPeak) stats.outboxPeak = used;
+    xSemaphoreGive(lock);
+
+    if (ioTask) xTaskNotifyGive(ioTask);
+    return true;
+}
+
+uint16_t MqttSession::outboxFree() {
+    if (!lock) return 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint16_t bytes = MQTT_OUTBOX_BYTES - used;
+    xSemaphoreGive(lock);
+    return bytes;
+}
+
+// Skip the unused end of the ring
+uint16_t MqttSession::normalize(uint16_t offset) {
+    if (MQTT_OUTBOX_BYTES - offset < sizeof(OutboxEntry) || entryAt(offset)->state == ENTRY_WRAP) {
+        return 0;
+    }
+    return offset;
+}
+
+uint16_t MqttSession::advance(uint16_t offset) {
+    return (offset + entryAt(offset)->size) % MQTT_OUTBOX_BYTES;
+}
+
+// Reclaim sent QoS 0 and acknowledged QoS 1 entries from the tail
+void MqttSession::releaseDone() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    while (used > 0) {
+        uint16_t start = normalize(tail);
+        if (start != tail) {
+            used -= MQTT_OUTBOX_BYTES - tail;
+            tail = 0;
+            continue;
+        }
+        OutboxEntry* entry = entryAt(tail);
+        if (entry->state != ENTRY_DONE) break;
+        used -= entry->size;
+        tail = advance(tail);
+    }
+    xSemaphoreGive(lock);
+}
+
+// ============================================================================
+// I/O Task
+// ============================================================================
+
+void MqttSession::taskEntry(void* param) {
+    MqttSession* session = (MqttSession*)param;
+    while (true) {
+        session->service();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_IO_POLL_MS));
+    }
+}
+
+void MqttSession::service() {
+    unsigned long now = clockMillis();
+
+    if (state == SESSION_DISCONNECTED) {
+        if (WiFi.status() != WL_CONNECTED) {
+            lastConnectAttempt = 0;     // Try the broker right away once WiFi is back
+            return;
+        }
+        if (lastConnectAttempt == 0 || now - lastConnectAttempt >= MQTT_RECONNECT_MS) {
+            lastConnectAttempt = now;
+            beginConnect(now);
+        }
+        return;
+    }
+
+    if (!client.connected()) {
+        drop("connection lost");
+        return;
+    }
+
+    while (state != SESSION_DISCONNECTED && readPacket()) {
+        handlePacket(now);
+    }
+
+    if (state == SESSION_CONNECTING) {
+        if (now - connectStartMs > MQTT_CONNECT_TIMEOUT_MS) {
+            drop("no CONNACK");
+        }
+        return;
+    }
+    if (state != SESSION_CONNECTED) return;
+
+    if (subscribePending) sendSubscriptions();
+
+    // Only bulk entries wait for a quiet BLE window (see coex_scheduler.h);
+    // state, alerts, acks, pings and subscriptions go out right away
+    bulkGate = -1;
+    if (outboxPending()) {
+        retransmit(now);
+        sendQueued(now);
+    }
+    keepalive(now);
+}
+
+static size_t encodeLength(uint8_t* buf, uint32_t length) {
+    size_t n = 0;
+    do {
+        uint8_t digit = length % 128;
+        length /= 128;
+        if (length > 0) digit |= 0x80;
+        buf[n++] = digit;
+    } while (length > 0);
+    return n;
+}
+
+// Length-prefixed string into buf (cap bytes from n); false if it does not fit
+static bool appendString(uint8_t* buf, size_t cap, size_t& n, const char* str) {
+    size_t length = strlen(str);
+    if (length > 0xFFFF || n + 2 + length > cap) return false;
+    buf[n++] = length >> 8;
+    buf[n++] = length & 0xFF;
+    memcpy(buf + n, str, length);
+    n += length;
+    return true;
+}
+
+// String field written straight to the socket (CONNECT payload)
+bool MqttSession::writeString(const char* str) {
+    size_t length = strlen(str);
+    uint8_t prefix[2] = { (uint8_t)(length >> 8), (uint8_t)(length & 0xFF) };
+    return writeBytes(prefix, 2) && writeBytes((const uint8_t*)str, length);
+}
+
+bool MqttSession::writeBytes(const uint8_t* buf, size_t len) {
+    if (client.write(buf, len) != len) {
+        drop("write failed");
+        return false;
+    }
+    lastOutMs = clockMillis();
+    return true;
+}
+
+void MqttSession::beginConnect(unsigned long now) {
+    #ifdef DEBUG_MODE
+    Serial.printf("[MQTT] Connecting to broker: %s:%d\n", host, port);
+    #endif
+    coexScheduler.noteNetworkActivity();
+
+    if (!client.connect(host, port)) {
+        #ifdef DEBUG_MODE
+        Serial.println("[MQTT] TCP connect failed");
+        #endif
+        return;
+    }
+
+    // Variable header: protocol "MQTT" level 4, flags, keepalive
+    uint8_t flags = 0x02;                                   // Clean session
+    if (willTopic[0] && willMessage) flags |= 0x04 | 0x08 | 0x20;    // Will, QoS 1, retain
+    if (username) flags |= 0x80;
+    if (username && password) flags |= 0x40;
+
+    // Payload fields (client id, will, credentials) have no fixed limit, so
+    // only the headers go through tx and the fields are written after it
+    const char* fields[5];
+    uint8_t fieldCount = 0;
+    fields[fieldCount++] = clientId;
+    if (flags & 0x04) {
+        fields[fieldCount++] = willTopic;
+        fields[fieldCount++] = willMessage;
+    }
+    if (flags & 0x80) fields[fieldCount++] = username;
+    if (flags & 0x40) fields[fieldCount++] = password;
+
+    uint32_t remaining = 10;            // Variable header
+    for (uint8_t i = 0; i < fieldCount; i++) {
+        size_t length = strlen(fields[i]);
+        if (length > 0xFFFF) {
+            Serial.printf("[MQTT] CONNECT field %u too long (%u bytes)\n", i, (unsigned)length);
+            drop("connect too large");
+            return;
+        }
+        remaining += 2 + length;
+    }
+
+    tx[0] = MQTT_CONNECT;
+    size_t n = 1 + encodeLength(tx + 1, remaining);
+    appendString(tx, sizeof(tx), n, "MQTT");
+    tx[n++] = 4;
+    tx[n++] = flags;
+    tx[n++] = MQTT_KEEPALIVE_S >> 8;
+    tx[n++] = MQTT_KEEPALIVE_S & 0xFF;
+
+    state = SESSION_CONNECTING;
+    connectStartMs = now;
+    rxPhase = 0;
+    if (!writeBytes(tx, n)) return;
+    for (uint8_t i = 0; i < fieldCount; i++) {
+        if (!writeString(fields[i])) return;
+    }
+}
+
+void MqttSession::drop(const char* reason) {
+    if (state == SESSION_CONNECTED) {
+        Serial.printf("[MQTT] Broker connection closed (%s), %u message(s) unacknowledged\n",
+            reason, inflight);
+    }
+    #ifdef DEBUG_MODE
+    else {
+        Serial.printf("[MQTT] Connection failed (%s)\n", reason);
+    }
+    #endif
+    client.stop();
+    state = SESSION_DISCONNECTED;
+    isConnected = false;
+    pingOutstanding = false;
+    rxPhase = 0;
+    coexScheduler.noteNetworkActivity();
+}
+
+// Incremental parser; true when a complete packet is in rx
+bool MqttSession::readPacket() {
+    while (client.available() > 0) {
+        int c = client.read();
+        if (c < 0) return false;
+        uint8_t b = (uint8_t)c;
+
+        if (rxPhase == 0) {
+            rxType = b;
+            rxLength = 0;
+            rxShift = 0;
+            rxPhase = 1;
+        } else if (rxPhase == 1) {
+            rxLength |= (uint32_t)(b & 0x7F) << rxShift;
+            rxShift += 7;
+            if (b & 0x80) {
+                if (rxShift > 21) {
+                    drop("malformed packet");
+                    return false;
+                }
+                continue;
+            }
+            rxReceived = 0;
+            rxPhase = 2;
+            if (rxLength == 0) {
+                rxPhase = 0;
+                return true;
+            }
+        } else {
+            // Oversized packets are read to the end and then ignored
+            if (rxReceived < sizeof(rx)) rx[rxReceived] = b;
+            rxReceived++;
+            if (rxReceived == rxLength) {
+                rxPhase = 0;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void MqttSession::handlePacket(unsigned long now) {
+    if (rxLength > sizeof(rx)) {
+        Serial.printf("[MQTT] Dropped incoming packet (%lu bytes)\n", (unsigned long)rxLength);
+        return;
+    }
+
+    switch (rxType & 0xF0) {
+        case MQTT_CONNACK:
+            if (state != SESSION_CONNECTING) break;
+            if (rxLength < 2 || rx[1] != 0) {
+                Serial.printf("[MQTT] Broker refused connection (rc=%d)\n", rxLength >= 2 ? rx[1] : -1);
+                drop("refused");
+                break;
+            }
+            state = SESSION_CONNECTED;
+            isConnected = true;
+            sessionId++;                // Unacknowledged messages go out again
+            subscribePending = subscriptionCount > 0;
+            stats.connects++;
+            Serial.printf("[MQTT] Broker connected after %lums uptime\n", clockMillis());
+            if (connectCallback) connectCallback();
+            break;
+
+        case MQTT_PUBACK: {
+            if (rxLength < 2) break;
+            uint16_t id = (rx[0] << 8) | rx[1];
+            uint16_t offset = tail;
+            for (uint8_t seen = 0; seen < inflight; ) {
+                offset = normalize(offset);
+                OutboxEntry* entry = entryAt(offset);
+                if (entry->state == ENTRY_INFLIGHT) {
+                    if (entry->packetId == id) {
+                        entry->state = ENTRY_DONE;
+                        inflight--;
+                        stats.acked++;
+                        telemetry.recordLatency(LATENCY_MQTT_ACK, (uint32_t)clockMicros() - entry->sentUs);
+                        releaseDone();
+                        break;
+                    }
+                    seen++;
+                }
+                offset = advance(offset);
+            }
+            break;
+        }
+
+        case MQTT_PUBLISH:
+            handlePublish();
+            break;
+
+        case MQTT_PINGRESP:
+            pingOutstanding = false;
+            break;
+
+        case MQTT_SUBACK:
+        default:
+            break;
+    }
+}
+
+// Incoming message: topic is moved down one byte to make room for the terminator
+void MqttSession::handlePublish() {
+    if (rxLength < 2) return;
+    uint16_t topicLength = (rx[0] << 8) | rx[1];
+    uint8_t qos = (rxType >> 1) & 0x03;
+    uint32_t payloadStart = 2 + topicLength + (qos ? 2 : 0);
+    if (payloadStart > rxLength) return;
+
+    if (qos == 1) {
+        uint8_t ack[4] = { MQTT_PUBACK, 2, rx[2 + topicLength], rx[3 + topicLength] };
+        if (!writeBytes(ack, sizeof(ack))) return;
+    }
+
+    char* topic = (char*)rx + 1;
+    memmove(topic, rx + 2, topicLength);
+    topic[topicLength] = '\0';
+    if (messageCallback) {
+        messageCallback(topic, rx + payloadStart, rxLength - payloadStart);
+    }
+}
+
+void MqttSession::sendSubscriptions() {
+    subscribePending = false;
+    for (uint8_t i = 0; i < subscriptionCount; i++) {
+        uint16_t id = nextPacketId++;
+        if (nextPacketId == 0) nextPacketId = 1;
+
+        // Packet id + topic + QoS after a fixed header of at most 3 bytes
+        size_t topicLength = strlen(subscriptions[i]);
+        uint32_t remaining = 2 + 2 + topicLength + 1;
+        if (4 + remaining > sizeof(tx)) {
+            Serial.printf("[MQTT] Subscription %s too long, skipped\n", subscriptions[i]);
+            continue;
+        }
+
+        tx[0] = MQTT_SUBSCRIBE;
+        size_t n = 1 + encodeLength(tx + 1, remaining);
+        tx[n++] = id >> 8;
+        tx[n++] = id & 0xFF;
+        appendString(tx, sizeof(tx), n, subscriptions[i]);
+        tx[n++] = 0;                    // Requested QoS
+        if (!writeBytes(tx, n)) return;
+    }
+}
+
+bool MqttSession::writePublish(OutboxEntry* entry, bool dup) {
+    uint8_t qos = entry->flags & ENTRY_QOS_MASK;
+    const uint8_t* data = (const uint8_t*)(entry + 1);
+    uint32_t remaining = 2 + entry->topicLength + (qos ? 2 : 0) + entry->payloadLength;
+
+    tx[0] = MQTT_PUBLISH | (dup ? 0x08 : 0) | (qos << 1) | ((entry->flags & ENTRY_RETAIN) ? 1 : 0);
+    size_t n = 1 + encodeLength(tx + 1, remaining);
+    tx[n++] = entry->topicLength >> 8;
+    tx[n++] = entry->topicLength & 0xFF;
+    memcpy(tx + n, data, entry->topicLength);
+    n += entry->topicLength;
+    if (qos) {
+        tx[n++] = entry->packetId >> 8;
+        tx[n++] = entry->packetId & 0xFF;
+    }
+
+    if (!writeBytes(tx, n)) return false;
+    if (entry->payloadLength > 0) {
+        return writeBytes(data + entry->topicLength, entry->payloadLength);
+    }
+    return true;
+}
+
+// Anything to transmit or possibly retransmit (inflight is only written by
+// the I/O task, which is the caller)
+bool MqttSession::outboxPending() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool pending = unsent > 0;
+    xSemaphoreGive(lock);
+    return pending || inflight > 0;
+}
+
+// Asked at most once per service pass, and only if a bulk entry is due
+bool MqttSession::bulkAllowed() {
+    if (bulkGate < 0) bulkGate = coexScheduler.allowBulkWork() ? 1 : 0;
+    return bulkGate;
+}
+
+// First transmission in FIFO order; QoS 1 limited by the inflight window. A
+// bulk entry outside a quiet window holds back the entries behind it, at
+// most COEX_MAX_DEFER_MS.
+void MqttSession::sendQueued(unsigned long now) {
+    while (state == SESSION_CONNECTED) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        bool pending = unsent > 0;
+        xSemaphoreGive(lock);
+        if (!pending) return;
+
+        cursor = normalize(cursor);
+        OutboxEntry* entry = entryAt(cursor);
+        uint8_t qos = entry->flags & ENTRY_QOS_MASK;
+        if (qos && inflight >= MQTT_INFLIGHT_WINDOW) return;
+        if ((entry->flags & ENTRY_BULK) && !bulkAllowed()) return;
+
+        if (qos) {
+            entry->packetId = nextPacketId++;
+            if (nextPacketId == 0) nextPacketId = 1;
+        }
+        if (!writePublish(entry, false)) return;
+
+        uint32_t nowUs = (uint32_t)clockMicros();
+        telemetry.recordLatency(LATENCY_MQTT_SEND, nowUs - entry->queuedUs);
+        entry->sentUs = nowUs;
+        entry->lastSendMs = now;
+        entry->session = sessionId;
+        entry->state = qos ? ENTRY_INFLIGHT : ENTRY_DONE;
+        if (qos) {
+            inflight++;
+            if (inflight > stats.inflightPeak) stats.inflightPeak = inflight;
+        }
+        stats.sent++;
+        cursor = advance(cursor);
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        unsent--;
+        xSemaphoreGive(lock);
+        if (!qos) releaseDone();
+    }
+}
+
+// Resend unacknowledged QoS 1 messages after a timeout or a reconnect
+void MqttSession::retransmit(unsigned long now) {
+    uint16_t offset = tail;
+    for (uint8_t seen = 0; seen < inflight && state == SESSION_CONNECTED; ) {
+        offset = normalize(offset);
+        OutboxEntry* entry = entryAt(offset);
+        if (entry->state == ENTRY_INFLIGHT) {
+            seen++;
+            bool due = entry->session != sessionId || now - entry->lastSendMs >= MQTT_RETRANSMIT_MS;
+            if (due && (!(entry->flags & ENTRY_BULK) || bulkAllowed())) {
+                if (!writePublish(entry, true)) return;
+                entry->session = sessionId;
+                entry->lastSendMs = now;
+                stats.retransmits++;
+            }
+        }
+        offset = advance(offset);
+    }
+}
+
+void MqttSession::keepalive(unsigned long now) {
+    const unsigned long intervalMs = MQTT_KEEPALIVE_S * 1000UL;
+    if (pingOutstanding) {
+        if (now - pingSentMs > intervalMs) {
+            drop("keepalive timeout");
+        }
+        return;
+    }
+    if (now - lastOutMs >= intervalMs) {
+        uint8_t ping[2] = { MQTT_PINGREQ, 0 };
+        if (writeBytes(ping, sizeof(ping))) {
+            pingOutstanding = true;
+            pingSentMs = now;
+        }
+    }
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+void MqttSession::printStats() {
+    Serial.printf("[TELEMETRY]   mqtt queued=%lu sent=%lu acked=%lu retx=%lu dropped=%lu "
+        "connects=%lu inflight_peak=%u outbox_peak=%uB\n",
+        (unsigned long)stats.queued, (unsigned long)stats.sent, (unsigned long)stats.acked,
+        (unsigned long)stats.retransmits, (unsigned long)stats.dropped,
+        (unsigned long)stats.connects, stats.inflightPeak, stats.outboxPeak);
+}
+
+// "mqtt":{...}; returns the number of characters written
+size_t MqttSession::formatStats(char* buf, size_t len) {
+    if (len == 0) return 0;
+    size_t pos = snprintf(buf, len,
+        "\"mqtt\":{\"queued\":%lu,\"sent\":%lu,\"acked\":%lu,\"retx\":%lu,\"drop\":%lu,"
+        "\"connects\":%lu,\"inflight_peak\":%u,\"outbox_peak\":%u}",
+        (unsigned long)stats.queued, (unsigned long)stats.sent, (unsigned long)stats.acked,
+        (unsigned long)stats.retransmits, (unsigned long)stats.dropped,
+        (unsigned long)stats.connects, stats.inflightPeak, stats.outboxPeak);
+    return pos < len ? pos : len;
+}
+
+#endif // MQTT_ENABLED
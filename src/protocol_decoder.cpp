@@ -0,0 +1,107 @@
+#include "protocol_decoder.h"
+
+// ============================================================================
+// BM6 - intAct Battery Guard
+// ============================================================================
+static uint8_t bm6BuildHandshake(const DeviceConfig* config, uint8_t commands[][16]) {
+    static const uint8_t sequence[6][16] = {
+        // Write #1: Session Init
+        {0xD1, 0x55, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        // Write #2: Battery Type (byte 3 filled in below)
+        {0xD1, 0x55, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        // Write #3: Config 0x1E
+        {0xD1, 0x55, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        // Write #4: Config 0xCA94
+        {0xD1, 0x55, 0x05, 0x00, 0x00, 0x00, 0x00, 0xCA, 0x94, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        // Write #5: Pre-finalization
+        {0xD1, 0x55, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        // Write #6: Finalization
+        {0xD1, 0x55, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
+    };
+    memcpy(commands, sequence, sizeof(sequence));
+    commands[1][3] = config->type;
+    return 6;
+}
+
+// Based on Android app analysis
+static bool bm6Parse(const uint8_t* frame, DecodedSample& out) {
+    if (frame[0] != 0xD1 || frame[1] != 0x55) return false;
+    
+    // Byte 3: Temperature sign (1 = negative), Byte 4: Temperature value
+    out.temperature = (frame[3] == 1) ? -(int8_t)frame[4] : (int8_t)frame[4];
+    out.status = frame[5];
+    out.soc = frame[6];
+    out.voltage = ((frame[7] << 8) | frame[8]) / 100.0f;
+    out.rapidVoltageRise = (frame[9] << 8) | frame[10];
+    out.rapidVoltageDrop = (frame[11] << 8) | frame[12];
+    return true;
+}
+
+// ============================================================================
+// BM2 - Ancel BM300 Pro
+// ============================================================================
+// Streams data as soon as notifications are enabled
+static uint8_t bm2BuildHandshake(const DeviceConfig* config, uint8_t commands[][16]) {
+    (void)config;
+    (void)commands;
+    return 0;
+}
+
+// BM2 status nibble: 0 = battery ok, 1 = low voltage, 2 = charging. Mapped
+// onto the BM6 codes every consumer reads (low voltage is "not charging";
+// like on BM6, voltage/SOC carry the health). Other nibbles (3-15) don't
+// collide with those codes and are passed on as-is ("Charge: 0x0N").
+static uint8_t bm2Status(uint8_t nibble) {
+    switch (nibble) {
+        case 0:
+        case 1:  return STATUS_NORMAL;
+        case 2:  return STATUS_CHARGING;
+        default: return nibble;
+    }
+}
+
+// Byte 0: 0xF5, bytes 1-2: voltage (12 bits, 1/100 V) + status nibble, byte 3: SOC
+static bool bm2Parse(const uint8_t* frame, DecodedSample& out) {
+    if (frame[0] != 0xF5) return false;
+    
+    out.temperature = 0;
+    out.status = bm2Status(frame[2] & 0x0F);
+    out.soc = frame[3];
+    out.voltage = ((frame[1] << 4) | (frame[2] >> 4)) / 100.0f;
+    out.rapidVoltageRise = 0;
+    out.rapidVoltageDrop = 0;
+    return true;
+}
+
+// ============================================================================
+// Registry (index = ProtocolId)
+// ============================================================================
+static const ProtocolDecoder DECODERS[PROTOCOL_COUNT] = {
+    {   // PROTOCOL_BM6
+        "BM6", "Battery Guard",
+        "0000fff0-0000-1000-8000-00805f9b34fb",
+        "0000fff3-0000-1000-8000-00805f9b34fb",
+        "0000fff4-0000-1000-8000-00805f9b34fb",
+        5,  // First 5 notifications contain invalid data (e.g. 61°C)
+        bm6BuildHandshake, bm6Parse
+    },
+    {   // PROTOCOL_BM2
+        "BM2", "Battery Monitor",
+        "0000fff0-0000-1000-8000-00805f9b34fb",
+        nullptr,  // No handshake, nothing to write
+        "0000fff4-0000-1000-8000-00805f9b34fb",
+        0,
+        bm2BuildHandshake, bm2Parse
+    }
+};
+
+const ProtocolDecoder* decoderFor(ProtocolId protocol) {
+    return (protocol < PROTOCOL_COUNT) ? &DECODERS[protocol] : &DECODERS[PROTOCOL_BM6];
+}
+
+const ProtocolDecoder* decoderForAdvertisedName(const char* name) {
+    for (uint8_t i = 0; i < PROTOCOL_COUNT; i++) {
+        if (strcmp(DECODERS[i].advertisedName, name) == 0) return &DECODERS[i];
+    }
+    return nullptr;
+}
@@ -0,0 +1,109 @@
+#include "sample_bus.h"
+#include "types.h"
+#include "clock_source.h"
+
+#ifdef LCD_ENABLED
+  #include "tft_display.h"
+#endif
+
+#ifdef MQTT_ENABLED
+  #include "mqtt_client.h"
+#endif
+
+#ifdef INFLUX_ENABLED
+  #include "influx_writer.h"
+#endif
+
+#ifdef UDP_ENABLED
+  #include "udp_streamer.h"
+#endif
+
+// ============================================================================
+// Serial
+// ============================================================================
+const char* const SerialSink::NAME = "serial";
+SinkStats SerialSink::stats = {0, 0};
+
+bool SerialSink::consume(const SampleRecord& record) {
+    const DeviceConfig* config = record.monitor->config;
+    
+    // ALWAYS log parsed bytes for debugging status issues
+    Serial.printf("[PARSE] %s: Byte[4]=Temp:%d°C | Byte[5]=Status:0x%02X(%s) | Byte[6]=SOC:%d%% | Byte[7-8]=V:%.2f | Byte[9-10]=VRise:%d | Byte[11-12]=VDrop:%d\n",
+        config->name,
+        record.temperature,
+        record.status, getBatteryStatusText(record.status),
+        record.soc,
+        record.voltage,
+        record.rapidVoltageRise,
+        record.rapidVoltageDrop);
+    
+    // Summary log output
+    Serial.printf("%s (%s): %.2fV | %d%% | %d°C | %s | VRise:%d | VDrop:%d\n",
+        config->name, config->serial,
+        record.voltage, record.soc, record.temperature, getBatteryStatusText(record.status),
+        record.rapidVoltageRise, record.rapidVoltageDrop);
+    return true;
+}
+
+// ============================================================================
+// LCD
+// ============================================================================
+#ifdef LCD_ENABLED
+// Shared with the display task (defined in main.cpp)
+extern DeviceDisplayData g_displayData[MAX_MONITORS];
+
+const char* const LcdSink::NAME = "lcd";
+SinkStats LcdSink::stats = {0, 0};
+
+bool LcdSink::consume(const SampleRecord& record) {
+    if (record.monitorIndex >= MAX_MONITORS) return false;
+    
+    DeviceDisplayData& slot = g_displayData[record.monitorIndex];
+    slot.active = true;
+    slot.connected = (record.monitor->state == STATE_MONITORING);
+    strncpy(slot.name, record.monitor->config->name, sizeof(slot.name) - 1);
+    slot.voltage = record.voltage;
+    slot.soc = record.soc;
+    slot.temperature = record.temperature;
+    slot.status = record.status;
+    slot.lastUpdate = clockMillis();
+    return true;
+}
+#endif
+
+// ============================================================================
+// MQTT
+// ============================================================================
+#ifdef MQTT_ENABLED
+const char* const MqttSink::NAME = "mqtt";
+SinkStats MqttSink::stats = {0, 0};
+
+bool MqttSink::consume(const SampleRecord& record) {
+    // Copied into the client's per-slot buffer; NetworkTask publishes from it
+    return mqttClient.storeSample(record);
+}
+#endif
+
+// ============================================================================
+// InfluxDB
+// ============================================================================
+#ifdef INFLUX_ENABLED
+const char* const InfluxSink::NAME = "influx";
+SinkStats InfluxSink::stats = {0, 0};
+
+bool InfluxSink::consume(const SampleRecord& record) {
+    return influxWriter.add(record);
+}
+#endif
+
+// ============================================================================
+// UDP
+// ============================================================================
+#ifdef UDP_ENABLED
+const char* const UdpSink::NAME = "udp";
+SinkStats UdpSink::stats = {0, 0};
+
+bool UdpSink::consume(const SampleRecord& record) {
+    return udpStreamer.update(record);
+}
+#endif
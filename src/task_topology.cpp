@@ -0,0 +1,48 @@
+#include "task_topology.h"
+
+// ============================================================================
+// Task Topology Table
+// ============================================================================
+// Default layout for dual-core ESP32: BLE processing on core 1 next to the
+// Arduino loop, network/display/storage on core 0 next to the WiFi stack.
+const TaskSpec TASK_TOPOLOGY[TASK_ROLE_COUNT] = {
+    // name           core  prio  stack
+    { "loopTask",      1,    1,   8192 },   // TASK_CONTROL (framework-created)
+    { "SampleTask",    1,    3,   4096 },   // TASK_SAMPLES
+    { "NetworkTask",   0,    1,   6144 },   // TASK_NETWORK
+    { "MqttIoTask",    0,    2,   8192 },   // TASK_MQTT_IO (TLS handshake)
+    { "DisplayTask",   0,    1,   4096 },   // TASK_DISPLAY
+    { "StorageTask",   0,    1,   3072 },   // TASK_STORAGE
+    { "InfluxTask",    0,    1,   4096 },   // TASK_INFLUX
+    { "UdpTask",       0,    1,   3072 },   // TASK_UDP
+};
+
+bool startTask(TaskRole role, TaskFunction_t fn, void* param, TaskHandle_t* handle) {
+    const TaskSpec& spec = TASK_TOPOLOGY[role];
+    
+    BaseType_t core = tskNO_AFFINITY;
+    if (spec.core >= 0) {
+        core = (spec.core < portNUM_PROCESSORS) ? spec.core : 0;
+    }
+    #ifdef TASK_SINGLE_CORE
+    core = 0;  // Single-core placement on a dual-core board, for comparison
+    #endif
+    
+    BaseType_t result = xTaskCreatePinnedToCore(
+        fn, spec.name, spec.stackBytes, param, spec.priority, handle, core);
+    
+    if (result != pdPASS) {
+        Serial.printf("[TASK] ERROR: Could not create %s\n", spec.name);
+        return false;
+    }
+    
+    // The core the task actually got (-1 = unpinned)
+    Serial.printf("[TASK] %s started (core %d, prio %d, stack %lu)\n",
+        spec.name, core == tskNO_AFFINITY ? -1 : (int)core, spec.priority,
+        (unsigned long)spec.stackBytes);
+    return true;
+}
+
+void applyControlTaskPriority() {
+    vTaskPrioritySet(NULL, TASK_TOPOLOGY[TASK_CONTROL].priority);
+}
@@ -0,0 +1,224 @@
+#include "telemetry.h"
+#include <esp_heap_caps.h>
+#include "clock_source.h"
+#include "sample_bus.h"
+#ifdef MQTT_ENABLED
+  #include "mqtt_client.h"
+#endif
+
+#ifdef INFLUX_ENABLED
+  #include "influx_writer.h"
+#endif
+
+#ifdef UDP_ENABLED
+  #include "udp_streamer.h"
+#endif
+
+// Global instance
+Telemetry telemetry;
+
+// Guards the latency accumulators (written from several tasks)
+static portMUX_TYPE latencyMux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* const LATENCY_NAMES[LATENCY_STAGE_COUNT] = { "parse", "publish", "rules", "mqtt_send", "mqtt_ack" };
+
+// Scratch buffer for uxTaskGetSystemState (kept off the loop stack)
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t taskStatus[TELEMETRY_MAX_TASKS];
+#endif
+
+Telemetry::Telemetry() :
+    taskCount(0), heap(), haveRunTimeStats(false),
+    prevCount(0), prevTotalRunTime(0) {
+    coreLoadPercent[0] = 0;
+    coreLoadPercent[1] = 0;
+    for (uint8_t i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        latency[i] = LatencyTelemetry();
+        latencyCount[i] = 0;
+        latencySumUs[i] = 0;
+        latencyMaxUs[i] = 0;
+    }
+}
+
+void Telemetry::recordLatency(LatencyStage stage, uint32_t us) {
+    portENTER_CRITICAL(&latencyMux);
+    latencyCount[stage]++;
+    latencySumUs[stage] += us;
+    if (us > latencyMaxUs[stage]) latencyMaxUs[stage] = us;
+    portEXIT_CRITICAL(&latencyMux);
+}
+
+void Telemetry::sample() {
+    portENTER_CRITICAL(&latencyMux);
+    for (uint8_t i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        latency[i].count = latencyCount[i];
+        latency[i].avgUs = latencyCount[i] ? (uint32_t)(latencySumUs[i] / latencyCount[i]) : 0;
+        latency[i].maxUs = latencyMaxUs[i];
+        latencyCount[i] = 0;
+        latencySumUs[i] = 0;
+        latencyMaxUs[i] = 0;
+    }
+    portEXIT_CRITICAL(&latencyMux);
+    
+    heap.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap.minFreeBytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    
+#if configUSE_TRACE_FACILITY
+    uint32_t totalRunTime = 0;
+    UBaseType_t count = uxTaskGetSystemState(taskStatus, TELEMETRY_MAX_TASKS, &totalRunTime);
+    
+    #if configGENERATE_RUN_TIME_STATS
+    haveRunTimeStats = true;
+    #endif
+    
+    uint32_t totalDelta = totalRunTime - prevTotalRunTime;
+    uint32_t nextTaskNumber[TELEMETRY_MAX_TASKS];
+    uint32_t nextRunTime[TELEMETRY_MAX_TASKS];
+    uint32_t idleShare[2] = {0, 0};
+    
+    taskCount = 0;
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& st = taskStatus[i];
+        TaskTelemetry& t = tasks[taskCount++];
+        
+        strncpy(t.name, st.pcTaskName, sizeof(t.name) - 1);
+        t.name[sizeof(t.name) - 1] = '\0';
+        t.taskNumber = st.xTaskNumber;
+        t.core = (st.xCoreID == tskNO_AFFINITY) ? -1 : (int8_t)st.xCoreID;
+        t.priority = (uint8_t)st.uxCurrentPriority;
+        t.stackFreeBytes = st.usStackHighWaterMark;  // ESP-IDF reports bytes
+        
+        // CPU share from run-time counter delta against the previous sample
+        t.cpuPercent = 0;
+        if (haveRunTimeStats && totalDelta > 0) {
+            for (uint8_t p = 0; p < prevCount; p++) {
+                if (prevTaskNumber[p] == st.xTaskNumber) {
+                    uint32_t delta = st.ulRunTimeCounter - prevRunTime[p];
+                    uint32_t pct = (uint32_t)((uint64_t)delta * 100 / totalDelta);
+                    t.cpuPercent = pct > 100 ? 100 : pct;
+                    break;
+                }
+            }
+        }
+        if (strncmp(t.name, "IDLE", 4) == 0 && t.core >= 0 && t.core < 2) {
+            idleShare[t.core] = t.cpuPercent;
+        }
+        
+        nextTaskNumber[i] = st.xTaskNumber;
+        nextRunTime[i] = st.ulRunTimeCounter;
+    }
+    
+    memcpy(prevTaskNumber, nextTaskNumber, count * sizeof(uint32_t));
+    memcpy(prevRunTime, nextRunTime, count * sizeof(uint32_t));
+    prevCount = count;
+    prevTotalRunTime = totalRunTime;
+    
+    if (haveRunTimeStats && totalDelta > 0) {
+        for (uint8_t c = 0; c < portNUM_PROCESSORS && c < 2; c++) {
+            coreLoadPercent[c] = 100 - idleShare[c];
+        }
+    }
+#else
+    // Without the trace facility only the calling (loop) task can be sampled
+    taskCount = 1;
+    strncpy(tasks[0].name, "loopTask", sizeof(tasks[0].name));
+    tasks[0].taskNumber = 0;
+    tasks[0].core = xPortGetCoreID();
+    tasks[0].priority = 1;
+    tasks[0].cpuPercent = 0;
+    tasks[0].stackFreeBytes = uxTaskGetStackHighWaterMark(NULL);
+#endif
+}
+
+void Telemetry::printSerial() const {
+    Serial.printf("[TELEMETRY] Heap free=%lu min=%lu largest=%lu",
+        (unsigned long)heap.freeBytes, (unsigned long)heap.minFreeBytes,
+        (unsigned long)heap.largestBlock);
+    if (haveRunTimeStats) {
+        Serial.printf(" | Core0=%d%% Core1=%d%%", coreLoadPercent[0], coreLoadPercent[1]);
+    }
+    Serial.println("");
+    
+    for (uint8_t i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        Serial.printf("[TELEMETRY]   latency %-8s n=%lu avg=%luus max=%luus\n", LATENCY_NAMES[i],
+            (unsigned long)latency[i].count, (unsigned long)latency[i].avgUs,
+            (unsigned long)latency[i].maxUs);
+    }
+    
+    for (uint8_t i = 0; i < taskCount; i++) {
+        const TaskTelemetry& t = tasks[i];
+        if (haveRunTimeStats) {
+            Serial.printf("[TELEMETRY]   %-16s core=%2d prio=%2d cpu=%3d%% stackFree=%lu\n",
+                t.name, t.core, t.priority, t.cpuPercent, (unsigned long)t.stackFreeBytes);
+        } else {
+            Serial.printf("[TELEMETRY]   %-16s core=%2d prio=%2d stackFree=%lu\n",
+                t.name, t.core, t.priority, (unsigned long)t.stackFreeBytes);
+        }
+    }
+}
+
+size_t Telemetry::formatJson(char* buf, size_t len) const {
+    size_t pos = snprintf(buf, len,
+        "{\"uptime_s\":%lu,\"heap_free\":%lu,\"heap_min\":%lu,\"heap_largest\":%lu,"
+        "\"core0\":%d,\"core1\":%d,\"tasks\":{",
+        clockMillis() / 1000,
+        (unsigned long)heap.freeBytes, (unsigned long)heap.minFreeBytes,
+        (unsigned long)heap.largestBlock, coreLoadPercent[0], coreLoadPercent[1]);
+    
+    for (uint8_t i = 0; i < taskCount && pos < len; i++) {
+        const TaskTelemetry& t = tasks[i];
+        pos += snprintf(buf + pos, len - pos, "%s\"%s\":{\"cpu\":%d,\"stack\":%lu,\"core\":%d}",
+            i ? "," : "", t.name, t.cpuPercent, (unsigned long)t.stackFreeBytes, t.core);
+    }
+    if (pos < len) {
+        pos += snprintf(buf + pos, len - pos, "},\"latency_us\":{");
+    }
+    for (uint8_t i = 0; i < LATENCY_STAGE_COUNT && pos < len; i++) {
+        pos += snprintf(buf + pos, len - pos, "%s\"%s\":{\"avg\":%lu,\"max\":%lu}",
+            i ? "," : "", LATENCY_NAMES[i], (unsigned long)latency[i].avgUs,
+            (unsigned long)latency[i].maxUs);
+    }
+    if (pos < len) {
+        pos += snprintf(buf + pos, len - pos, "},\"sinks\":{");
+    }
+    if (pos < len) {
+        pos += SampleBus::formatStats(buf + pos, len - pos, true);
+    }
+    if (pos < len) {
+        pos += snprintf(buf + pos, len - pos, "}");
+    }
+    #ifdef MQTT_ENABLED
+    if (pos < len) {
+        pos += snprintf(buf + pos, len - pos, ",");
+    }
+    if (pos < len) {
+        pos += mqttClient.formatSessionStats(buf + pos, len - pos);
+    }
+    #endif
+    #ifdef INFLUX_ENABLED
+    if (pos < len) {
+        pos += snprintf(buf + pos, len - pos, ",");
+    }
+    if (pos < len) {
+        pos += influxWriter.formatStats(buf + pos, len - pos);
+    }
+    #endif
+    #ifdef UDP_ENABLED
+    if (pos < len) {
+        pos += snprintf(buf + pos, len - pos, ",");
+    }
+    if (pos < len) {
+        pos += udpStreamer.formatStats(buf + pos, len - pos);
+    }
+    #endif
+    if (pos < len) {
+        pos += snprintf(buf + pos, len - pos, "}");
+    }
+    if (pos >= len) {
+        // Cut off mid-object - invalid JSON, don't hand it out
+        Serial.printf("[TELEMETRY] JSON needs more than %u bytes, not published\n", (unsigned)len);
+        return 0;
+    }
+    return pos;
+}
@@ -1,4 +1,6 @@
 #include "tft_display.h"
+#include "task_topology.h"
+#include "clock_source.h"
 
 #ifdef LCD_ENABLED
 
@@ -125,10 +127,10 @@ void drawDevice(int index, int yPos) {
 
 // Display task - runs on Core 0
 void displayTask(void* parameter) {
-    Serial.println("[DISPLAY] Task started on Core 0");
+    Serial.printf("[DISPLAY] Task started on Core %d\n", xPortGetCoreID());
     
-    // Initialize display on Core 0 (thread-safe)
-    Serial.println("[DISPLAY] Initializing TFT on Core 0...");
+    // Initialize display inside the display task (thread-safe)
+    Serial.println("[DISPLAY] Initializing TFT...");
     tft.init();
     tft.setRotation(0);
     tft.fillScreen(TFT_BLACK);
@@ -147,7 +149,7 @@ void displayTask(void* parameter) {
     bool startupShown = true;
     
     while (true) {
-        unsigned long now = millis();
+        unsigned long now = clockMillis();
         
         // Update display every DISPLAY_UPDATE_INTERVAL_MS
         if (now - lastUpdate >= DISPLAY_UPDATE_INTERVAL_MS) {
@@ -208,19 +210,9 @@ void displayTask(void* parameter) {
     }
 }
 
-// Start the display task on Core 0
+// Start the display task (core/priority/stack from TASK_TOPOLOGY)
 void startDisplayTask() {
-    xTaskCreatePinnedToCore(
-        displayTask,           // Task function
-        "DisplayTask",         // Task name
-        4096,                  // Stack size (bytes)
-        NULL,                  // Parameter
-        1,                     // Priority
-        &displayTaskHandle,    // Task handle
-        0                      // Core 0
-    );
-    
-    Serial.println("[DISPLAY] Task created on Core 0");
+    startTask(TASK_DISPLAY, displayTask, NULL, &displayTaskHandle);
 }
 
 #endif // LCD_ENABLED
@@ -0,0 +1,374 @@
+#if defined(MQTT_ENABLED) && defined(MQTT_TLS)
+
+#include "tls_client.h"
+#include <mbedtls/net_sockets.h>
+#include <esp_heap_caps.h>
+#include "clock_source.h"
+
+#define TLS_STORE_MAGIC 0x42475453  // "BGTS"
+
+// Serialized session, kept across software/watchdog resets
+struct TlsSessionStore {
+    uint32_t magic;
+    uint32_t length;
+    uint8_t data[TLS_SESSION_STORE];
+    uint32_t checksum;
+};
+
+static RTC_NOINIT_ATTR TlsSessionStore sessionStore;
+
+// FNV-1a over the used part of the store
+static uint32_t storeChecksum(const TlsSessionStore& store) {
+    uint32_t hash = 2166136261u;
+    const uint8_t* p = (const uint8_t*)&store.length;
+    for (size_t i = 0; i < sizeof(store.length); i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    for (size_t i = 0; i < store.length && i < sizeof(store.data); i++) {
+        hash = (hash ^ store.data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+TlsClient::TlsClient() :
+    caCert(nullptr),
+    initialized(false),
+    established(false),
+    peeked(-1),
+    haveSession(false),
+    certificateSeen(false) {
+    memset(&fullStats, 0, sizeof(fullStats));
+    memset(&resumedStats, 0, sizeof(resumedStats));
+}
+
+// ============================================================================
+// Setup (once; the contexts are reused for every connection)
+// ============================================================================
+
+bool TlsClient::setup() {
+    if (initialized) return true;
+
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_x509_crt_init(&ca);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_session_init(&session);
+
+    static const char PERSONALIZATION[] = "batteryguard-mqtt";
+    int ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+        (const unsigned char*)PERSONALIZATION, sizeof(PERSONALIZATION) - 1);
+    if (ret != 0) {
+        Serial.printf("[TLS] ERROR: RNG seed failed (-0x%04x)\n", -ret);
+        return false;
+    }
+
+    ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT,
+        MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        Serial.printf("[TLS] ERROR: Config failed (-0x%04x)\n", -ret);
+        return false;
+    }
+
+    if (caCert) {
+        ret = mbedtls_x509_crt_parse(&ca, (const unsigned char*)caCert, strlen(caCert) + 1);
+        if (ret != 0) {
+            Serial.printf("[TLS] ERROR: CA certificate invalid (-0x%04x)\n", -ret);
+            return false;
+        }
+        mbedtls_ssl_conf_ca_chain(&conf, &ca, nullptr);
+        mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+        // Optional: the certificate is still parsed (see onVerify), failures ignored
+        Serial.println("[TLS] WARNING: No CA certificate, broker is not verified");
+        mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_OPTIONAL);
+    }
+    mbedtls_ssl_conf_verify(&conf, onVerify, this);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+    #if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    #endif
+
+    // Record buffers are allocated here, once
+    size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    ret = mbedtls_ssl_setup(&ssl, &conf);
+    if (ret != 0) {
+        Serial.printf("[TLS] ERROR: SSL setup failed (-0x%04x)\n", -ret);
+        return false;
+    }
+    Serial.printf("[TLS] Context ready, record buffers %luB\n",
+        (unsigned long)(heapBefore - heap_caps_get_free_size(MALLOC_CAP_8BIT)));
+    mbedtls_ssl_set_bio(&ssl, &tcp, bioSend, bioRecv, nullptr);
+
+    restoreSession();
+    initialized = true;
+    return true;
+}
+
+// ============================================================================
+// mbedTLS Callbacks (certificate check, non-blocking socket I/O)
+// ============================================================================
+
+// Called per certificate of the chain - only on full handshakes, a resumed
+// session skips the Certificate message
+int TlsClient::onVerify(void* ctx, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+    (void)crt;
+    (void)depth;
+    (void)flags;
+    ((TlsClient*)ctx)->certificateSeen = true;
+    return 0;                   // Keep mbedTLS's own verdict in flags
+}
+
+int TlsClient::bioSend(void* ctx, const unsigned char* buf, size_t len) {
+    WiFiClient* tcp = (WiFiClient*)ctx;
+    size_t written = tcp->write(buf, len);
+    return written > 0 ? (int)written : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+int TlsClient::bioRecv(void* ctx, unsigned char* buf, size_t len) {
+    WiFiClient* tcp = (WiFiClient*)ctx;
+    int available = tcp->available();
+    if (available <= 0) {
+        return tcp->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    int n = tcp->read(buf, len < (size_t)available ? len : (size_t)available);
+    return n > 0 ? n : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+// ============================================================================
+// Connection
+// ============================================================================
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+    if (!setup()) return 0;
+    stop();
+
+    size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    unsigned long start = clockMillis();
+
+    if (!tcp.connect(host, port)) {
+        return 0;
+    }
+    mbedtls_ssl_set_hostname(&ssl, host);
+
+    // Offer the cached session; the server decides whether to resume
+    bool offered = haveSession && mbedtls_ssl_set_session(&ssl, &session) == 0;
+    certificateSeen = false;
+
+    int ret;
+    while ((ret = mbedtls_ssl_handshake(&ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            fail("Handshake failed", ret);
+            if (offered) {
+                // Next attempt is a full handshake, in case the server chokes on the session
+                haveSession = false;
+                sessionStore.magic = 0;
+            }
+            return 0;
+        }
+        if (clockMillis() - start > TLS_HANDSHAKE_TIMEOUT_MS) {
+            fail("Handshake timeout", ret);
+            return 0;
+        }
+        clockDelay(2);
+    }
+
+    bool resumed = offered && !certificateSeen;
+    cacheSession();
+
+    uint32_t elapsed = clockMillis() - start;
+    size_t heapAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    TlsHandshakeStats& stats = resumed ? resumedStats : fullStats;
+    stats.count++;
+    stats.lastMs = elapsed;
+    if (elapsed > stats.maxMs) stats.maxMs = elapsed;
+    stats.lastHeapBytes = heapBefore > heapAfter ? heapBefore - heapAfter : 0;
+
+    Serial.printf("[TLS] %s handshake %lums, connection holds %luB heap (free %luB, min %luB)\n",
+        resumed ? "Resumed" : "Full", (unsigned long)elapsed, (unsigned long)stats.lastHeapBytes,
+        (unsigned long)heapAfter, (unsigned long)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+
+    established = true;
+    return 1;
+}
+
+void TlsClient::fail(const char* what, int ret) {
+    Serial.printf("[TLS] %s (-0x%04x)\n", what, -ret);
+    tcp.stop();
+    mbedtls_ssl_session_reset(&ssl);
+    established = false;
+    peeked = -1;
+}
+
+// Keep the negotiated session (new ticket if the server issued one)
+void TlsClient::cacheSession() {
+    mbedtls_ssl_session fresh;
+    mbedtls_ssl_session_init(&fresh);
+    if (mbedtls_ssl_get_session(&ssl, &fresh) != 0) {
+        mbedtls_ssl_session_free(&fresh);
+        return;
+    }
+
+    mbedtls_ssl_session_free(&session);
+    session = fresh;            // Takes ownership of fresh's buffers
+    haveSession = true;
+    storeSession();
+}
+
+void TlsClient::stop() {
+    if (established) {
+        mbedtls_ssl_close_notify(&ssl);     // Best effort
+    }
+    tcp.stop();
+    if (initialized) {
+        mbedtls_ssl_session_reset(&ssl);    // Keeps the record buffers allocated
+    }
+    established = false;
+    peeked = -1;
+}
+
+uint8_t TlsClient::connected() {
+    return established && tcp.connected();
+}
+
+// ============================================================================
+// Data
+// ============================================================================
+
+int TlsClient::available() {
+    if (!established) return 0;
+    int pending = (peeked >= 0) ? 1 : 0;
+
+    size_t buffered = mbedtls_ssl_get_bytes_avail(&ssl);
+    if (buffered == 0) {
+        // Process whatever arrived on the socket without consuming data
+        int ret = mbedtls_ssl_read(&ssl, nullptr, 0);
+        if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            if (ret != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+                Serial.printf("[TLS] Read failed (-0x%04x)\n", -ret);
+            }
+            stop();
+            return pending;
+        }
+        buffered = mbedtls_ssl_get_bytes_avail(&ssl);
+    }
+    return pending + (int)buffered;
+}
+
+int TlsClient::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+    if (size == 0) return 0;
+    size_t n = 0;
+    if (peeked >= 0) {
+        buf[n++] = (uint8_t)peeked;
+        peeked = -1;
+    }
+    if (n < size && established && mbedtls_ssl_get_bytes_avail(&ssl) > 0) {
+        int ret = mbedtls_ssl_read(&ssl, buf + n, size - n);
+        if (ret > 0) n += ret;
+    }
+    return n > 0 ? (int)n : -1;
+}
+
+int TlsClient::peek() {
+    if (peeked < 0 && available() > 0) {
+        peeked = read();
+    }
+    return peeked;
+}
+
+size_t TlsClient::write(uint8_t b) {
+    return write(&b, 1);
+}
+
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+    if (!established) return 0;
+    size_t sent = 0;
+    unsigned long start = clockMillis();
+    while (sent < size) {
+        int ret = mbedtls_ssl_write(&ssl, buf + sent, size - sent);
+        if (ret > 0) {
+            sent += ret;
+        } else if ((ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) &&
+                   clockMillis() - start < TLS_WRITE_TIMEOUT_MS) {
+            clockDelay(1);
+        } else {
+            Serial.printf("[TLS] Write failed (-0x%04x)\n", -ret);
+            stop();
+            break;
+        }
+    }
+    return sent;
+}
+
+// ============================================================================
+// Session Store (RTC memory)
+// ============================================================================
+
+void TlsClient::restoreSession() {
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT ||
+        sessionStore.magic != TLS_STORE_MAGIC || sessionStore.length > sizeof(sessionStore.data) ||
+        sessionStore.checksum != storeChecksum(sessionStore)) {
+        sessionStore.magic = 0;
+        return;
+    }
+    if (mbedtls_ssl_session_load(&session, sessionStore.data, sessionStore.length) == 0) {
+        haveSession = true;
+        Serial.println("[TLS] Session restored from before the restart");
+    } else {
+        mbedtls_ssl_session_free(&session);
+        mbedtls_ssl_session_init(&session);
+        sessionStore.magic = 0;
+    }
+}
+
+void TlsClient::storeSession() {
+    size_t length = 0;
+    int ret = mbedtls_ssl_session_save(&session, sessionStore.data, sizeof(sessionStore.data), &length);
+    if (ret != 0) {
+        if (ret == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+            Serial.printf("[TLS] Session (%luB) too large for the restart store\n", (unsigned long)length);
+        }
+        sessionStore.magic = 0;
+        return;
+    }
+    sessionStore.length = length;
+    sessionStore.magic = TLS_STORE_MAGIC;
+    sessionStore.checksum = storeChecksum(sessionStore);
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+void TlsClient::printStats() {
+    Serial.printf("[TELEMETRY]   tls full=%lu (last %lums, max %lums, %luB) resumed=%lu (last %lums, max %lums, %luB)\n",
+        (unsigned long)fullStats.count, (unsigned long)fullStats.lastMs,
+        (unsigned long)fullStats.maxMs, (unsigned long)fullStats.lastHeapBytes,
+        (unsigned long)resumedStats.count, (unsigned long)resumedStats.lastMs,
+        (unsigned long)resumedStats.maxMs, (unsigned long)resumedStats.lastHeapBytes);
+}
+
+// "tls":{...}; returns the number of characters written
+size_t TlsClient::formatStats(char* buf, size_t len) {
+    if (len == 0) return 0;
+    size_t pos = snprintf(buf, len,
+        "\"tls\":{\"full\":{\"n\":%lu,\"ms\":%lu,\"max_ms\":%lu,\"heap\":%lu},"
+        "\"resumed\":{\"n\":%lu,\"ms\":%lu,\"max_ms\":%lu,\"heap\":%lu}}",
+        (unsigned long)fullStats.count, (unsigned long)fullStats.lastMs,
+        (unsigned long)fullStats.maxMs, (unsigned long)fullStats.lastHeapBytes,
+        (unsigned long)resumedStats.count, (unsigned long)resumedStats.lastMs,
+        (unsigned long)resumedStats.maxMs, (unsigned long)resumedStats.lastHeapBytes);
+    return pos < len ? pos : len;
+}
+
+#endif // MQTT_ENABLED && MQTT_TLS
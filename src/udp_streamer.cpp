@@ -0,0 +1,158 @@
+#ifdef UDP_ENABLED
+
+#include "udp_streamer.h"
+#include "task_topology.h"
+#include "clock_source.h"
+#include "wifi_link.h"
+
+// Global instance
+UdpStreamer udpStreamer;
+
+UdpStreamer::UdpStreamer() :
+    gatewayId(0),
+    sequence(0),
+    task(nullptr) {
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    lock = unlocked;
+    memset(slots, 0, sizeof(slots));
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool UdpStreamer::begin() {
+    #ifdef UDP_GATEWAY_ID
+    gatewayId = UDP_GATEWAY_ID;
+    #else
+    gatewayId = (uint32_t)(ESP.getEfuseMac() >> 16);
+    #endif
+    Serial.printf("[UDP] Streaming to %s:%d every %lums (gateway %08lX)\n",
+        UDP_HOST, UDP_PORT, (unsigned long)UDP_INTERVAL_MS, (unsigned long)gatewayId);
+    return startTask(TASK_UDP, taskEntry, this, &task);
+}
+
+bool UdpStreamer::update(const SampleRecord& record) {
+    if (record.monitorIndex >= MAX_MONITORS || !record.monitor->identity) return false;
+
+    portENTER_CRITICAL(&lock);
+    Slot& slot = slots[record.monitorIndex];
+    if (slot.fresh) {
+        if (slot.replaced < 255) slot.replaced++;
+        stats.replaced++;
+    }
+    slot.fresh = true;
+    memcpy(slot.mac, record.monitor->identity->mac.bytes, sizeof(slot.mac));
+    slot.voltageMv = (uint16_t)(record.voltage * 1000.0f + 0.5f);
+    slot.soc = record.soc;
+    slot.temperature = record.temperature;
+    slot.status = record.status;
+    slot.rapidVoltageRise = record.rapidVoltageRise;
+    slot.rapidVoltageDrop = record.rapidVoltageDrop;
+    slot.arrivalUs = record.arrivalUs;
+    portEXIT_CRITICAL(&lock);
+    return true;
+}
+
+// ============================================================================
+// Stream Task
+// ============================================================================
+
+void UdpStreamer::taskEntry(void* param) {
+    ((UdpStreamer*)param)->run();
+}
+
+void UdpStreamer::run() {
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(UDP_INTERVAL_MS));
+        if (wifiLinkUp()) {
+            send();
+        }
+    }
+}
+
+static uint8_t* put16(uint8_t* p, uint16_t v) {
+    p[0] = v; p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t* put32(uint8_t* p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+    return p + 4;
+}
+
+void UdpStreamer::send() {
+    uint8_t datagram[UDP_HEADER_BYTES + MAX_MONITORS * UDP_RECORD_BYTES];
+    Slot taken[MAX_MONITORS];
+    uint8_t count = 0;
+
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < MAX_MONITORS; i++) {
+        if (!slots[i].fresh) continue;
+        taken[count++] = slots[i];
+        slots[i].fresh = false;
+        slots[i].replaced = 0;
+    }
+    portEXIT_CRITICAL(&lock);
+    if (count == 0) return;     // Nothing new since the last datagram
+
+    int64_t startUs = clockMicros();
+    uint8_t* p = datagram;
+    p = put16(p, UDP_MAGIC);
+    *p++ = UDP_VERSION;
+    *p++ = count;
+    p = put32(p, gatewayId);
+    p = put32(p, sequence);
+    uint64_t sentMs = (uint64_t)clockEpochMs(startUs);
+    p = put32(p, (uint32_t)sentMs);
+    p = put32(p, (uint32_t)(sentMs >> 32));
+
+    for (uint8_t i = 0; i < count; i++) {
+        const Slot& slot = taken[i];
+        memcpy(p, slot.mac, 6);
+        p += 6;
+        p = put16(p, slot.voltageMv);
+        *p++ = slot.soc;
+        *p++ = (uint8_t)slot.temperature;
+        *p++ = slot.status;
+        *p++ = slot.replaced;
+        p = put16(p, slot.rapidVoltageRise);
+        p = put16(p, slot.rapidVoltageDrop);
+        p = put32(p, (uint32_t)((startUs - slot.arrivalUs) / 1000));
+    }
+
+    // The sequence advances even if the send fails, so the receiver sees it as loss
+    sequence++;
+    size_t length = p - datagram;
+    if (!udp.beginPacket(UDP_HOST, UDP_PORT) ||
+        udp.write(datagram, length) != length ||
+        !udp.endPacket()) {
+        stats.sendErrors++;
+        return;
+    }
+    stats.datagrams++;
+    stats.records += count;
+    stats.lastSendUs = (uint32_t)(clockMicros() - startUs);
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+void UdpStreamer::printStats() {
+    Serial.printf("[TELEMETRY]   udp datagrams=%lu records=%lu replaced=%lu errors=%lu seq=%lu send=%luus\n",
+        (unsigned long)stats.datagrams, (unsigned long)stats.records,
+        (unsigned long)stats.replaced, (unsigned long)stats.sendErrors,
+        (unsigned long)sequence, (unsigned long)stats.lastSendUs);
+}
+
+// "udp":{...}; returns the number of characters written
+size_t UdpStreamer::formatStats(char* buf, size_t len) {
+    if (len == 0) return 0;
+    size_t pos = snprintf(buf, len,
+        "\"udp\":{\"datagrams\":%lu,\"records\":%lu,\"replaced\":%lu,\"errors\":%lu,\"seq\":%lu}",
+        (unsigned long)stats.datagrams, (unsigned long)stats.records,
+        (unsigned long)stats.replaced, (unsigned long)stats.sendErrors,
+        (unsigned long)sequence);
+    return pos < len ? pos : len;
+}
+
+#endif // UDP_ENABLED
@@ -0,0 +1,160 @@
+#include "warm_restart.h"
+#include <sys/time.h>
+#include "debug.h"
+
+#define WARM_MAGIC 0x42475732  // "BGW2" - bump when the layout changes
+
+struct WarmSlot {
+    char serial[13];            // Config serial the slot belongs to
+    uint8_t address[6];         // Last connected device address
+    uint8_t addressType;
+    bool hasAddress;
+    bool hasSample;
+    int8_t temperature;
+    uint8_t soc;
+    uint8_t status;
+    uint16_t rapidVoltageRise;
+    uint16_t rapidVoltageDrop;
+    float voltage;
+    int64_t sampleEpochMs;
+    float frameIntervalMean;
+    float frameIntervalJitter;
+    uint16_t frameIntervalSamples;
+};
+
+struct WarmSnapshot {
+    uint32_t magic;
+    uint32_t bootCount;         // Warm boots since last power-on
+    time_t epoch;               // Wall-clock time at save (0 = not synced)
+    WarmSlot slots[MAX_MONITORS];
+    uint32_t checksum;
+};
+
+// Not initialised on boot - contents survive everything except power loss
+static RTC_NOINIT_ATTR WarmSnapshot snapshot;
+
+// FNV-1a over everything except the checksum itself
+static uint32_t snapshotChecksum(const WarmSnapshot& snap) {
+    const uint8_t* p = (const uint8_t*)&snap;
+    size_t len = offsetof(WarmSnapshot, checksum);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void warmRestartSave(const BatteryMonitor* monitors, uint8_t count) {
+    WarmSnapshot next;
+    memset(&next, 0, sizeof(next));
+    next.magic = WARM_MAGIC;
+    next.bootCount = (snapshot.magic == WARM_MAGIC) ? snapshot.bootCount : 0;
+    
+    // Only keep NTP-synced time (not a provisional time restored below)
+    int64_t epochMs = clockEpochMs(clockMicros());
+    next.epoch = (time_t)(epochMs / 1000);
+    
+    for (uint8_t i = 0; i < count && i < MAX_MONITORS; i++) {
+        const BatteryMonitor& mon = monitors[i];
+        WarmSlot& slot = next.slots[i];
+        
+        strncpy(slot.serial, mon.config->serial, sizeof(slot.serial) - 1);
+        
+        // SampleTask and the BLE callbacks keep writing while we copy
+        portENTER_CRITICAL(&mon.sampleLock);
+        if (mon.lastAdvTime != 0 || mon.state == STATE_MONITORING) {
+            memcpy(slot.address, mon.deviceAddress.getNative(), 6);
+            slot.addressType = mon.deviceAddress.getType();
+            slot.hasAddress = true;
+        }
+        slot.hasSample = mon.voltage > 0.0f;
+        slot.voltage = mon.voltage;
+        slot.sampleEpochMs = mon.sampleEpochMs;
+        slot.soc = mon.soc;
+        slot.temperature = mon.temperature;
+        slot.status = mon.status;
+        slot.rapidVoltageRise = mon.rapidVoltageRise;
+        slot.rapidVoltageDrop = mon.rapidVoltageDrop;
+        slot.frameIntervalMean = mon.cadence.mean;
+        slot.frameIntervalJitter = mon.cadence.jitter;
+        slot.frameIntervalSamples = mon.cadence.samples;
+        portEXIT_CRITICAL(&mon.sampleLock);
+    }
+    
+    next.checksum = snapshotChecksum(next);
+    snapshot = next;
+}
+
+uint8_t warmRestartRestore(BatteryMonitor* monitors, uint8_t count) {
+    esp_reset_reason_t reason = esp_reset_reason();
+    
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT ||
+        snapshot.magic != WARM_MAGIC || snapshot.checksum != snapshotChecksum(snapshot)) {
+        DEBUG_PRINTF("[WARM] Cold boot (reset reason %d), no snapshot\n", reason);
+        snapshot.magic = 0;
+        return 0;
+    }
+    
+    snapshot.bootCount++;
+    snapshot.checksum = snapshotChecksum(snapshot);
+    
+    // The RTC keeps counting through most resets: if the time was NTP-synced
+    // before and is still ahead of the snapshot, samples can be stamped now.
+    // If the clock was lost, the snapshot is behind by the reset time plus up
+    // to WARM_SNAPSHOT_INTERVAL_MS - set it as a provisional time (logs, TLS
+    // certificate dates) but leave samples unstamped until NTP syncs.
+    time_t now;
+    time(&now);
+    if (snapshot.epoch != 0 && now >= snapshot.epoch) {
+        clockSyncWallTime();
+    } else if (snapshot.epoch != 0) {
+        struct timeval tv = { snapshot.epoch, 0 };
+        settimeofday(&tv, nullptr);
+        Serial.println("[WARM] Clock lost, provisional time from snapshot until NTP sync");
+    }
+    
+    uint8_t restored = 0;
+    unsigned long nowMs = clockMillis();
+    
+    for (uint8_t i = 0; i < count; i++) {
+        BatteryMonitor& mon = monitors[i];
+        if (!mon.config->enabled) continue;  // Slot removed at runtime
+        
+        // Match by serial so a changed config never restores into the wrong slot
+        for (uint8_t s = 0; s < MAX_MONITORS; s++) {
+            const WarmSlot& slot = snapshot.slots[s];
+            if (strncmp(slot.serial, mon.config->serial, sizeof(slot.serial)) != 0) continue;
+            
+            if (slot.hasSample) {
+                mon.voltage = slot.voltage;
+                mon.sampleEpochMs = slot.sampleEpochMs;
+                mon.soc = slot.soc;
+                mon.temperature = slot.temperature;
+                mon.status = slot.status;
+                mon.rapidVoltageRise = slot.rapidVoltageRise;
+                mon.rapidVoltageDrop = slot.rapidVoltageDrop;
+                mon.restoredSample = true;
+            }
+            mon.cadence.mean = slot.frameIntervalMean;
+            mon.cadence.jitter = slot.frameIntervalJitter;
+            mon.cadence.samples = slot.frameIntervalSamples;
+            
+            if (slot.hasAddress) {
+                // Connect straight away - treat the stored address as just heard
+                mon.deviceAddress = NimBLEAddress(slot.address, slot.addressType);
+                mon.lastAdvTime = nowMs;
+                mon.state = STATE_SCANNING;
+                restored++;
+            }
+            
+            Serial.printf("[%s] Warm restart: restored %s%s\n", mon.config->name,
+                slot.hasAddress ? "address" : "no address",
+                slot.hasSample ? " + last reading" : "");
+            break;
+        }
+    }
+    
+    Serial.printf("[WARM] Warm boot #%lu (reset reason %d), %d device(s) reconnect directly\n",
+        (unsigned long)snapshot.bootCount, reason, restored);
+    return restored;
+}
@@ -0,0 +1,64 @@
+#include "wifi_link.h"
+
+#ifdef WIFI_ENABLED
+
+#include <WiFi.h>
+#include <esp_sntp.h>
+#include "clock_source.h"
+#include "coex_scheduler.h"
+
+static bool started = false;
+static volatile bool linkUp = false;
+
+// SNTP callback - runs after every successful time sync
+static void onTimeSync(struct timeval* tv) {
+    clockSyncWallTime();
+    #ifdef DEBUG_MODE
+    Serial.printf("[WIFI] NTP time synced (%ld)\n", (long)tv->tv_sec);
+    #endif
+}
+
+// Runs in the WiFi event task once per (re)association
+static void onGotIp(arduino_event_id_t event) {
+    linkUp = true;
+    coexScheduler.noteNetworkActivity();
+    #ifdef DEBUG_MODE
+    Serial.printf("[WIFI] Connected! IP: %s\n", WiFi.localIP().toString().c_str());
+    #endif
+    Serial.printf("[BOOT] WiFi associated after %lums\n", clockMillis());
+    
+    // Configure NTP time synchronization (GMT+1, DST+1)
+    sntp_set_time_sync_notification_cb(onTimeSync);
+    configTime(3600, 3600, "pool.ntp.org", "time.nist.gov");
+}
+
+// Also raised for every failed reconnect attempt - only the first is logged
+static void onDisconnected(arduino_event_id_t event) {
+    if (!linkUp) return;
+    linkUp = false;
+    coexScheduler.noteNetworkActivity();
+    #ifdef DEBUG_MODE
+    Serial.println("[WIFI] Disconnected, driver is reconnecting...");
+    #endif
+}
+
+void wifiLinkBegin() {
+    if (started) return;
+    started = true;
+    
+    #ifdef DEBUG_MODE
+    Serial.printf("[WIFI] Connecting to %s\n", WIFI_SSID);
+    #endif
+    
+    WiFi.onEvent(onGotIp, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    WiFi.onEvent(onDisconnected, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+}
+
+bool wifiLinkUp() {
+    return linkUp;
+}
+
+#endif // WIFI_ENABLED
@@ -0,0 +1,184 @@
+/**
+ * BatteryMonitor benchmark: the policy template instantiated with the host
+ * simulator policies (SimTransport, PlainCipher, virtual SystemClock,
+ * StdioLogger muted).
+ *
+ *   pio test -e native-bench -f bench/test_monitor -v
+ *
+ * Reports object size, the per-frame monitor work SampleTask does, a full
+ * connect sequence through ConnectionEngine, and the cooldown poll with the
+ * clock as a static policy versus the same clock behind a virtual call (what
+ * the template removes). Wall time on the build host, not the ESP32.
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <unity.h>
+#include "connection_engine.h"
+
+static const uint32_t FRAME_ITERATIONS = 2000000;
+static const uint32_t CONNECT_ITERATIONS = 200000;
+static const uint32_t POLL_ITERATIONS = 20000000;
+
+static BatteryMonitor monitor;
+static SimTransport::Callbacks callbacks;
+static void onNotify(SimTransport::Characteristic*, uint8_t*, size_t, bool) {}
+ConnectionEngine connectionEngine(onNotify);
+
+static volatile uint32_t sink;
+
+static double nsPer(std::chrono::steady_clock::time_point start, uint32_t iterations) {
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+static void report(const char* what, double ns) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%-34s %8.1f ns", what, ns);
+    TEST_MESSAGE(msg);
+}
+
+void setUp() {
+    clockSetMillis(1000);
+    clockSeedRandom(1);
+}
+
+void tearDown() {}
+
+// ============================================================================
+// Size
+// ============================================================================
+
+void bench_size() {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "sizeof(BatteryMonitor) %u B (stats %u, health %u, trend %u)",
+        (unsigned)sizeof(BatteryMonitor), (unsigned)sizeof(DeviceStats),
+        (unsigned)sizeof(HealthEstimator), (unsigned)sizeof(TrendPredictor));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(sizeof(BatteryMonitor) > 0);
+}
+
+// ============================================================================
+// Frame path (as processFrame: decrypt, parse, store, stats/trend/health)
+// ============================================================================
+
+void bench_frame_path() {
+    const uint8_t frame[16] = {0xD1, 0x55, 0x07, 0x00, 0x16, 0x01, 0x55, 0x04,
+                               0xF7, 0x00, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00};
+    const ProtocolDecoder* decoder = monitor.decoder;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < FRAME_ITERATIONS; i++) {
+        clockAdvance(1000);
+        unsigned long now = clockMillis();
+        monitor.recordFrameArrival(now);
+
+        uint8_t decrypted[16];
+        BatteryMonitor::Cipher::decrypt(frame, decrypted, monitor.config->key);
+        DecodedSample sample;
+        decoder->parse(decrypted, sample);
+
+        portENTER_CRITICAL(&monitor.sampleLock);
+        monitor.voltage = sample.voltage;
+        monitor.soc = sample.soc;
+        monitor.temperature = sample.temperature;
+        monitor.status = sample.status;
+        monitor.lastUpdateTime = now;
+        portEXIT_CRITICAL(&monitor.sampleLock);
+        monitor.stats.add(now, monitor.voltage, monitor.temperature);
+        monitor.trend.update(now, monitor.soc, monitor.status == STATUS_CHARGING);
+        monitor.health.update(now, monitor.voltage, monitor.status, monitor.rapidVoltageDrop);
+        sink = monitor.livenessTimeoutMs();
+    }
+    double ns = nsPer(start, FRAME_ITERATIONS);
+    report("frame (decrypt..health, liveness)", ns);
+    TEST_ASSERT_TRUE(monitor.cadence.samples > 0);
+}
+
+// ============================================================================
+// Connect sequence (simulated link, no step time)
+// ============================================================================
+
+void bench_connect() {
+    SimTransport::link().failAt = SIM_NONE;
+    uint32_t ok = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < CONNECT_ITERATIONS; i++) {
+        ok += connectionEngine.connect(&monitor);
+        monitor.cleanup();
+    }
+    double ns = nsPer(start, CONNECT_ITERATIONS);
+    report("connect + handshake + cleanup", ns);
+    TEST_ASSERT_EQUAL_UINT32(CONNECT_ITERATIONS, ok);
+
+    SimTransport::link().failAt = SIM_CONNECT;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < CONNECT_ITERATIONS; i++) {
+        connectionEngine.connect(&monitor);
+        monitor.state = STATE_DISCONNECTED;     // Skip the backoff wait
+    }
+    ns = nsPer(start, CONNECT_ITERATIONS);
+    report("failed connect + retry schedule", ns);
+    SimTransport::link().failAt = SIM_NONE;
+}
+
+// ============================================================================
+// Cooldown poll: static clock policy vs. the same clock behind a vtable
+// ============================================================================
+
+struct ClockSource {
+    virtual ~ClockSource() {}
+    virtual unsigned long now() = 0;
+};
+
+struct VirtualClockSource : ClockSource {
+    unsigned long now() override { return clockMillis(); }
+};
+
+static VirtualClockSource virtualClockSource;
+static ClockSource* volatile dynamicClock = &virtualClockSource;
+
+struct DynamicClock {
+    static unsigned long now() { return dynamicClock->now(); }
+    static uint32_t random() { return clockRandom(); }
+};
+
+typedef BasicBatteryMonitor<SimTransport, PlainCipher, DynamicClock, StdioLogger> DynamicClockMonitor;
+
+template <class Monitor>
+static double pollCooldown(Monitor& m) {
+    m.connectRetries = 10;
+    m.scheduleRetry(clockMillis());
+    uint32_t cooling = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < POLL_ITERATIONS; i++) {
+        cooling += m.isInCooldown();
+        m.state = STATE_COOLDOWN;
+    }
+    double ns = nsPer(start, POLL_ITERATIONS);
+    sink = cooling;
+    return ns;
+}
+
+void bench_cooldown_poll() {
+    static DynamicClockMonitor dynamicMonitor;
+    double staticNs = pollCooldown(monitor);
+    double dynamicNs = pollCooldown(dynamicMonitor);
+    report("isInCooldown, static clock", staticNs);
+    report("isInCooldown, virtual clock call", dynamicNs);
+    TEST_ASSERT_TRUE(staticNs > 0 && dynamicNs > 0);
+}
+
+int main() {
+    StdioLogger::enabled() = false;
+    monitor.init(0, &DEVICES[0], &DEVICE_IDENTITIES.entries[0]);
+    monitor.attachClient(&callbacks);
+
+    UNITY_BEGIN();
+    RUN_TEST(bench_size);
+    RUN_TEST(bench_frame_path);
+    RUN_TEST(bench_connect);
+    RUN_TEST(bench_cooldown_poll);
+    return UNITY_END();
+}
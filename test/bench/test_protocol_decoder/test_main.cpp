@@ -0,0 +1,86 @@
+/**
+ * Protocol decoder benchmark: frame parse and handshake build per protocol,
+ * through the registry as SampleTask and the connection engine call them.
+ *
+ *   pio test -e native-bench -f bench/test_protocol_decoder -v
+ *
+ * Wall time on the build host, not the ESP32.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <unity.h>
+#include "protocol_decoder.h"
+
+static const uint32_t PARSE_ITERATIONS = 20000000;
+static const uint32_t HANDSHAKE_ITERATIONS = 2000000;
+
+static volatile uint32_t sink;
+
+// Known frames (see test/test_protocol_decoder), one per ProtocolId
+static const uint8_t FRAMES[PROTOCOL_COUNT][16] = {
+    {0xD1, 0x55, 0x07, 0x00, 0x16, 0x01, 0x55, 0x04, 0xF7, 0x00, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00},
+    {0xF5, 0x4F, 0x72, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
+};
+
+static double nsPer(std::chrono::steady_clock::time_point start, uint32_t iterations) {
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void bench_parse() {
+    for (uint8_t p = 0; p < PROTOCOL_COUNT; p++) {
+        const ProtocolDecoder* decoder = decoderFor((ProtocolId)p);
+        uint8_t frame[16];
+        memcpy(frame, FRAMES[p], sizeof(frame));
+        DecodedSample sample;
+        uint32_t ok = 0;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < PARSE_ITERATIONS; i++) {
+            frame[6] = (uint8_t)i;      // Vary the input so the loop is not hoisted
+            ok += decoder->parse(frame, sample);
+            sink = sample.soc;
+        }
+        double ns = nsPer(start, PARSE_ITERATIONS);
+
+        char msg[96];
+        snprintf(msg, sizeof(msg), "%s parse      %6.2f ns/frame", decoder->name, ns);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_EQUAL_UINT32(PARSE_ITERATIONS, ok);
+    }
+}
+
+void bench_handshake() {
+    DeviceConfig config = {};
+    config.type = AGM;
+    for (uint8_t p = 0; p < PROTOCOL_COUNT; p++) {
+        const ProtocolDecoder* decoder = decoderFor((ProtocolId)p);
+        uint8_t commands[HANDSHAKE_MAX_COMMANDS][16];
+        uint32_t total = 0;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < HANDSHAKE_ITERATIONS; i++) {
+            total += decoder->buildHandshake(&config, commands);
+            sink = commands[0][2];
+        }
+        double ns = nsPer(start, HANDSHAKE_ITERATIONS);
+
+        char msg[96];
+        snprintf(msg, sizeof(msg), "%s handshake  %6.2f ns (%lu commands)", decoder->name, ns,
+            (unsigned long)(total / HANDSHAKE_ITERATIONS));
+        TEST_MESSAGE(msg);
+    }
+    TEST_ASSERT_TRUE(true);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(bench_parse);
+    RUN_TEST(bench_handshake);
+    return UNITY_END();
+}
@@ -0,0 +1,264 @@
+/**
+ * Task topology benchmark: notification-to-publish latency through the
+ * firmware's pipeline, with the tasks as threads pinned like a TASK_TOPOLOGY
+ * layout.
+ *
+ *   pio test -e native-bench -f bench/test_task_topology -v
+ *
+ * notify (NimBLE host task) stamps and queues the raw frame; sample
+ * (SampleTask) decrypts, parses and updates the monitor, stats, trend and
+ * health, then copies the record into the latest-reading buffer like
+ * MqttSink; network (NetworkTask) builds the state payload from that copy. A
+ * load thread stands in for the WiFi stack on core 0. The network thread is
+ * woken per sample instead of polling every 50 ms, so the figures show the
+ * placement, not the poll interval.
+ *
+ * Layouts: "dual" = notify/sample on CPU 1, network/load on CPU 0 (the
+ * default table); "single" = everything on CPU 0 (TASK_SINGLE_CORE). The
+ * table's priorities are not applied (host scheduler). Wall time on the
+ * build host, not the ESP32; a host with one CPU only runs the single layout.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unity.h>
+#ifdef __linux__
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+#include "connection_engine.h"
+
+static const uint32_t FRAMES = 20000;
+static const uint32_t FRAME_SPACING_US = 250;   // 4 kHz across all slots
+static const uint32_t LOAD_BUSY_US = 2000;      // "WiFi" work per 10 ms
+static const uint32_t LOAD_PERIOD_US = 10000;
+
+static BatteryMonitor monitors[DEVICE_COUNT];
+static void onNotify(SimTransport::Characteristic*, uint8_t*, size_t, bool) {}
+ConnectionEngine connectionEngine(onNotify);
+
+typedef std::chrono::steady_clock Clock;
+
+static int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// Known BM6 / BM2 frames (see test/test_protocol_decoder)
+static const uint8_t FRAMES_BY_PROTOCOL[PROTOCOL_COUNT][16] = {
+    {0xD1, 0x55, 0x07, 0x00, 0x16, 0x01, 0x55, 0x04, 0xF7, 0x00, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00},
+    {0xF5, 0x4F, 0x72, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
+};
+
+// ============================================================================
+// Pipeline
+// ============================================================================
+
+struct RawFrame {
+    uint8_t monitorIndex;
+    uint8_t data[16];
+    int64_t arrivalUs;
+};
+
+struct Latest {
+    float voltage;
+    uint8_t soc;
+    int8_t temperature;
+    uint8_t status;
+    int64_t arrivalUs;
+    int64_t parsedUs;
+};
+
+// FreeRTOS queue stand-in
+template <typename T>
+class Queue {
+public:
+    void send(const T& item) {
+        std::lock_guard<std::mutex> guard(mutex);
+        items.push_back(item);
+        ready.notify_one();
+    }
+    bool receive(T& item) {
+        std::unique_lock<std::mutex> guard(mutex);
+        ready.wait(guard, [this] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+    void close() {
+        std::lock_guard<std::mutex> guard(mutex);
+        closed = true;
+        ready.notify_all();
+    }
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<T> items;
+    bool closed = false;
+};
+
+struct Run {
+    Queue<RawFrame> sampleQueue;
+    Queue<Latest> publishQueue;
+    std::vector<uint32_t> parseUs;
+    std::vector<uint32_t> publishUs;
+    std::atomic<bool> loadRunning;
+    Run() : loadRunning(true) {}
+};
+
+static bool pin(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Busy wait that still lets threads sharing the CPU run
+static void spinUntil(int64_t us) {
+    while (nowUs() < us) {
+        std::this_thread::yield();
+    }
+}
+
+static void notifyTask(Run* run, int cpu) {
+    pin(cpu);
+    int64_t next = nowUs();
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        next += FRAME_SPACING_US;
+        spinUntil(next);
+        RawFrame frame;
+        frame.monitorIndex = i % DEVICE_COUNT;
+        memcpy(frame.data, FRAMES_BY_PROTOCOL[monitors[frame.monitorIndex].config->protocol], 16);
+        frame.arrivalUs = nowUs();
+        run->sampleQueue.send(frame);
+    }
+    run->sampleQueue.close();
+}
+
+static void sampleTask(Run* run, int cpu) {
+    pin(cpu);
+    RawFrame frame;
+    while (run->sampleQueue.receive(frame)) {
+        BatteryMonitor& monitor = monitors[frame.monitorIndex];
+        unsigned long now = clockMillis();
+        monitor.recordFrameArrival(now);
+
+        uint8_t decrypted[16];
+        BatteryMonitor::Cipher::decrypt(frame.data, decrypted, monitor.config->key);
+        DecodedSample sample;
+        if (!monitor.decoder->parse(decrypted, sample)) continue;
+
+        portENTER_CRITICAL(&monitor.sampleLock);
+        monitor.voltage = sample.voltage;
+        monitor.soc = sample.soc;
+        monitor.temperature = sample.temperature;
+        monitor.status = sample.status;
+        monitor.lastUpdateTime = now;
+        portEXIT_CRITICAL(&monitor.sampleLock);
+        monitor.stats.add(now, sample.voltage, sample.temperature);
+        monitor.trend.update(now, sample.soc, sample.status == STATUS_CHARGING);
+        monitor.health.update(now, sample.voltage, sample.status, sample.rapidVoltageDrop);
+
+        // MqttSink: copy into the latest-reading buffer, wake the network side
+        Latest latest = { sample.voltage, sample.soc, sample.temperature, sample.status,
+                          frame.arrivalUs, nowUs() };
+        run->publishQueue.send(latest);
+    }
+    run->publishQueue.close();
+}
+
+static void networkTask(Run* run, int cpu) {
+    pin(cpu);
+    Latest latest;
+    char payload[160];
+    while (run->publishQueue.receive(latest)) {
+        snprintf(payload, sizeof(payload),
+            "{\"voltage\":%.2f,\"soc\":%u,\"temperature\":%d,\"charge\":%u,\"timestamp\":%lld}",
+            latest.voltage, latest.soc, latest.temperature, latest.status, (long long)latest.arrivalUs / 1000);
+        int64_t done = nowUs();
+        run->parseUs.push_back((uint32_t)(latest.parsedUs - latest.arrivalUs));
+        run->publishUs.push_back((uint32_t)(done - latest.arrivalUs));
+    }
+}
+
+static void loadTask(Run* run, int cpu) {
+    pin(cpu);
+    while (run->loadRunning) {
+        int64_t start = nowUs();
+        spinUntil(start + LOAD_BUSY_US);
+        std::this_thread::sleep_for(std::chrono::microseconds(LOAD_PERIOD_US - LOAD_BUSY_US));
+    }
+}
+
+static uint32_t percentile(std::vector<uint32_t>& values, uint32_t permille) {
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) * permille / 1000];
+}
+
+static void runLayout(const char* name, int sampleCpu, int networkCpu) {
+    Run run;
+    run.parseUs.reserve(FRAMES);
+    run.publishUs.reserve(FRAMES);
+
+    std::thread load(loadTask, &run, networkCpu);
+    std::thread network(networkTask, &run, networkCpu);
+    std::thread sample(sampleTask, &run, sampleCpu);
+    std::thread notify(notifyTask, &run, sampleCpu);
+    notify.join();
+    sample.join();
+    network.join();
+    run.loadRunning = false;
+    load.join();
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%-6s parse   p50 %5lu us  p99 %6lu us  max %6lu us", name,
+        (unsigned long)percentile(run.parseUs, 500), (unsigned long)percentile(run.parseUs, 990),
+        (unsigned long)percentile(run.parseUs, 1000));
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg), "%-6s publish p50 %5lu us  p99 %6lu us  max %6lu us", name,
+        (unsigned long)percentile(run.publishUs, 500), (unsigned long)percentile(run.publishUs, 990),
+        (unsigned long)percentile(run.publishUs, 1000));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(FRAMES, run.publishUs.size());
+}
+
+void setUp() {}
+void tearDown() {}
+
+void bench_single_core() {
+    runLayout("single", 0, 0);
+}
+
+void bench_dual_core() {
+    unsigned cpus = std::thread::hardware_concurrency();
+    if (cpus < 2) {
+        TEST_MESSAGE("dual   skipped: the host has one CPU");
+        return;
+    }
+    runLayout("dual", 1, 0);
+}
+
+int main() {
+    StdioLogger::enabled() = false;
+    for (uint8_t i = 0; i < DEVICE_COUNT; i++) {
+        monitors[i].init(i, &DEVICES[i], &DEVICE_IDENTITIES.entries[i]);
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(bench_single_core);
+    RUN_TEST(bench_dual_core);
+    return UNITY_END();
+}
@@ -0,0 +1,76 @@
+/**
+ * Battery Guard Multi-Device Monitor - Native Test Configuration
+ *
+ * Force-included by the native env (see platformio.ini) in place of the
+ * user's config.h: it takes the CONFIG_H guard first, so the tests always
+ * see this fixed two-device setup. Values match config.h.sample; tunables
+ * not listed here come from config_defaults.h.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "types.h"
+
+// ============================================================================
+// AES Encryption Keys
+// ============================================================================
+// Placeholders - the host cipher policy passes frames through unchanged
+const uint8_t AES_KEY_1[16] = {
+    0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11
+};
+
+const uint8_t AES_KEY_2[16] = {
+    0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+    0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22
+};
+
+// ============================================================================
+// Device Configuration
+// ============================================================================
+constexpr DeviceConfig DEVICES[] = {
+    {
+        .serial = "50547B815AFB",
+        .name = "Battery #1",
+        .mqttName = "battery1",
+        .type = LEAD_ACID,
+        .enabled = true,
+        .key = AES_KEY_1,
+        .protocol = PROTOCOL_BM6
+    },
+    {
+        .serial = "3CA5090A1B2C",
+        .name = "Battery #2",
+        .mqttName = "battery2",
+        .type = AGM,
+        .enabled = true,
+        .key = AES_KEY_2,
+        .protocol = PROTOCOL_BM2
+    }
+};
+
+constexpr uint8_t DEVICE_COUNT = sizeof(DEVICES) / sizeof(DEVICES[0]);
+
+#define MQTT_PREFIX "home/batteries"
+#define MQTT_UPDATE_INTERVAL 60
+#define MQTT_RETAINED false
+
+// ============================================================================
+// BLE Configuration
+// ============================================================================
+#define SCAN_INTERVAL 100
+#define SCAN_WINDOW 80
+#define SCAN_DURATION 5
+
+#define CONNECT_TIMEOUT_MS 30000
+#define MAX_CONNECT_RETRIES 3
+#define RETRY_COOLDOWN_MS 30000
+
+// ============================================================================
+// Monitoring Configuration
+// ============================================================================
+#define NOTIFICATION_TIMEOUT_MS 60000
+#define RECONNECT_DELAY_MS 2000
+
+#endif // CONFIG_H
@@ -0,0 +1,207 @@
+/**
+ * Backoff, liveness and millis() wraparound on the virtual clock.
+ *
+ *   pio test -e native -f test_link_timing
+ */
+
+#include <stdio.h>
+#include <unity.h>
+#include "clock_source.h"
+#include "link_timing.h"
+
+// Same values as config.h.sample
+static const uint8_t QUICK_RETRIES = 3;
+static const uint32_t FIRST_DELAY_MS = 2000;
+static const uint32_t MAX_DELAY_MS = 30000;
+static const uint8_t MISSED_FRAMES = 5;
+static const uint32_t FLOOR_MS = 3000;
+static const uint32_t CEILING_MS = 60000;
+static const uint16_t MIN_SAMPLES = 4;
+
+static const uint64_t WRAP_MS = 0x100000000ULL;  // millis() wraps here (49.7 days)
+
+void setUp() {
+    clockSetMillis(0);
+    clockSeedRandom(12345);
+}
+
+void tearDown() {}
+
+// ============================================================================
+// Backoff
+// ============================================================================
+
+void test_backoff_sequence() {
+    // Nominal delay after 0..9 consecutive failures
+    const uint32_t nominal[] = {2000, 2000, 2000, 4000, 8000, 16000, 30000, 30000, 30000, 30000};
+    for (uint8_t failures = 0; failures < 10; failures++) {
+        uint32_t delayMs = backoffDelayMs(failures, QUICK_RETRIES, FIRST_DELAY_MS,
+                                          MAX_DELAY_MS, clockRandom());
+        uint32_t jitter = nominal[failures] / 4;
+        TEST_ASSERT_UINT32_WITHIN(jitter, nominal[failures], delayMs);
+    }
+}
+
+void test_backoff_saturates() {
+    // connectRetries saturates at 255; the shift must not overflow
+    TEST_ASSERT_UINT32_WITHIN(MAX_DELAY_MS / 4, MAX_DELAY_MS,
+        backoffDelayMs(255, QUICK_RETRIES, FIRST_DELAY_MS, MAX_DELAY_MS, clockRandom()));
+    TEST_ASSERT_EQUAL_UINT32(MAX_DELAY_MS - MAX_DELAY_MS / 4,
+        backoffDelayMs(40, QUICK_RETRIES, FIRST_DELAY_MS, MAX_DELAY_MS, 0));
+}
+
+void test_backoff_reproducible() {
+    uint32_t first[8];
+    clockSeedRandom(7);
+    for (uint8_t i = 0; i < 8; i++) {
+        first[i] = backoffDelayMs(i, QUICK_RETRIES, FIRST_DELAY_MS, MAX_DELAY_MS, clockRandom());
+    }
+    clockSeedRandom(7);
+    for (uint8_t i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL_UINT32(first[i],
+            backoffDelayMs(i, QUICK_RETRIES, FIRST_DELAY_MS, MAX_DELAY_MS, clockRandom()));
+    }
+}
+
+void test_cooldown_across_wraparound() {
+    clockSetMillis(WRAP_MS - 500);
+    unsigned long since = clockMillis();
+    uint32_t delayMs = backoffDelayMs(QUICK_RETRIES, QUICK_RETRIES, FIRST_DELAY_MS,
+                                      MAX_DELAY_MS, 0);  // 4000 - 25%
+    TEST_ASSERT_EQUAL_UINT32(3000, delayMs);
+    
+    clockDelay(1000);                                    // now past the wrap
+    TEST_ASSERT_TRUE(clockMillis() < since);
+    TEST_ASSERT_FALSE(intervalElapsed(clockMillis(), since, delayMs));
+    clockAdvance(1999);
+    TEST_ASSERT_FALSE(intervalElapsed(clockMillis(), since, delayMs));
+    clockAdvance(1);
+    TEST_ASSERT_TRUE(intervalElapsed(clockMillis(), since, delayMs));
+}
+
+// ============================================================================
+// Liveness
+// ============================================================================
+
+// Deliver `count` frames `intervalMs` apart
+static void deliver(FrameCadence& cadence, uint8_t count, uint32_t intervalMs) {
+    for (uint8_t i = 0; i < count; i++) {
+        clockAdvance(intervalMs);
+        cadence.record(clockMillis(), 0, MIN_SAMPLES);
+    }
+}
+
+void test_liveness_ceiling_until_learned() {
+    FrameCadence cadence;
+    deliver(cadence, MIN_SAMPLES, 1000);  // First frame opens the gap: MIN_SAMPLES - 1 intervals
+    TEST_ASSERT_EQUAL_UINT32(CEILING_MS, cadence.timeoutMs(MISSED_FRAMES, FLOOR_MS, CEILING_MS, MIN_SAMPLES));
+    deliver(cadence, 1, 1000);
+    TEST_ASSERT_TRUE(cadence.timeoutMs(MISSED_FRAMES, FLOOR_MS, CEILING_MS, MIN_SAMPLES) < CEILING_MS);
+}
+
+void test_liveness_learns_cadence_across_wraparound() {
+    // One-second frames straddling the wrap
+    clockSetMillis(WRAP_MS - 10000);
+    FrameCadence cadence;
+    deliver(cadence, 30, 1000);
+    TEST_ASSERT_TRUE(clockMillis() < 30000);
+    
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 1000.0f, cadence.mean);
+    TEST_ASSERT_EQUAL_UINT32(0, cadence.missed);
+    uint32_t timeout = cadence.timeoutMs(MISSED_FRAMES, FLOOR_MS, CEILING_MS, MIN_SAMPLES);
+    TEST_ASSERT_UINT32_WITHIN(100, 5000, timeout);
+    
+    // Stale check as in the main loop: silence beyond the timeout
+    unsigned long last = cadence.lastArrival;
+    clockAdvance(timeout);
+    TEST_ASSERT_FALSE(elapsedMs(clockMillis(), last) > timeout);
+    clockAdvance(1);
+    TEST_ASSERT_TRUE(elapsedMs(clockMillis(), last) > timeout);
+}
+
+void test_liveness_counts_missed_frames_across_wraparound() {
+    clockSetMillis(WRAP_MS - 8000);
+    FrameCadence cadence;
+    deliver(cadence, 6, 1000);
+    
+    // Three frames lost while millis() wraps; WiFi was busy during the gap
+    clockAdvance(2500);
+    unsigned long netActivity = clockMillis();
+    clockAdvance(1500);
+    cadence.record(clockMillis(), netActivity, MIN_SAMPLES);
+    TEST_ASSERT_EQUAL_UINT32(3, cadence.missed);
+    TEST_ASSERT_EQUAL_UINT32(3, cadence.missedNet);
+    
+    // A gap without network activity is not attributed to it
+    clockAdvance(3000);
+    cadence.record(clockMillis(), netActivity, MIN_SAMPLES);
+    TEST_ASSERT_TRUE(cadence.missed > 3);
+    TEST_ASSERT_EQUAL_UINT32(3, cadence.missedNet);
+}
+
+void test_liveness_floor() {
+    FrameCadence cadence;
+    deliver(cadence, 10, 100);  // Fast device: 5 * 100ms is below the floor
+    TEST_ASSERT_EQUAL_UINT32(FLOOR_MS, cadence.timeoutMs(MISSED_FRAMES, FLOOR_MS, CEILING_MS, MIN_SAMPLES));
+}
+
+// Stream `frames` frames at `intervalMs` +/- `jitterMs`, then silence: returns
+// how long the link stays silent before it is declared stale. `falseStale`
+// counts jittered frames that arrived after the threshold.
+static uint32_t detectionLatency(uint32_t intervalMs, uint32_t jitterMs, uint16_t frames,
+                                 uint16_t& falseStale) {
+    FrameCadence cadence;
+    falseStale = 0;
+    for (uint16_t i = 0; i < frames; i++) {
+        uint32_t gap = intervalMs - jitterMs + clockRandom() % (2 * jitterMs + 1);
+        if (cadence.lastArrival != 0 &&
+            gap > cadence.timeoutMs(MISSED_FRAMES, FLOOR_MS, CEILING_MS, MIN_SAMPLES)) {
+            falseStale++;
+        }
+        clockAdvance(gap);
+        cadence.record(clockMillis(), 0, MIN_SAMPLES);
+    }
+    // Main loop checks every 100 ms
+    while (elapsedMs(clockMillis(), cadence.lastArrival) <=
+           cadence.timeoutMs(MISSED_FRAMES, FLOOR_MS, CEILING_MS, MIN_SAMPLES)) {
+        clockDelay(100);
+    }
+    return elapsedMs(clockMillis(), cadence.lastArrival);
+}
+
+void test_detection_latency() {
+    char msg[80];
+    uint16_t falseStale;
+    clockSetMillis(WRAP_MS - 60000);
+    uint32_t latency = detectionLatency(1000, 100, 120, falseStale);  // BM6/BM2: ~1 frame per second
+    snprintf(msg, sizeof(msg), "1 Hz +/-100 ms: stale after %lu ms", (unsigned long)latency);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT16(0, falseStale);
+    TEST_ASSERT_TRUE(latency < 6000);                       // Was NOTIFICATION_TIMEOUT_MS (60 s)
+    
+    latency = detectionLatency(500, 50, 120, falseStale);
+    snprintf(msg, sizeof(msg), "2 Hz +/-50 ms: stale after %lu ms", (unsigned long)latency);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT16(0, falseStale);
+    TEST_ASSERT_TRUE(latency < 4000);
+    
+    latency = detectionLatency(2000, 400, 120, falseStale);
+    snprintf(msg, sizeof(msg), "0.5 Hz +/-400 ms: stale after %lu ms", (unsigned long)latency);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT16(0, falseStale);
+    TEST_ASSERT_TRUE(latency < 14000);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_backoff_sequence);
+    RUN_TEST(test_backoff_saturates);
+    RUN_TEST(test_backoff_reproducible);
+    RUN_TEST(test_cooldown_across_wraparound);
+    RUN_TEST(test_liveness_ceiling_until_learned);
+    RUN_TEST(test_liveness_learns_cadence_across_wraparound);
+    RUN_TEST(test_liveness_counts_missed_frames_across_wraparound);
+    RUN_TEST(test_liveness_floor);
+    RUN_TEST(test_detection_latency);
+    return UNITY_END();
+}
@@ -0,0 +1,249 @@
+/**
+ * BatteryMonitor state machine over simulated weeks: the monitor and the
+ * connection engine on the simulated transport and the virtual clock,
+ * driven like loop() does it. Cooldown expiry and the liveness timeout are
+ * checked against 64-bit virtual time, across the millis() wraparound;
+ * phases over their budget fail the attempt.
+ *
+ *   pio test -e native -f test_monitor_timing
+ */
+
+#include <stdio.h>
+#include <unity.h>
+#include "connection_engine.h"
+
+static const uint64_t WRAP_MS = 0x100000000ULL;  // millis() wraps here (49.7 days)
+static const uint64_t WEEK_MS = 7ULL * 24 * 3600 * 1000;
+static const uint32_t TICK_MS = 100;              // loop() granularity
+
+static BatteryMonitor monitors[DEVICE_COUNT];
+static SimTransport::Callbacks callbacks[DEVICE_COUNT];
+static void onNotify(SimTransport::Characteristic*, uint8_t*, size_t, bool) {}
+ConnectionEngine connectionEngine(onNotify);
+
+// Virtual time that never wraps, for checking the wrapping millis() view
+static uint64_t nowMs() {
+    return (uint64_t)clockMicros() / 1000;
+}
+
+void setUp() {
+    clockSeedRandom(7);
+    SimTransport::Link& link = SimTransport::link();
+    link.failAt = SIM_NONE;
+    for (int s = 0; s < SIM_STEPS; s++) link.stepMs[s] = 0;
+    for (uint8_t i = 0; i < DEVICE_COUNT; i++) {
+        monitors[i].cleanup();
+        monitors[i].connectRetries = 0;
+        monitors[i].cadence = FrameCadence();
+    }
+}
+
+void tearDown() {}
+
+// ============================================================================
+// Cooldown
+// ============================================================================
+
+void test_cooldown_expires_across_wraparound() {
+    BatteryMonitor& monitor = monitors[0];
+    SimTransport::link().failAt = SIM_CONNECT;
+
+    // The failed connect blocks for CONNECT_TIMEOUT_MS, so the backoff
+    // starts 1 s before the wrap and ends after it
+    clockSetMillis(WRAP_MS - CONNECT_TIMEOUT_MS - 1000);
+    TEST_ASSERT_FALSE(connectionEngine.connect(&monitor));
+    TEST_ASSERT_EQUAL_UINT8(STATE_COOLDOWN, monitor.state);
+    uint64_t failedAt = nowMs();
+    TEST_ASSERT_TRUE(failedAt < WRAP_MS);
+    TEST_ASSERT_TRUE(failedAt + monitor.retryDelayMs > WRAP_MS);
+
+    while (monitor.isInCooldown()) {
+        clockAdvance(1);
+    }
+    TEST_ASSERT_EQUAL_UINT32(monitor.retryDelayMs, (uint32_t)(nowMs() - failedAt));
+    TEST_ASSERT_EQUAL_UINT8(STATE_DISCONNECTED, monitor.state);
+}
+
+// ============================================================================
+// Phase budgets
+// ============================================================================
+
+void test_slow_discover_fails_attempt() {
+    BatteryMonitor& monitor = monitors[0];
+    SimTransport::link().stepMs[SIM_DISCOVER] = DISCOVER_TIMEOUT_MS + 1;
+    ConnectionMetrics before = monitor.connectMetrics;
+
+    clockSetMillis(1000);
+    TEST_ASSERT_FALSE(connectionEngine.connect(&monitor));
+    TEST_ASSERT_EQUAL_UINT8(STATE_COOLDOWN, monitor.state);
+    TEST_ASSERT_EQUAL_UINT32(before.overruns[PHASE_DISCOVER] + 1, monitor.connectMetrics.overruns[PHASE_DISCOVER]);
+    TEST_ASSERT_EQUAL_UINT32(before.failures[PHASE_DISCOVER] + 1, monitor.connectMetrics.failures[PHASE_DISCOVER]);
+    TEST_ASSERT_FALSE(SimTransport::isConnected(monitor.pClient));
+}
+
+void test_handshake_stops_at_budget() {
+    // BM6: several writes; each blocks for half the budget, so the third
+    // is never sent
+    BatteryMonitor& monitor = monitors[0];
+    SimTransport::Link& link = SimTransport::link();
+    link.stepMs[SIM_WRITE] = HANDSHAKE_TIMEOUT_MS / 2;
+    uint32_t writesBefore = link.calls[SIM_WRITE];
+    uint32_t failuresBefore = monitor.connectMetrics.failures[PHASE_HANDSHAKE];
+
+    clockSetMillis(1000);
+    TEST_ASSERT_FALSE(connectionEngine.connect(&monitor));
+    TEST_ASSERT_EQUAL_UINT8(STATE_COOLDOWN, monitor.state);
+    TEST_ASSERT_EQUAL_UINT32(2, link.calls[SIM_WRITE] - writesBefore);
+    TEST_ASSERT_EQUAL_UINT32(failuresBefore + 1, monitor.connectMetrics.failures[PHASE_HANDSHAKE]);
+}
+
+// ============================================================================
+// Liveness
+// ============================================================================
+
+void test_liveness_timeout_across_wraparound() {
+    BatteryMonitor& monitor = monitors[0];
+    clockSetMillis(WRAP_MS - 30000);
+    TEST_ASSERT_TRUE(connectionEngine.connect(&monitor));
+
+    // 1 Hz frames straight through the wrap, then silence
+    for (int i = 0; i < 60; i++) {
+        clockAdvance(1000);
+        monitor.recordFrameArrival(clockMillis());
+        TEST_ASSERT_FALSE(monitor.linkStale(clockMillis()));
+    }
+    TEST_ASSERT_TRUE(nowMs() > WRAP_MS);
+    uint32_t timeout = monitor.livenessTimeoutMs();
+    TEST_ASSERT_TRUE(timeout < NOTIFICATION_TIMEOUT_MS);    // Learned from the cadence
+
+    uint64_t lastFrame = nowMs();
+    while (!monitor.linkStale(clockMillis())) {
+        clockAdvance(1);
+    }
+    TEST_ASSERT_EQUAL_UINT32(timeout + 1, (uint32_t)(nowMs() - lastFrame));
+}
+
+void test_liveness_grace_period() {
+    BatteryMonitor& monitor = monitors[0];
+    clockSetMillis(WRAP_MS - 1000);
+    TEST_ASSERT_TRUE(connectionEngine.connect(&monitor));
+
+    // No frame at all: stale only after the grace period and the (unlearned)
+    // ceiling, never right after the handshake
+    uint64_t enteredAt = nowMs();
+    while (!monitor.linkStale(clockMillis())) {
+        clockAdvance(TICK_MS);
+    }
+    TEST_ASSERT_UINT32_WITHIN(TICK_MS, NOTIFICATION_TIMEOUT_MS + TICK_MS, (uint32_t)(nowMs() - enteredAt));
+}
+
+// ============================================================================
+// Weeks of fleet operation
+// ============================================================================
+
+// Per-device link behaviour for the run
+struct Battery {
+    uint64_t sendingUntil;      // Frames stop here (battery out of range)
+    uint64_t lastFrame;
+    uint64_t cooldownFrom;      // Failure time of the current backoff
+};
+
+void test_weeks_of_operation() {
+    StdioLogger::enabled() = false;
+    Battery batteries[DEVICE_COUNT] = {};
+    uint32_t cooldowns = 0, cooldownsAcrossWrap = 0, staleLinks = 0, falseStale = 0;
+    uint32_t worstCooldownErrorMs = 0, worstStaleLatencyErrorMs = 0;
+
+    // Three weeks, the wrap in the middle
+    clockSetMillis(WRAP_MS - WEEK_MS - WEEK_MS / 2);
+    uint64_t endMs = nowMs() + 3 * WEEK_MS;
+
+    while (nowMs() < endMs) {
+        for (uint8_t i = 0; i < DEVICE_COUNT; i++) {
+            BatteryMonitor& monitor = monitors[i];
+            Battery& battery = batteries[i];
+
+            switch (monitor.state) {
+            case STATE_DISCONNECTED: {
+                // Advertisement heard: 30% of attempts fail in some phase
+                SimTransport::Link& link = SimTransport::link();
+                uint32_t r = clockRandom() % 100;
+                link.failAt = r < 10 ? SIM_CONNECT : r < 20 ? SIM_DISCOVER : r < 30 ? SIM_SUBSCRIBE : SIM_NONE;
+                link.stepMs[SIM_CONNECT] = 200 + clockRandom() % 3000;
+                if (connectionEngine.connect(&monitor)) {
+                    // Battery sends at 1 Hz for 1 min .. 2 h, then goes quiet
+                    battery.sendingUntil = nowMs() + 60000 + clockRandom() % (2 * 3600 * 1000);
+                    battery.lastFrame = nowMs();
+                } else {
+                    battery.cooldownFrom = nowMs();
+                    if (battery.cooldownFrom + monitor.retryDelayMs > WRAP_MS && battery.cooldownFrom < WRAP_MS) {
+                        cooldownsAcrossWrap++;
+                    }
+                }
+                break;
+            }
+            case STATE_COOLDOWN:
+                if (!monitor.isInCooldown()) {
+                    cooldowns++;
+                    uint64_t waited = nowMs() - battery.cooldownFrom;
+                    TEST_ASSERT_TRUE(waited >= monitor.retryDelayMs);
+                    uint32_t error = (uint32_t)(waited - monitor.retryDelayMs);
+                    if (error > worstCooldownErrorMs) worstCooldownErrorMs = error;
+                }
+                break;
+            case STATE_MONITORING:
+                if (nowMs() < battery.sendingUntil && nowMs() - battery.lastFrame >= 1000) {
+                    monitor.recordFrameArrival(clockMillis());
+                    battery.lastFrame = nowMs();
+                }
+                if (monitor.linkStale(clockMillis())) {
+                    if (nowMs() < battery.sendingUntil) {
+                        falseStale++;
+                    } else {
+                        staleLinks++;
+                        uint64_t silence = nowMs() - battery.lastFrame;
+                        TEST_ASSERT_TRUE(silence > monitor.livenessTimeoutMs());
+                        uint32_t error = (uint32_t)(silence - monitor.livenessTimeoutMs());
+                        if (error > worstStaleLatencyErrorMs) worstStaleLatencyErrorMs = error;
+                    }
+                    monitor.cleanup();
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        clockAdvance(TICK_MS);
+    }
+    StdioLogger::enabled() = true;
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "3 weeks: %lu cooldowns (%lu across the wrap, worst +%lu ms), %lu stale links (worst +%lu ms), %lu false",
+        (unsigned long)cooldowns, (unsigned long)cooldownsAcrossWrap, (unsigned long)worstCooldownErrorMs,
+        (unsigned long)staleLinks, (unsigned long)worstStaleLatencyErrorMs, (unsigned long)falseStale);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_TRUE(cooldowns > 100);
+    TEST_ASSERT_TRUE(staleLinks > 100);
+    TEST_ASSERT_EQUAL_UINT32(0, falseStale);
+    // Expiry and detection are late by at most a loop pass - plus, as in
+    // loop(), another slot's connect blocking until it times out
+    TEST_ASSERT_TRUE(worstCooldownErrorMs <= CONNECT_TIMEOUT_MS + DEVICE_COUNT * TICK_MS);
+    TEST_ASSERT_TRUE(worstStaleLatencyErrorMs <= CONNECT_TIMEOUT_MS + DEVICE_COUNT * TICK_MS);
+}
+
+int main() {
+    for (uint8_t i = 0; i < DEVICE_COUNT; i++) {
+        monitors[i].init(i, &DEVICES[i], &DEVICE_IDENTITIES.entries[i]);
+        monitors[i].attachClient(&callbacks[i]);
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_cooldown_expires_across_wraparound);
+    RUN_TEST(test_slow_discover_fails_attempt);
+    RUN_TEST(test_handshake_stops_at_budget);
+    RUN_TEST(test_liveness_timeout_across_wraparound);
+    RUN_TEST(test_liveness_grace_period);
+    RUN_TEST(test_weeks_of_operation);
+    return UNITY_END();
+}
@@ -0,0 +1,154 @@
+/**
+ * BM6/BM2 frame parsing against known decrypted frames.
+ *
+ *   pio test -e native -f test_protocol_decoder
+ */
+
+#include <unity.h>
+#include "protocol_decoder.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Parse into a sample pre-filled with garbage, so unset fields show up
+static bool parse(ProtocolId protocol, const uint8_t* frame, DecodedSample& sample) {
+    memset(&sample, 0xAA, sizeof(sample));
+    return decoderFor(protocol)->parse(frame, sample);
+}
+
+// ============================================================================
+// BM6
+// ============================================================================
+
+void test_bm6_frame() {
+    // 12.71V, 85%, 22°C, engine off, 3 rises, 1 drop
+    const uint8_t frame[16] = {0xD1, 0x55, 0x07, 0x00, 0x16, 0x01, 0x55, 0x04,
+                               0xF7, 0x00, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00};
+    DecodedSample s;
+    TEST_ASSERT_TRUE(parse(PROTOCOL_BM6, frame, s));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 12.71f, s.voltage);
+    TEST_ASSERT_EQUAL_UINT8(85, s.soc);
+    TEST_ASSERT_EQUAL_INT8(22, s.temperature);
+    TEST_ASSERT_EQUAL_UINT8(STATUS_NORMAL, s.status);
+    TEST_ASSERT_EQUAL_UINT16(3, s.rapidVoltageRise);
+    TEST_ASSERT_EQUAL_UINT16(1, s.rapidVoltageDrop);
+}
+
+void test_bm6_negative_temperature() {
+    // Byte 3 = 1: byte 4 is the magnitude of a negative temperature (-7°C)
+    const uint8_t frame[16] = {0xD1, 0x55, 0x07, 0x01, 0x07, 0x02, 0x5A, 0x05,
+                               0x46, 0x01, 0x2C, 0x00, 0x00, 0x00, 0x00, 0x00};
+    DecodedSample s;
+    TEST_ASSERT_TRUE(parse(PROTOCOL_BM6, frame, s));
+    TEST_ASSERT_EQUAL_INT8(-7, s.temperature);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 13.50f, s.voltage);
+    TEST_ASSERT_EQUAL_UINT8(90, s.soc);
+    TEST_ASSERT_EQUAL_UINT8(STATUS_CHARGING, s.status);
+    TEST_ASSERT_EQUAL_UINT16(300, s.rapidVoltageRise);
+    
+    // Any other sign byte reads as positive
+    uint8_t positive[16];
+    memcpy(positive, frame, sizeof(positive));
+    positive[3] = 0x00;
+    TEST_ASSERT_TRUE(parse(PROTOCOL_BM6, positive, s));
+    TEST_ASSERT_EQUAL_INT8(7, s.temperature);
+}
+
+void test_bm6_rejects_other_header() {
+    const uint8_t frame[16] = {0xD1, 0x56, 0x07, 0x00, 0x16, 0x01, 0x55, 0x04,
+                               0xF7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    DecodedSample s;
+    TEST_ASSERT_FALSE(decoderFor(PROTOCOL_BM6)->parse(frame, s));
+}
+
+void test_bm6_handshake() {
+    DeviceConfig config = {};
+    config.type = AGM;
+    uint8_t commands[HANDSHAKE_MAX_COMMANDS][16];
+    TEST_ASSERT_EQUAL_UINT8(6, decoderFor(PROTOCOL_BM6)->buildHandshake(&config, commands));
+    TEST_ASSERT_EQUAL_UINT8(0x08, commands[1][2]);
+    TEST_ASSERT_EQUAL_UINT8(AGM, commands[1][3]);
+    TEST_ASSERT_EQUAL_UINT8(0x07, commands[5][2]);
+}
+
+// ============================================================================
+// BM2
+// ============================================================================
+
+void test_bm2_frame() {
+    // Bytes 1-2: 0x4F7 (12.71V) in the top 12 bits, status 2 in the low nibble
+    const uint8_t frame[16] = {0xF5, 0x4F, 0x72, 0x50, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    DecodedSample s;
+    TEST_ASSERT_TRUE(parse(PROTOCOL_BM2, frame, s));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 12.71f, s.voltage);
+    TEST_ASSERT_EQUAL_UINT8(STATUS_CHARGING, s.status);
+    TEST_ASSERT_EQUAL_UINT8(80, s.soc);
+    TEST_ASSERT_EQUAL_INT8(0, s.temperature);
+    TEST_ASSERT_EQUAL_UINT16(0, s.rapidVoltageRise);
+    TEST_ASSERT_EQUAL_UINT16(0, s.rapidVoltageDrop);
+}
+
+void test_bm2_nibble_split() {
+    // All voltage bits set, status clear - and the reverse
+    const uint8_t maxVoltage[16] = {0xF5, 0xFF, 0xF0, 0x64};
+    DecodedSample s;
+    TEST_ASSERT_TRUE(parse(PROTOCOL_BM2, maxVoltage, s));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 40.95f, s.voltage);
+    TEST_ASSERT_EQUAL_UINT8(STATUS_NORMAL, s.status);
+    TEST_ASSERT_EQUAL_UINT8(100, s.soc);
+    
+    const uint8_t maxStatus[16] = {0xF5, 0x00, 0x0F, 0x00};
+    TEST_ASSERT_TRUE(parse(PROTOCOL_BM2, maxStatus, s));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, s.voltage);
+    TEST_ASSERT_EQUAL_UINT8(0x0F, s.status);
+}
+
+void test_bm2_status_mapping() {
+    // BM2 nibble -> BM6 status code the consumers (MQTT, trend, health) read
+    const uint8_t expected[16] = {STATUS_NORMAL, STATUS_NORMAL, STATUS_CHARGING, 3, 4, 5, 6, 7,
+                                  8, 9, 10, 11, 12, 13, 14, 15};
+    uint8_t frame[16] = {0xF5, 0x4F, 0x70, 0x50};
+    DecodedSample s;
+    for (uint8_t nibble = 0; nibble < 16; nibble++) {
+        frame[2] = 0x70 | nibble;
+        TEST_ASSERT_TRUE(parse(PROTOCOL_BM2, frame, s));
+        TEST_ASSERT_EQUAL_UINT8(expected[nibble], s.status);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, 12.71f, s.voltage);
+    }
+}
+
+void test_bm2_rejects_other_header() {
+    const uint8_t frame[16] = {0xD1, 0x55, 0x72, 0x50};
+    DecodedSample s;
+    TEST_ASSERT_FALSE(decoderFor(PROTOCOL_BM2)->parse(frame, s));
+}
+
+// ============================================================================
+// Registry
+// ============================================================================
+
+void test_decoder_lookup() {
+    TEST_ASSERT_EQUAL_STRING("BM6", decoderForAdvertisedName("Battery Guard")->name);
+    TEST_ASSERT_EQUAL_STRING("BM2", decoderForAdvertisedName("Battery Monitor")->name);
+    TEST_ASSERT_TRUE(decoderForAdvertisedName("Other") == nullptr);
+    TEST_ASSERT_EQUAL_STRING("BM6", decoderFor((ProtocolId)9)->name);
+    
+    DeviceConfig config = {};
+    uint8_t commands[HANDSHAKE_MAX_COMMANDS][16];
+    TEST_ASSERT_EQUAL_UINT8(0, decoderFor(PROTOCOL_BM2)->buildHandshake(&config, commands));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bm6_frame);
+    RUN_TEST(test_bm6_negative_temperature);
+    RUN_TEST(test_bm6_rejects_other_header);
+    RUN_TEST(test_bm6_handshake);
+    RUN_TEST(test_bm2_frame);
+    RUN_TEST(test_bm2_nibble_split);
+    RUN_TEST(test_bm2_status_mapping);
+    RUN_TEST(test_bm2_rejects_other_header);
+    RUN_TEST(test_decoder_lookup);
+    return UNITY_END();
+}
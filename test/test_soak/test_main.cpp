@@ -0,0 +1,159 @@
+/**
+ * Connect-path soak: pooled clients under months of failing and recovering
+ * links, on the simulated transport and the virtual clock. After setup the
+ * heap must stay flat - no allocation at all, so its layout (and with it
+ * fragmentation) cannot change.
+ *
+ *   pio test -e native -f test_soak
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <unity.h>
+#ifdef __GLIBC__
+  #include <malloc.h>
+#endif
+#include "connection_engine.h"
+
+static const uint32_t ATTEMPTS = 100000;
+static const uint64_t WRAP_MS = 0x100000000ULL;  // millis() wraps here (49.7 days)
+
+// ============================================================================
+// Allocation counting
+// ============================================================================
+static bool counting = false;
+static uint32_t allocations = 0;
+static uint32_t frees = 0;
+
+void* operator new(size_t size) {
+    if (counting) allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept {
+    if (counting && p) frees++;
+    free(p);
+}
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+// ============================================================================
+// Fixture
+// ============================================================================
+static BatteryMonitor monitors[DEVICE_COUNT];
+static SimTransport::Callbacks callbacks[DEVICE_COUNT];
+static void onNotify(SimTransport::Characteristic*, uint8_t*, size_t, bool) {}
+ConnectionEngine connectionEngine(onNotify);
+
+void setUp() {}
+void tearDown() {}
+
+// Script the next attempt: 40% connect timeouts, 15% discover, 10% subscribe,
+// 10% handshake write failures (BM2 has no handshake writes, so those
+// succeed), the rest succeed; step times vary per attempt
+static void scriptAttempt() {
+    SimTransport::Link& link = SimTransport::link();
+    uint32_t r = clockRandom() % 100;
+    link.failAt = r < 40 ? SIM_CONNECT : r < 55 ? SIM_DISCOVER : r < 65 ? SIM_SUBSCRIBE
+                : r < 75 ? SIM_WRITE : SIM_NONE;
+    link.stepMs[SIM_CONNECT] = 300 + clockRandom() % 2000;
+    link.stepMs[SIM_DISCOVER] = 100 + clockRandom() % 400;
+    link.stepMs[SIM_SUBSCRIBE] = 50 + clockRandom() % 200;
+    link.stepMs[SIM_WRITE] = 10;
+}
+
+void test_connect_path_does_not_allocate() {
+    clockSeedRandom(42);
+    clockSetMillis(WRAP_MS - 3600000);  // Wraps after the first simulated hour
+    uint64_t startMs = clockMicros() / 1000;
+    uint32_t successes = 0;
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 before = mallinfo2();
+#endif
+    counting = true;
+    for (uint32_t a = 0; a < ATTEMPTS; a++) {
+        BatteryMonitor& monitor = monitors[a % DEVICE_COUNT];
+        while (monitor.isInCooldown()) {
+            clockAdvance(100);
+        }
+        scriptAttempt();
+        if (!connectionEngine.connect(&monitor)) continue;
+        successes++;
+
+        // Up to 10 minutes of 1 Hz frames, then the battery drops off and
+        // the liveness check tears the link down
+        uint32_t frames = 1 + clockRandom() % 600;
+        for (uint32_t f = 0; f < frames; f++) {
+            clockAdvance(1000);
+            monitor.recordFrameArrival(clockMillis());
+        }
+        while (clockMillis() - monitor.lastNotificationTime <= monitor.livenessTimeoutMs()) {
+            clockAdvance(1000);
+        }
+        monitor.cleanup();
+    }
+    counting = false;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 after = mallinfo2();
+#endif
+
+    ConnectionMetrics total = {};
+    for (uint8_t i = 0; i < DEVICE_COUNT; i++) {
+        const ConnectionMetrics& m = monitors[i].connectMetrics;
+        total.attempts += m.attempts;
+        total.successes += m.successes;
+        for (int p = 0; p < PHASE_COUNT; p++) total.failures[p] += m.failures[p];
+    }
+
+    char msg[160];
+    double days = (clockMicros() / 1000 - startMs) / 86400000.0;
+    snprintf(msg, sizeof(msg), "%lu attempts (connect %lu, discover %lu, subscribe %lu, handshake %lu failed, %lu ok), %.1f simulated days",
+        (unsigned long)total.attempts, (unsigned long)total.failures[PHASE_CONNECT],
+        (unsigned long)total.failures[PHASE_DISCOVER], (unsigned long)total.failures[PHASE_SUBSCRIBE],
+        (unsigned long)total.failures[PHASE_HANDSHAKE], (unsigned long)total.successes, days);
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg), "allocations %lu, frees %lu", (unsigned long)allocations, (unsigned long)frees);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL_UINT32(ATTEMPTS, total.attempts);
+    TEST_ASSERT_EQUAL_UINT32(successes, total.successes);
+    TEST_ASSERT_TRUE(total.failures[PHASE_CONNECT] > 0 && total.failures[PHASE_DISCOVER] > 0 &&
+                     total.failures[PHASE_SUBSCRIBE] > 0 && total.failures[PHASE_HANDSHAKE] > 0);
+    TEST_ASSERT_TRUE(days > 50);                        // Crossed the wrap with margin
+    TEST_ASSERT_EQUAL_UINT32(0, allocations);
+    TEST_ASSERT_EQUAL_UINT32(0, frees);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    // Bytes in use and free-chunk count: the heap profile is unchanged
+    TEST_ASSERT_EQUAL_UINT32(before.uordblks, after.uordblks);
+    TEST_ASSERT_EQUAL_UINT32(before.ordblks, after.ordblks);
+#endif
+}
+
+void test_clients_are_reused() {
+    // One pooled client per slot, every attempt after the first reuses it
+    for (uint8_t i = 0; i < DEVICE_COUNT; i++) {
+        TEST_ASSERT_NOT_NULL(monitors[i].pClient);
+        for (uint8_t j = 0; j < i; j++) {
+            TEST_ASSERT_TRUE(monitors[i].pClient != monitors[j].pClient);
+        }
+        TEST_ASSERT_FALSE(SimTransport::isConnected(monitors[i].pClient));
+    }
+}
+
+int main() {
+    StdioLogger::enabled() = false;
+    for (uint8_t i = 0; i < DEVICE_COUNT; i++) {
+        monitors[i].init(i, &DEVICES[i], &DEVICE_IDENTITIES.entries[i]);
+        monitors[i].attachClient(&callbacks[i]);
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_connect_path_does_not_allocate);
+    RUN_TEST(test_clients_are_reused);
+    return UNITY_END();
+}
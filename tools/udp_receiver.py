@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""Receiver for the Battery Guard UDP frame stream (release-udp builds).
+
+Decodes the datagrams described in include/udp_streamer.h and periodically
+reports, per gateway: datagrams received, lost, reordered and duplicated, and
+latency percentiles.
+
+  net   = receive time - gateway send time (network + OS, one way)
+  frame = net + record age (BLE arrival -> received here)
+
+Both latencies compare the gateway's NTP clock with this host's clock, so
+they are only meaningful when both are NTP-synced; datagrams sent before
+the gateway's first sync (send time 0) are left out of them.
+
+Usage: tools/udp_receiver.py [--port 4210] [--interval 10] [--frames]
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+MAGIC = 0x4742
+VERSION = 1
+HEADER = struct.Struct("<HBBIIq")       # magic, version, count, gateway, sequence, sent ms
+RECORD = struct.Struct("<6sHBbBBHHI")   # mac, mV, soc, temp, status, replaced, vrise, vdrop, age ms
+RESTART_GAP = 1000                      # Sequence this far behind = gateway rebooted
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]
+
+
+def fmt_ms(value):
+    return "-" if value is None else "%.0f" % value
+
+
+class Gateway:
+    def __init__(self):
+        self.expected = None
+        self.received = 0
+        self.lost = 0
+        self.reordered = 0      # Arrived after a later sequence (not lost)
+        self.duplicates = 0
+        self.missing = set()
+        self.restarts = 0
+        self.records = 0
+        self.replaced = 0
+        self.net_ms = []
+        self.frame_ms = []
+
+    def sequence(self, seq):
+        if self.expected is None or seq == self.expected:
+            pass
+        elif seq > self.expected and seq - self.expected <= RESTART_GAP:
+            self.missing.update(range(self.expected, seq))
+            self.lost += seq - self.expected
+        elif seq < self.expected and self.expected - seq <= RESTART_GAP:
+            if seq in self.missing:
+                self.missing.discard(seq)
+                self.lost -= 1
+                self.reordered += 1
+            else:
+                self.duplicates += 1
+            return
+        else:
+            self.restarts += 1
+            self.missing.clear()
+        self.expected = seq + 1
+        if len(self.missing) > RESTART_GAP:
+            self.missing = set(m for m in self.missing if m >= seq - RESTART_GAP)
+
+    def report(self, gateway_id, elapsed):
+        total = self.received + self.lost
+        loss = 100.0 * self.lost / total if total else 0.0
+        print("%08X  rx=%d (%.1f/s) lost=%d (%.2f%%) reordered=%d dup=%d restarts=%d records=%d replaced=%d  "
+              "net p50/p99/max=%s/%s/%s ms  frame p50/p99/max=%s/%s/%s ms" % (
+                  gateway_id, self.received, self.received / elapsed, self.lost, loss, self.reordered, self.duplicates,
+                  self.restarts, self.records, self.replaced,
+                  fmt_ms(percentile(self.net_ms, 50)), fmt_ms(percentile(self.net_ms, 99)),
+                  fmt_ms(max(self.net_ms) if self.net_ms else None),
+                  fmt_ms(percentile(self.frame_ms, 50)), fmt_ms(percentile(self.frame_ms, 99)),
+                  fmt_ms(max(self.frame_ms) if self.frame_ms else None)))
+        self.net_ms = []
+        self.frame_ms = []
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bind", default="0.0.0.0", help="local address (default: all)")
+    parser.add_argument("--port", type=int, default=4210, help="UDP port (default: 4210)")
+    parser.add_argument("--interval", type=float, default=10.0, help="report interval in seconds")
+    parser.add_argument("--frames", action="store_true", help="print every decoded record")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind((args.bind, args.port))
+    sock.settimeout(0.5)
+    print("Listening on %s:%d" % (args.bind, args.port))
+
+    gateways = {}
+    malformed = 0
+    started = last_report = time.time()
+    while True:
+        try:
+            data, sender = sock.recvfrom(2048)
+            now_ms = time.time() * 1000.0
+        except socket.timeout:
+            data = None
+        except KeyboardInterrupt:
+            break
+
+        if data is not None:
+            if len(data) < HEADER.size:
+                malformed += 1
+                continue
+            magic, version, count, gateway_id, seq, sent_ms = HEADER.unpack_from(data)
+            if magic != MAGIC or version != VERSION or len(data) != HEADER.size + count * RECORD.size:
+                malformed += 1
+                continue
+
+            gateway = gateways.setdefault(gateway_id, Gateway())
+            gateway.received += 1
+            gateway.sequence(seq)
+            net = now_ms - sent_ms if sent_ms else None
+            if net is not None:
+                gateway.net_ms.append(net)
+
+            for i in range(count):
+                mac, mv, soc, temp, status, replaced, vrise, vdrop, age = \
+                    RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+                gateway.records += 1
+                gateway.replaced += replaced
+                if net is not None:
+                    gateway.frame_ms.append(net + age)
+                if args.frames:
+                    print("%08X #%d %s %.2fV %d%% %dC status=0x%02X vrise=%d vdrop=%d age=%dms%s" % (
+                        gateway_id, seq, ":".join("%02X" % b for b in mac), mv / 1000.0, soc, temp,
+                        status, vrise, vdrop, age, " replaced=%d" % replaced if replaced else ""))
+
+        now = time.time()
+        if now - last_report >= args.interval:
+            for gateway_id, gateway in sorted(gateways.items()):
+                gateway.report(gateway_id, now - started)
+            if malformed:
+                print("malformed datagrams: %d" % malformed)
+            last_report = now
+
+
+if __name__ == "__main__":
+    main()